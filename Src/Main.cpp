@@ -94,6 +94,7 @@ static gchar* s_debugTrapStr = NULL;
 static gboolean s_forceSoftwareRendering = false;
 static gchar* s_mallocStatsFileStr = NULL;
 static int s_mallocStatsInterval = -1;
+static int s_installerWorkers = 0;
 
 /**
  * Whether or not to debug crashes
@@ -593,6 +594,7 @@ static void parseCommandlineOptions(int argc, char** argv)
 		{ "force-software-rendering", 'S', 0, G_OPTION_ARG_NONE, &s_forceSoftwareRendering, "Force Software rendering", NULL},
 		{ "malloc-stats-file", 'm', 0, G_OPTION_ARG_STRING,  &s_mallocStatsFileStr, "File for logging malloc stats", "file" },
 		{ "malloc-stats-interval", 'i', 0, G_OPTION_ARG_INT,  &s_mallocStatsInterval, "Interval at which to log malloc stats", "seconds" },
+		{ "installer-workers", 'w', 0, G_OPTION_ARG_INT,  &s_installerWorkers, "Installer commands (other than installs and removes) that may run at once", "count" },
 		{ NULL }
 	};
 
@@ -775,6 +777,8 @@ int main( int argc, char** argv)
 
 	// Initialize the Application Installer
 	ApplicationInstaller::instance();
+	if (s_installerWorkers > 0)
+		ApplicationInstaller::instance()->setMaxConcurrentCommands(s_installerWorkers);
 
 	// Initialize the Event Reporter
 	EventReporter::init(host->mainLoop());
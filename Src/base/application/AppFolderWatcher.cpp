@@ -0,0 +1,235 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+
+
+#include "Common.h"
+
+#include <glib.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "AppFolderWatcher.h"
+
+// what happens to the roots: app folders appearing and disappearing
+static const uint32_t s_rootEventMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+// what happens inside an app folder or under its resources/: appinfo.json (or anything else) written, replaced or removed
+static const uint32_t s_folderEventMask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_ONLYDIR;
+
+// resources/<language>/<region>/ is the deepest place an appinfo.json is looked up
+const int AppFolderWatcher::s_maxResourceDepth = 3;
+
+AppFolderWatcher::AppFolderWatcher()
+	: m_fd(-1)
+	, m_overflowed(false)
+{
+}
+
+AppFolderWatcher::~AppFolderWatcher()
+{
+	stop();
+}
+
+bool AppFolderWatcher::start(const std::vector<std::string>& rootFolders)
+{
+	stop();
+
+	m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (m_fd < 0) {
+		g_warning("%s: inotify_init1 failed: %s", __FUNCTION__, strerror(errno));
+		return false;
+	}
+
+	m_roots = rootFolders;
+	m_missingRoots.clear();
+	m_overflowed = false;
+
+	for (std::vector<std::string>::const_iterator it = m_roots.begin(); it != m_roots.end(); ++it) {
+
+		const std::string& root = *it;
+		int wd = inotify_add_watch(m_fd, root.c_str(), s_rootEventMask);
+		if (wd < 0) {
+			//a root that doesn't exist (yet) is fine; the full walk finds nothing there either, until takeChanges() sees it appear
+			g_debug("%s: not watching %s: %s", __FUNCTION__, root.c_str(), strerror(errno));
+			m_missingRoots.push_back(root);
+			continue;
+		}
+		m_rootWatches[wd] = root;
+
+		struct dirent** list = NULL;
+		int count = ::scandir(root.c_str(), &list, 0, 0);
+		for (int i = 0; i < count; i++) {
+			if (list[i]) {
+				if (list[i]->d_name[0] != '.')
+					addFolderWatch(root + list[i]->d_name, root + list[i]->d_name, 0);
+				free(list[i]);
+			}
+		}
+		if (list)
+			free(list);
+	}
+
+	g_message("%s: watching %d roots, %d app and resource folders", __FUNCTION__, (int)m_rootWatches.size(), (int)m_folderWatches.size());
+	return true;
+}
+
+void AppFolderWatcher::stop()
+{
+	if (m_fd >= 0)
+		::close(m_fd);		//drops all the watches with it
+	m_fd = -1;
+	m_rootWatches.clear();
+	m_missingRoots.clear();
+	m_folderWatches.clear();
+	m_changedFolders.clear();
+}
+
+void AppFolderWatcher::addFolderWatch(const std::string& appFolder,const std::string& dirPath,int depth)
+{
+	int wd = inotify_add_watch(m_fd, dirPath.c_str(), s_folderEventMask);
+	if (wd < 0)
+		return;
+
+	WatchedDir& watched = m_folderWatches[wd];
+	watched.appFolder = appFolder;
+	watched.path = dirPath;
+	watched.depth = depth;
+
+	if (depth == 0) {
+		addFolderWatch(appFolder, dirPath + "/resources", 1);
+		return;
+	}
+	if (depth >= s_maxResourceDepth)
+		return;
+
+	struct dirent** list = NULL;
+	int count = ::scandir(dirPath.c_str(), &list, 0, 0);
+	for (int i = 0; i < count; i++) {
+		if (list[i]) {
+			//inotify_add_watch(IN_ONLYDIR) weeds out the plain files
+			if (list[i]->d_name[0] != '.')
+				addFolderWatch(appFolder, dirPath + "/" + list[i]->d_name, depth + 1);
+			free(list[i]);
+		}
+	}
+	if (list)
+		free(list);
+}
+
+void AppFolderWatcher::drain()
+{
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+	while (true) {
+
+		ssize_t len = ::read(m_fd, buf, sizeof(buf));
+		if (len <= 0) {
+			if (len < 0 && errno != EAGAIN && errno != EINTR) {
+				g_warning("%s: read failed: %s", __FUNCTION__, strerror(errno));
+				m_overflowed = true;
+			}
+			if (len < 0 && errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (char* p = buf; p < buf + len; ) {
+
+			const struct inotify_event* ev = reinterpret_cast<const struct inotify_event*>(p);
+			p += sizeof(struct inotify_event) + ev->len;
+
+			if (ev->mask & IN_Q_OVERFLOW) {
+				m_overflowed = true;
+				continue;
+			}
+
+			std::map<int,std::string>::iterator root_it = m_rootWatches.find(ev->wd);
+			if (root_it != m_rootWatches.end()) {
+
+				if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+					//the root itself is gone; can't tell what else happened
+					m_overflowed = true;
+					continue;
+				}
+				if (!ev->len || ev->name[0] == '.')
+					continue;
+
+				std::string folderPath = root_it->second + ev->name;
+				m_changedFolders.insert(folderPath);
+				if ((ev->mask & (IN_CREATE | IN_MOVED_TO)) && (ev->mask & IN_ISDIR))
+					addFolderWatch(folderPath, folderPath, 0);
+				continue;
+			}
+
+			std::map<int,WatchedDir>::iterator folder_it = m_folderWatches.find(ev->wd);
+			if (folder_it != m_folderWatches.end()) {
+				if (ev->mask & IN_IGNORED) {
+					//directory removed (its parent's IN_DELETE/IN_MOVED_FROM reports it)
+					m_folderWatches.erase(folder_it);
+					continue;
+				}
+				//addFolderWatch() below writes to m_folderWatches; work from a copy
+				WatchedDir watched = folder_it->second;
+				m_changedFolders.insert(watched.appFolder);
+
+				//a resources/ (or a directory below it) showing up has to be watched too, along with whatever was moved in with it
+				if ((ev->mask & (IN_CREATE | IN_MOVED_TO)) && (ev->mask & IN_ISDIR) && ev->len) {
+					std::string name(ev->name);
+					if (watched.depth == 0 ? (name == "resources") : (watched.depth < s_maxResourceDepth))
+						addFolderWatch(watched.appFolder, watched.path + "/" + name, watched.depth + 1);
+				}
+			}
+		}
+	}
+}
+
+bool AppFolderWatcher::takeChanges(std::set<std::string>& r_changedFolders)
+{
+	if (m_fd < 0)
+		return false;
+
+	drain();
+
+	//the apps in a root that's been created since are in none of the watches
+	for (std::vector<std::string>::const_iterator it = m_missingRoots.begin(); it != m_missingRoots.end(); ++it) {
+		struct stat st;
+		if (::stat(it->c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+			g_message("%s: %s has appeared", __FUNCTION__, it->c_str());
+			m_overflowed = true;
+			break;
+		}
+	}
+
+	if (m_overflowed) {
+		g_warning("%s: lost track of app folder changes; a full rescan is needed", __FUNCTION__);
+		std::vector<std::string> roots = m_roots;
+		start(roots);
+		return false;
+	}
+
+	r_changedFolders.insert(m_changedFolders.begin(), m_changedFolders.end());
+	m_changedFolders.clear();
+	return true;
+}
@@ -0,0 +1,81 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+
+
+#ifndef APPFOLDERWATCHER_H_
+#define APPFOLDERWATCHER_H_
+
+#include "Common.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+/*
+ * Watches a set of root folders (e.g. the lunaAppsPaths), every folder directly inside them, and each such folder's resources/
+ * subtree (where the localized appinfo.json files live) with inotify, and remembers which of those app folders were created,
+ * removed or had files written/replaced in them or anywhere under their resources/.
+ *
+ * The watcher is polled: takeChanges() drains the inotify queue without blocking and hands back the folders that changed since
+ * the last call. If the kernel queue overflowed (or a root itself went away), the change set can't be trusted; takeChanges()
+ * then returns false, re-arms all watches, and the caller has to fall back to walking the roots. A root that doesn't exist
+ * yet is checked for on every takeChanges(), and its showing up is handled the same way, which also starts watching it.
+ */
+class AppFolderWatcher
+{
+public:
+
+	AppFolderWatcher();
+	~AppFolderWatcher();
+
+	// every root must end in '/'. Changed folders are reported as root + name, the same way the scanners build their paths
+	bool start(const std::vector<std::string>& rootFolders);
+	void stop();
+	bool isActive() const { return m_fd >= 0; }
+
+	bool takeChanges(std::set<std::string>& r_changedFolders);
+
+private:
+
+	struct WatchedDir {
+		std::string appFolder;		// what gets reported when something changes in here
+		std::string path;
+		int depth;					// 0 for the app folder itself, 1 for its resources/, ...
+	};
+
+	void addFolderWatch(const std::string& appFolder,const std::string& dirPath,int depth);
+	void drain();
+
+	static const int s_maxResourceDepth;
+
+	int m_fd;
+	bool m_overflowed;
+	std::vector<std::string> m_roots;
+	std::vector<std::string> m_missingRoots;		// roots that couldn't be watched (not there yet)
+	std::map<int,std::string> m_rootWatches;
+	std::map<int,WatchedDir> m_folderWatches;
+	std::set<std::string> m_changedFolders;
+
+	AppFolderWatcher(const AppFolderWatcher&);
+	AppFolderWatcher& operator=(const AppFolderWatcher&);
+};
+
+#endif /* APPFOLDERWATCHER_H_ */
@@ -34,6 +34,7 @@
 #include "Settings.h"
 #include "MimeSystem.h"
 #include "ApplicationManager.h"
+#include "IconCache.h"
 #include <QMetaMethod>
 #include <QMetaObject>
 #include "Preferences.h"
@@ -67,6 +68,7 @@ ApplicationDescription::ApplicationDescription()
 	m_universalSearchJsonStr = "";
 	m_pBuiltin_launcher = 0;
     m_filePath = "";
+	m_registrationDeferred = false;
 }
 
 ApplicationDescription::~ApplicationDescription()
@@ -79,7 +81,8 @@ ApplicationDescription::~ApplicationDescription()
     	delete m_pBuiltin_launcher;
 }
 
-ApplicationDescription* ApplicationDescription::fromFile(const std::string& filePath, const std::string& folderPath)
+ApplicationDescription* ApplicationDescription::fromFile(const std::string& filePath, const std::string& folderPath, bool deferRegistration,
+												  bool offMainThread)
 {
 	bool success = false;
 	ApplicationDescription* appDesc = 0;
@@ -158,39 +161,13 @@ ApplicationDescription* ApplicationDescription::fromFile(const std::string& file
 	if ( label) {
 		if (utilExtractMimeTypes(label,extractedMimeTypes)) {
 			//found some!
-			for (std::vector<MimeRegInfo>::iterator it = extractedMimeTypes.begin();
-				it != extractedMimeTypes.end();
-				++it)
-			{
-				if ((*it).mimeType.size()) {
-					// ADD BY MIME TYPE.  The extension that is appropriate for this mimeType will be automatically filled in into "extension" if successful
-					if (MimeSystem::instance()->addResourceHandler((*it).extension,(*it).mimeType,!((*it).stream),appDesc->id(),NULL,false) > 0)
-						appDesc->m_mimeTypes.push_back(ResourceHandler((*it).extension,(*it).mimeType,appDesc->id(),(*it).stream));			//success adding to mime system, so add it to this app descriptor for bookeeping purposes
-				}
-				else if ((*it).extension.size()) {
-					// ADD BY EXTENSION... count on the extension->mime mapping to already exist, or this will fail
-					if (MimeSystem::instance()->addResourceHandler((*it).extension,!((*it).stream),appDesc->id(),NULL,false) > 0) {
-						//get the mime type
-						MimeSystem::instance()->getMimeTypeByExtension((*it).extension,(*it).mimeType);
-						appDesc->m_mimeTypes.push_back(ResourceHandler((*it).extension,(*it).mimeType,appDesc->id(),(*it).stream));
-					}
-				}
-				else if ((*it).scheme.size()) {			//TODO: fix this so it's more robust; it should check if the way the appinfo file specified the scheme is in fact a valid "scheme form" regexp and if not, make it one
-					// ADD REDIRECT: THIS IS A SCHEME or "COMMAND" FORM.... (e.g. "tel://")
-					(*it).scheme = std::string("^")+(*it).scheme+std::string(":");
-					if (MimeSystem::instance()->addRedirectHandler((*it).scheme,appDesc->id(),NULL,true,false) > 0) {
-						appDesc->m_redirectTypes.push_back(RedirectHandler((*it).scheme,appDesc->id(),true));
-					}
-				}
-				else if ((*it).urlPattern.size()) {
-					// ADD REDIRECT: THIS IS A PURE REDIRECT FORM... (e.g. "^[^:]+://www.youtube.com/watch\\?v="
-					if (MimeSystem::instance()->addRedirectHandler((*it).urlPattern,appDesc->id(),NULL,false,false) > 0) {
-						appDesc->m_redirectTypes.push_back(RedirectHandler((*it).urlPattern,appDesc->id(),false));
-					}
-				}
-			}
+			if (deferRegistration)
+				appDesc->m_deferredMimeRegs = extractedMimeTypes;
+			else
+				appDesc->registerMimeTypes(extractedMimeTypes);
 		}
 	}
+	appDesc->m_registrationDeferred = deferRegistration;
 	
 	// ICON: we have a default if this is not present.
 	if( appDesc->icon().length() == 0 )
@@ -439,7 +416,13 @@ ApplicationDescription* ApplicationDescription::fromFile(const std::string& file
     }
 
 	//check to see if it's a sysmgr-builtin
-	if (appDesc->m_type == Type_SysmgrBuiltin)
+	if (appDesc->m_type == Type_SysmgrBuiltin && offMainThread)
+	{
+		//the builtin launch helper has to be created on the main thread, and the localization lookup has to happen
+		//before the default launchpoint is made. Leave this one incomplete; the caller re-parses it without deferring
+		goto Done;
+	}
+	else if (appDesc->m_type == Type_SysmgrBuiltin)
 	{
 		//must have an entrypoint
 		label = json_object_object_get(root,"entrypoint");
@@ -491,6 +474,90 @@ Done:
 	return appDesc;
 }
 
+void ApplicationDescription::registerMimeTypes(std::vector<MimeRegInfo>& mimeRegs)
+{
+	MimeSystem::RegistrationBatch batch;
+	queueMimeRegistrations(mimeRegs,batch);
+	MimeSystem::instance()->addHandlers(batch);
+	mimeRegistrationsDone(batch,0,batch.entries.size());
+}
+
+void ApplicationDescription::queueMimeRegistrations(std::vector<MimeRegInfo>& mimeRegs,MimeSystem::RegistrationBatch& batch)
+{
+	for (std::vector<MimeRegInfo>::iterator it = mimeRegs.begin();
+		it != mimeRegs.end();
+		++it)
+	{
+		if ((*it).mimeType.size()) {
+			// ADD BY MIME TYPE.  The extension that is appropriate for this mimeType will be automatically filled in into "extension" if successful
+			batch.addResourceHandler((*it).extension,(*it).mimeType,!((*it).stream),m_id);
+		}
+		else if ((*it).extension.size()) {
+			// ADD BY EXTENSION... count on the extension->mime mapping to already exist, or this will fail
+			batch.addResourceHandler((*it).extension,!((*it).stream),m_id);
+		}
+		else if ((*it).scheme.size()) {			//TODO: fix this so it's more robust; it should check if the way the appinfo file specified the scheme is in fact a valid "scheme form" regexp and if not, make it one
+			// ADD REDIRECT: THIS IS A SCHEME or "COMMAND" FORM.... (e.g. "tel://")
+			(*it).scheme = std::string("^")+(*it).scheme+std::string(":");
+			batch.addRedirectHandler((*it).scheme,m_id,true);
+		}
+		else if ((*it).urlPattern.size()) {
+			// ADD REDIRECT: THIS IS A PURE REDIRECT FORM... (e.g. "^[^:]+://www.youtube.com/watch\\?v="
+			batch.addRedirectHandler((*it).urlPattern,m_id,false);
+		}
+	}
+}
+
+// bookkeeping for this app's entries [first,last) of a batch that has been through MimeSystem::addHandlers()
+void ApplicationDescription::mimeRegistrationsDone(const MimeSystem::RegistrationBatch& batch,size_t first,size_t last)
+{
+	for (size_t i = first; i < last; ++i) {
+		const MimeSystem::RegistrationBatch::Entry& entry = batch.entries[i];
+		if (entry.result <= 0)
+			continue;
+		//success adding to mime system, so add it to this app descriptor for bookeeping purposes
+		if (entry.kind == MimeSystem::RegistrationBatch::Redirect)
+			m_redirectTypes.push_back(RedirectHandler(entry.url,m_id,entry.schemeForm));
+		else
+			m_mimeTypes.push_back(ResourceHandler(entry.extension,entry.mimeType,m_id,!entry.shouldDownload));
+	}
+}
+
+void ApplicationDescription::completeRegistration()
+{
+	if (!m_registrationDeferred)
+		return;
+
+	registerMimeTypes(m_deferredMimeRegs);
+	m_deferredMimeRegs.clear();
+	m_registrationDeferred = false;
+}
+
+//static
+void ApplicationDescription::completeRegistrations(const std::vector<ApplicationDescription*>& apps)
+{
+	MimeSystem::RegistrationBatch batch;
+	std::vector<size_t> firstEntry;
+
+	for (std::vector<ApplicationDescription*>::const_iterator it = apps.begin(); it != apps.end(); ++it) {
+		firstEntry.push_back(batch.entries.size());
+		if ((*it)->m_registrationDeferred)
+			(*it)->queueMimeRegistrations((*it)->m_deferredMimeRegs,batch);
+	}
+
+	if (!batch.entries.empty())
+		MimeSystem::instance()->addHandlers(batch);
+
+	for (size_t i = 0; i < apps.size(); ++i) {
+		ApplicationDescription* appDesc = apps[i];
+		if (!appDesc->m_registrationDeferred)
+			continue;
+		appDesc->mimeRegistrationsDone(batch,firstEntry[i],(i+1 < apps.size() ? firstEntry[i+1] : batch.entries.size()));
+		appDesc->m_deferredMimeRegs.clear();
+		appDesc->m_registrationDeferred = false;
+	}
+}
+
 ApplicationDescription* ApplicationDescription::fromApplicationStatus(const ApplicationStatus& appStatus, bool isUpdating)
 {
 	ApplicationDescription* appDesc = new ApplicationDescription();
@@ -531,6 +598,14 @@ ApplicationDescription* ApplicationDescription::fromJsonString(const char* jsonS
         fprintf( stderr, "ApplicationDescriptionBase::fromJsonString: Failed to parse string into a JSON string.\n" );
         return 0;
     }
+    ApplicationDescription* appDesc = fromJson(root);
+    json_object_put(root);
+    return appDesc;
+}
+
+//static
+ApplicationDescription* ApplicationDescription::fromJson(struct json_object* root)
+{
     ApplicationDescription* appDesc = new ApplicationDescription();
 
     bool success = appDesc->fromJsonObject(root);
@@ -572,11 +647,124 @@ ApplicationDescription* ApplicationDescription::fromJsonString(const char* jsonS
         delete appDesc;
         appDesc = 0;
     }
-    if(root)
-        json_object_put(root);
     return appDesc;
 }
 
+std::string ApplicationDescription::toSnapshotString() const
+{
+	json_object* json = toJSON();
+
+	//the rest of what fromJsonString() expects...
+	json_object_object_add(json, (char*) "splashicon", json_object_new_string(m_splashIconName.c_str()));
+	json_object_object_add(json, (char*) "splashBackground", json_object_new_string(m_splashBackgroundName.c_str()));
+	json_object_object_add(json, (char*) "miniicon", json_object_new_string(m_miniIconName.c_str()));
+	json_object_object_add(json, (char*) "folderPath", json_object_new_string(m_folderPath.c_str()));
+	json_object_object_add(json, (char*) "attributes", json_object_new_string(m_attributes.c_str()));
+	json_object_object_add(json, (char*) "transparent", json_object_new_boolean(m_hasTransparentWindows));
+	json_object_object_add(json, (char*) "userHideable", json_object_new_boolean(m_isUserHideable));
+	json_object_object_add(json, (char*) "visible", json_object_new_boolean(m_isVisible));
+	json_object_object_add(json, (char*) "launchinnewgroup", json_object_new_boolean(m_launchInNewGroup));
+	json_object_object_add(json, (char*) "hardwareFeaturesNeeded", json_object_new_int((int)m_hardwareFeaturesNeeded));
+	json_object_object_add(json, (char*) "type", json_object_new_int((int)m_type));
+	json_object_object_add(json, (char*) "runtimeMemoryRequired", json_object_new_int((int)m_runtimeMemoryRequired));
+
+	//...and what only fromFile() sets up
+	json_object* extra = json_object_new_object();
+	json_object_object_add(extra, (char*) "filePath", json_object_new_string(m_filePath.c_str()));
+	json_object_object_add(extra, (char*) "dockMode", json_object_new_boolean(m_dockMode));
+	json_object_object_add(extra, (char*) "dockModeTitle", json_object_new_string(m_dockModeTitle.c_str()));
+	json_object_object_add(extra, (char*) "universalSearch", json_object_new_string(m_universalSearchJsonStr.c_str()));
+	json_object_object_add(extra, (char*) "services", json_object_new_string(m_servicesJsonStr.c_str()));
+	json_object_object_add(extra, (char*) "accounts", json_object_new_string(m_accountsJsonStr.c_str()));
+
+	const LaunchPoint* defaultLP = getDefaultLaunchPoint();
+	json_object_object_add(extra, (char*) "params", json_object_new_string(defaultLP ? defaultLP->params().c_str() : ""));
+
+	json_object* keywords = json_object_new_array();
+	std::list<std::string> allKeywords = m_keywords.allKeywords();
+	for (std::list<std::string>::const_iterator it = allKeywords.begin(); it != allKeywords.end(); ++it)
+		json_object_array_add(keywords, json_object_new_string((*it).c_str()));
+	json_object_object_add(extra, (char*) "keywords", keywords);
+
+	//same shape as the appinfo.json "mimeTypes" array, so utilExtractMimeTypes() reads it back
+	json_object* mimeTypes = json_object_new_array();
+	for (std::vector<MimeRegInfo>::const_iterator it = m_deferredMimeRegs.begin(); it != m_deferredMimeRegs.end(); ++it) {
+		json_object* mri = json_object_new_object();
+		if ((*it).mimeType.size())
+			json_object_object_add(mri, (char*) "mime", json_object_new_string((*it).mimeType.c_str()));
+		if ((*it).extension.size())
+			json_object_object_add(mri, (char*) "extension", json_object_new_string((*it).extension.c_str()));
+		if ((*it).urlPattern.size())
+			json_object_object_add(mri, (char*) "urlPattern", json_object_new_string((*it).urlPattern.c_str()));
+		if ((*it).scheme.size())
+			json_object_object_add(mri, (char*) "scheme", json_object_new_string((*it).scheme.c_str()));
+		json_object_object_add(mri, (char*) "stream", json_object_new_boolean((*it).stream));
+		json_object_array_add(mimeTypes, mri);
+	}
+	json_object_object_add(extra, (char*) "mimeTypes", mimeTypes);
+
+	json_object_object_add(json, (char*) "snapshot", extra);
+
+	std::string s = json_object_to_json_string(json);
+	json_object_put(json);
+	return s;
+}
+
+//static
+ApplicationDescription* ApplicationDescription::fromSnapshotString(const std::string& snapshot)
+{
+	struct json_object* root = json_tokener_parse(snapshot.c_str());
+	if (!root)
+		return 0;
+
+	ApplicationDescription* appDesc = fromJson(root);
+	if (!appDesc) {
+		json_object_put(root);
+		return 0;
+	}
+
+	struct json_object* extra = JsonGetObject(root, "snapshot");
+	struct json_object* label = 0;
+	std::string launchParams;
+	bool success = (extra != 0) && (appDesc->m_type != Type_SysmgrBuiltin);
+
+	if (success) {
+		success &= extractFromJson(extra, "filePath", appDesc->m_filePath);
+		success &= extractFromJson(extra, "dockMode", appDesc->m_dockMode);
+		success &= extractFromJson(extra, "dockModeTitle", appDesc->m_dockModeTitle);
+		success &= extractFromJson(extra, "universalSearch", appDesc->m_universalSearchJsonStr);
+		success &= extractFromJson(extra, "services", appDesc->m_servicesJsonStr);
+		success &= extractFromJson(extra, "accounts", appDesc->m_accountsJsonStr);
+		success &= extractFromJson(extra, "params", launchParams);
+
+		label = JsonGetObject(extra, "keywords");
+		if (label)
+			appDesc->m_keywords.addKeywords(label);
+
+		label = JsonGetObject(extra, "mimeTypes");
+		if (label)
+			utilExtractMimeTypes(label, appDesc->m_deferredMimeRegs);
+		appDesc->m_registrationDeferred = true;
+	}
+
+	json_object_put(root);
+
+	if (!success) {
+		delete appDesc;
+		return 0;
+	}
+
+	// Default launchpoint, as fromFile() makes it
+	LaunchPoint * defaultLp = new LaunchPoint(appDesc,
+			  appDesc->id(),
+			  appDesc->id() + "_default",
+			  appDesc->title(), appDesc->m_appmenuName, appDesc->icon(), launchParams, appDesc->m_isRemovable);
+	defaultLp->setAsDefault();
+	appDesc->m_launchPoints.push_back(defaultLp);
+
+	return appDesc;
+}
+
 ApplicationDescription* ApplicationDescription::fromNativeDockApp(const std::string& id, 
 		const std::string& title, const std::string& version,
 		const std::string& splashIcon, const std::string& splashBackgroundName,
@@ -981,26 +1169,11 @@ void ApplicationDescription::getAppDescriptionString(std::string &descString) co
 	json_object_put(json);
 }
 
-void desaturate(QImage &img)
-{
-	int length = img.sizeInBytes();
-	uchar* data = img.bits();
-
-	int avg;
-
-	for (int i = 0; i < length; i += 4) {
-		avg = (data[i] + data[i+1] + data[i+2]) / 3;
-		data[i]   = avg;
-		data[i+1] = avg;
-		data[i+2] = avg;
-	}
-}
-
 QPixmap ApplicationDescription::miniIcon() const
 {
-	QPixmap pix(m_miniIconName.c_str());
-	if (!pix.isNull()) {
-		return pix;
+	QImage miniImg = IconCache::instance()->image(m_miniIconName);
+	if (!miniImg.isNull()) {
+		return QPixmap::fromImage(miniImg);
 	}
 
 	// if there is no mini-icon, we will scale and desaturate the regular app icon
@@ -1013,13 +1186,7 @@ QPixmap ApplicationDescription::miniIcon() const
 
 	const LaunchPoint* lp = m_launchPoints.front();
 
-	QImage img = QImage(qFromUtf8Stl(lp->iconPath())).scaled(miniIconSize, miniIconSize,
-		                Qt::IgnoreAspectRatio,
-		                Qt::SmoothTransformation);
-	desaturate(img);
-	pix = QPixmap::fromImage(img);
-
-	return pix;
+	return QPixmap::fromImage(IconCache::instance()->image(lp->iconPath(), miniIconSize, miniIconSize, true));
 }
 
 void ApplicationDescription::startSysmgrBuiltIn(const std::string& jsonArgsString) const
@@ -29,6 +29,7 @@
 #include "LaunchPoint.h"
 #include "KeywordMap.h"
 #include "CmdResourceHandlers.h"
+#include "MimeSystem.h"
 #include <ApplicationDescriptionBase.h>
 
 struct json_object;
@@ -85,8 +86,18 @@ public:
 	ApplicationDescription();
 	~ApplicationDescription();
 
-	static ApplicationDescription* fromFile(const std::string& filePath, const std::string& folderPath);
+	// with deferRegistration = true, nothing is registered with the MimeSystem; completeRegistration() must then be called
+	// (on the main thread) before the app is put in service. With offMainThread = true as well, the result can be produced off
+	// the main thread, except that sysmgr builtins can't be fully parsed that way: they come back with isRegistrationDeferred()
+	// set and type Type_SysmgrBuiltin and should be re-parsed on the main thread
+	static ApplicationDescription* fromFile(const std::string& filePath, const std::string& folderPath, bool deferRegistration = false,
+											bool offMainThread = false);
     static ApplicationDescription* fromJsonString(const char* jsonStr);
+	// toJSON() plus everything else fromFile() fills in (the pending mime registrations, the default launch point's params, ...),
+	// so that RegistrySnapshot can hand back an unchanged app without re-parsing its appinfo.json. Only valid for a description
+	// fresh out of fromFile(..,..,true) that isn't a sysmgr builtin; fromSnapshotString() returns it with its registration deferred
+	static ApplicationDescription* fromSnapshotString(const std::string& snapshot);
+	std::string toSnapshotString() const;
 	static ApplicationDescription* fromApplicationStatus(const ApplicationStatus& appStatus, bool isUpdating);
 	static ApplicationDescription* fromNativeDockApp(const std::string& id, const std::string& title, 
 						const std::string& version, const std::string& splashIcon,
@@ -194,6 +205,11 @@ public:
 
 	bool initSysmgrBuiltIn(QObject * pReceiver,const std::string& entrypt,const std::string& args);
 
+	bool isRegistrationDeferred() const { return m_registrationDeferred; }
+	void completeRegistration();
+	// same as completeRegistration() on each of apps in turn (those not deferred are skipped), but with one MimeSystem batch for all of them
+	static void completeRegistrations(const std::vector<ApplicationDescription*>& apps);
+
 	void dbgSetProgressManually(int progv) { m_progress = progv; }
 
     bool securityChecksVerified();
@@ -228,7 +244,14 @@ private:
 		bool stream;
 	};
 
+	static ApplicationDescription* fromJson(struct json_object* root);		// the body of fromJsonString()
 	static int 	utilExtractMimeTypes(struct json_object * jsonMimeTypeArray,std::vector<MimeRegInfo>& extractedMimeTypes);
+	void		registerMimeTypes(std::vector<MimeRegInfo>& mimeRegs);
+	void		queueMimeRegistrations(std::vector<MimeRegInfo>& mimeRegs,MimeSystem::RegistrationBatch& batch);
+	void		mimeRegistrationsDone(const MimeSystem::RegistrationBatch& batch,size_t first,size_t last);
+
+	bool						m_registrationDeferred;
+	std::vector<MimeRegInfo>	m_deferredMimeRegs;
 
     std::string                 m_filePath;
 	std::string            		m_category;
@@ -51,7 +51,6 @@
 #include <json_util.h>
 #include <errno.h>
 
-#include <ftw.h>
 #include <dirent.h>
 #include <regex.h>
 #include <glib.h>
@@ -59,8 +58,14 @@
 #include <algorithm>
 
 #include <QUrl>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <openssl/err.h>
 
 #include "PackageDescription.h"
+#include "DiskUsage.h"
+#include "PackageSizeCache.h"
 
 #define REMOVER_RETURNC__FAILEDIPKGREMOVE			1
 #define REMOVER_RETURNC__SUCCESS					0
@@ -89,6 +94,7 @@ static void util_unmountCryptofs() __attribute__((unused));
 static gboolean util_cryptofsPathAvailable() __attribute__((unused));
 static void util_validateCryptofs() __attribute__((unused));
 static int runScriptCwd(const std::string& scriptFile,const std::string& cwd);
+static void util_refreshPackageSize(const std::string& packageId);
 
 //TODO: these don't need to be vars...they can be #defines ... I need this for now to debug something
 
@@ -99,26 +105,25 @@ static const char*		s_pkginstallerExec 						=	"opkg";
 static const char*		s_pkginstallerOpts_location				=	"-o";
 static const char*		s_pkginstallerOpts_remove				=	"remove";
 
-static const char *	const s_verifyExec							=	"openssl";
 #if defined(TARGET_DEVICE)
 static const char * const s_revocationCertFile = "/etc/ssl/certs/pubsubsigning-bundle.crt";
 #else
 static const char * const s_revocationCertFile = "/etc/ssl/certs/pubsubsigning-bundle.crt";
 #endif
 
-static const char * const s_extractKeyOpts[] = { "x509" , "-in" , "-pubkey" , ">"};
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+#define EVP_MD_CTX_new		EVP_MD_CTX_create
+#define EVP_MD_CTX_free		EVP_MD_CTX_destroy
+#endif
+
+// signed files are read and digested this much at a time
+#define VERIFY_READ_BUFFER_SIZE		(16*1024)
 
 static ApplicationInstaller* s_instance = 0;
 static const char*    s_logChannel = "ApplicationInstaller";
 
 
 ////                    CLASS STATICS   --------------------------------------------------------------------------------
-Mutex		ApplicationInstaller::s_sizeFnMutex;
-std::string	ApplicationInstaller::s_sizeFnBaseDir;
-uint64_t		ApplicationInstaller::s_sizeFnAccumulator = 0;
-uint64_t		ApplicationInstaller::s_auxSizeFnAccumulator = 0;
-uint64_t		ApplicationInstaller::s_targetFsBlockSize = 0;
-json_object * ApplicationInstaller::s_manifestJobj = 0;
 std::string  ApplicationInstaller::s_installer_version 	= 	"1.0.0";
 	
 std::list<CommandParams*> ApplicationInstaller::s_commandParams;
@@ -180,6 +185,10 @@ ApplicationInstaller* ApplicationInstaller::instance()
 ApplicationInstaller::ApplicationInstaller()
 	: m_inBrickMode(false)
 	, m_service (NULL)
+	, m_concurrentPool(NULL)
+	, m_maxConcurrentCommands(s_defaultMaxConcurrentCommands)
+	, m_concurrentCommandsRunning(0)
+	, m_packageDbReadersRunning(0)
 {
 }
 
@@ -331,6 +340,8 @@ static void util_ipkgInstallDone (GPid pid, gint status, gpointer data)
 		g_warning ("%s: successful ipkg install of package '%s', rescanning apps",
 				   __PRETTY_FUNCTION__, installParams->_packageId.c_str());
 
+		PackageSizeCache::instance()->invalidate(installParams->_packageId);
+
 		json_object * packageIdJo = ApplicationInstaller::instance()->packageInfoFileToJson(installParams->_packageId);
 		if (packageIdJo)
 		{
@@ -343,6 +354,9 @@ static void util_ipkgInstallDone (GPid pid, gint status, gpointer data)
 			g_warning("%s: FAILED TO PARSE PACKAGE INFO FILE FOR INSTALLED PACKAGE [%s] - possibly an old style package. Trying alternate scan function...",__FUNCTION__,installParams->_packageId.c_str());
 			ApplicationManager::instance()->postInstallScan(installParams->_packageId);
 		}
+
+		//if the scan didn't measure it, do it now, off the main thread, so the first getSizeOfApps finds it
+		util_refreshPackageSize(installParams->_packageId);
     }
 
     if (Settings::LunaSettings()->debug_appInstallerCleaner & 1)
@@ -372,6 +386,7 @@ static void util_ipkgRemoveDone (GPid pid, gint status, gpointer data)
 		success = true;
 
 		EventReporter::instance()->report( "uninstall", removeParams->_packageName.c_str() );
+		PackageSizeCache::instance()->invalidate(removeParams->_packageName);
 		//also remove the app dir, because ipkg doesn't do a complete job
 		if (removeParams->_packageName.size()) {   //check the package name size (at least 1 char) for safety or else the whole app subtree can be deleted!!!
 			std::string installPathFull = Settings::LunaSettings()->appInstallBase +
@@ -775,6 +790,7 @@ gboolean ApplicationInstaller::cbShallowRemove(gpointer param)
 	std::string ls_payload = "{\"ticket\":"+ls_sub_key+", \"status\":\"SUCCESS\"}";
 
 	EventReporter::instance()->report("uninstall", removeParams->_packageName.c_str());
+	PackageSizeCache::instance()->invalidate(removeParams->_packageName);
 	util_LSSubReplyWithRelay_IgnoreError((LSHandle*)removeParams->_lshandle, ls_sub_key, removeParams->ticketId, ls_payload);
 
 	ApplicationInstaller::instance()->oneCommandProcessed();
@@ -800,9 +816,15 @@ bool ApplicationInstaller::lunasvcNotifyOnChange(const std::string& packageName,
 
 bool ApplicationInstaller::lunasvcGetInstalledSizes(LSHandle * lshandle,LSMessage *msg)
 {
+	//the app folders are listed on a worker thread; replyInstalledSizes() answers once that's done
+	processOrQueueCommand(new SizeParams(lshandle,msg));
+	return true;
+}
 
+void ApplicationInstaller::replyInstalledSizes(LSHandle * lshandle,LSMessage *msg,const std::vector<std::string>& appNames)
+{
 	std::vector<std::pair<std::string,uint64_t> > appList;
-	getAllUserInstalledAppSizes(appList,Settings::LunaSettings()->appInstallBase);
+	collectAppSizes(appNames,appList);
 	
 	std::string response("{ \"returnValue\":true , \"apps\":[ ");
 	bool first=true;
@@ -828,7 +850,6 @@ bool ApplicationInstaller::lunasvcGetInstalledSizes(LSHandle * lshandle,LSMessag
 		LSErrorPrint (&lserror, stderr);
 		LSErrorFree(&lserror);
 	}
-	return true;
 }
 
 /// WARNING! these are tied to the app catalog's notion of what the various codes mean. Don't change arbitrarily
@@ -1212,8 +1233,14 @@ int ApplicationInstaller::getAllUserInstalledAppSizes(std::vector<std::pair<std:
 	if (r == 0)
 		return 0;		//no apps found
 	
+	return collectAppSizes(appNames,appList);
+}
+
+//static
+int ApplicationInstaller::collectAppSizes(const std::vector<std::string>& appNames,std::vector<std::pair<std::string,uint64_t> >& appList)
+{
 	int n_found=0;
-	for (std::vector<std::string>::iterator it = appNames.begin();it != appNames.end();++it) 
+	for (std::vector<std::string>::const_iterator it = appNames.begin();it != appNames.end();++it) 
 	{
 		
 		ApplicationDescription * appDesc = ApplicationManager::instance()->getAppById(*it);
@@ -1274,137 +1301,428 @@ uint64_t ApplicationInstaller::getFsFreeSpaceInBlocks(const std::string& pathOnF
 //static 
 uint64_t ApplicationInstaller::getSizeOfAppDir(const std::string& dirName)
 {
-	gchar cstr[FILENAME_MAX+1];
-	if (dirName.length() > FILENAME_MAX)
+	//same as "du -s": allocated size, rounded up to KB, hard linked files counted once
+	DiskUsageWalker walker;
+	if (!walker.walk(dirName))
 		return 0;
-	strcpy(cstr,dirName.c_str());
-
-	gchar * g_stdoutBuffer = NULL;
-	gchar * g_stderrBuffer = NULL;
-	gchar * argv[] = {(gchar *)"du",(gchar *)"-s",cstr,0};
-	GError * gerr = NULL;
-	gint exit_status=0;
-	GSpawnFlags flags = (GSpawnFlags)(G_SPAWN_SEARCH_PATH);
-	gboolean resultStatus = g_spawn_sync(NULL,
-			argv,
-			NULL,
-			flags,
-			NULL,
-			NULL,
-			&g_stdoutBuffer,
-			&g_stderrBuffer,
-			&exit_status,
-			&gerr);
 
-	g_free(g_stderrBuffer);		//don't need it...can probably supress this buffer from being created with a GFlag but I've had some trouble w/ that...
+	return walker.allocatedBytesInKB() * 1024;
+}
 
-	if ((!resultStatus) || (!g_stdoutBuffer)) {
-		if (gerr) {
-			g_warning("ApplicationInstaller::getSizeOfAppDir(): error - %s",gerr->message);
-			g_error_free(gerr);
+static void util_appendJsonString(std::string& out,const std::string& str)
+{
+	out += '"';
+	for (std::string::const_iterator it = str.begin();it != str.end();++it) {
+		unsigned char c = (unsigned char)*it;
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += (char)c;
 		}
-		
+		else if (c < 0x20) {
+			char buf[8];
+			snprintf(buf,sizeof(buf),"\\u%04x",c);
+			out += buf;
+		}
+		else
+			out += (char)c;
 	}
+	out += '"';
+}
 
-	//split
-	gchar ** tokens = g_strsplit_set(g_stdoutBuffer,(gchar *)" \t",2);
-	g_free(g_stdoutBuffer);
-	if (tokens == NULL) {
-		return 0;
-	}
-	if (tokens[0] == NULL) {
-		//nothing...
-		g_strfreev(tokens);
-		return 0;
+/*
+ * Where the walkers of a PackageSizeWalk put the manifest entries they record: two unlinked temp files, one for the real sizes
+ * and one for the block sizes, appended in step so the two arrays list the files in the same order. The entries reach the
+ * manifest by being copied from here, so what's in memory is only the walkers' current batches, however big the package is.
+ */
+class PackageManifestEntries
+{
+public:
+	PackageManifestEntries() : m_realFp(NULL), m_blockFp(NULL), m_count(0), m_failed(false) {}
+
+	~PackageManifestEntries()
+	{
+		if (m_realFp)
+			fclose(m_realFp);
+		if (m_blockFp)
+			fclose(m_blockFp);
 	}
 
-	long sz = atol(tokens[0]);
-	g_strfreev(tokens);
-	if (sz == 0) {
-		//nothing
-		return 0;
+	//takes a batch of entries (each with the ",\n" between them, but not before the first)
+	void append(const std::string& realEntries,const std::string& blockEntries,uint32_t count)
+	{
+		if (count == 0)
+			return;
+
+		MutexLocker locker(&m_mutex);
+		if (m_failed)
+			return;
+
+		if (!m_realFp) {
+			m_realFp = tmpfile();
+			m_blockFp = tmpfile();
+			if (!m_realFp || !m_blockFp) {
+				g_warning("%s: can't create a temp file for the manifest entries: %s", __PRETTY_FUNCTION__, strerror(errno));
+				m_failed = true;
+				return;
+			}
+		}
+
+		if (m_count) {
+			fputs(",\n",m_realFp);
+			fputs(",\n",m_blockFp);
+		}
+		fputs(realEntries.c_str(),m_realFp);
+		fputs(blockEntries.c_str(),m_blockFp);
+		if (ferror(m_realFp) || ferror(m_blockFp)) {
+			g_warning("%s: failed to write the manifest entries", __PRETTY_FUNCTION__);
+			m_failed = true;
+		}
+		m_count += count;
 	}
 
-	return (((uint64_t)sz) * 1024);
-}
+	bool empty() const { return m_count == 0; }
+	bool failed() const { return m_failed; }
 
-//static 
-int ApplicationInstaller::_getSizeCbFn(const char *fpath, const struct stat *sb,int typeflag, struct FTW *ftwbuf)
-{
-//	printf("%-3s %2d %7lld   %-40s %d %s\n",
-//			(typeflag == FTW_D) ?   "dir"   : (typeflag == FTW_DNR) ? "(access denied)" :
-//	(typeflag == FTW_DP) ?  "dp"  : (typeflag == FTW_F) ?   "file" :
-//	(typeflag == FTW_DP) ?  "dp"  : (typeflag == FTW_SL) ?  "symlink" :
-//	(typeflag == FTW_SLN) ? "symlink-broken" : "???",
-//			ftwbuf->level, (long long) sb->st_size,
-//			fpath, ftwbuf->base, fpath + ftwbuf->base);
-	//if (typeflag == FTW_F) 
-	if (s_sizeFnBaseDir != fpath) //exclude the base dir entry
+	//copies the entries to fp, as the elements of a json array. Only once the walk is done
+	bool copyTo(FILE* fp,bool real)
 	{
-		s_sizeFnAccumulator += (uint64_t) sb->st_blocks;
-		s_auxSizeFnAccumulator += (uint64_t) sb->st_size;
+		FILE* src = (real ? m_realFp : m_blockFp);
+		if (!src)
+			return true;
+
+		if (fflush(src) != 0 || fseek(src,0,SEEK_SET) != 0)
+			return false;
+
+		char buffer[16 * 1024];
+		size_t n;
+		while ((n = fread(buffer,1,sizeof(buffer),src)) > 0) {
+			if (fwrite(buffer,1,n,fp) != n)
+				return false;
+		}
+		return (ferror(src) == 0);
 	}
-	return 0;           /* To tell nftw() to continue */
 
-}
+private:
+	Mutex m_mutex;
+	FILE* m_realFp;
+	FILE* m_blockFp;
+	uint32_t m_count;
+	bool m_failed;
+};
 
-//static 
-int ApplicationInstaller::_getSizeOfAppCbFn(const char *fpath, const struct stat *sb,int typeflag, struct FTW *ftwbuf)
+/*
+ * Sizes the entries of a package tree in blocks of the target filesystem (a directory is 1 block; anything else its size,
+ * rounded up to whole blocks), and optionally records each entry as a manifest line (as text, in the form the .pmmanifest
+ * arrays take), handing them to the walk's PackageManifestEntries a batch at a time.
+ */
+class PackageSizeWalker : public DiskUsageWalker
 {
-	uint64_t resizedBlocks;
-	if (s_sizeFnBaseDir != std::string(fpath)) //exclude the base dir entry
+public:
+	PackageSizeWalker(uint64_t blockSize,PackageManifestEntries* entries,DiskUsageLinkSet* links)
+		: DiskUsageWalker(links), m_blockSize(blockSize), m_entries(entries), m_blocks(0), m_batchCount(0) {}
+
+	uint64_t blocks() const { return m_blocks; }
+
+	//hands over what's left of the current batch; called when the walker is done
+	void flushEntries()
 	{
-		s_auxSizeFnAccumulator += sb->st_size;
-		if (typeflag == FTW_DP)
-		{
+		if (!m_entries)
+			return;
+		m_entries->append(m_realEntries,m_blockEntries,m_batchCount);
+		std::string().swap(m_realEntries);		//done with these; don't keep their buffers around until the walk ends
+		std::string().swap(m_blockEntries);
+		m_batchCount = 0;
+	}
+
+protected:
+	virtual void visit(const std::string& path,const struct stat& st)
+	{
+		uint64_t size = (uint64_t)st.st_size;
+		uint64_t resizedBlocks;
+		if (S_ISDIR(st.st_mode))
 			resizedBlocks = 1;
-			s_sizeFnAccumulator += 1;				//1 block for directories	
+		else
+			resizedBlocks = (size / m_blockSize) + ((size % m_blockSize) ? 1 : 0);
+		m_blocks += resizedBlocks;
+
+		if (!m_entries)
+			return;
+		appendEntry(m_realEntries,path,size);
+		appendEntry(m_blockEntries,path,resizedBlocks * m_blockSize);
+		++m_batchCount;
+
+		if (m_realEntries.size() >= s_maxBatchBytes) {
+			m_entries->append(m_realEntries,m_blockEntries,m_batchCount);
+			m_realEntries.clear();
+			m_blockEntries.clear();
+			m_batchCount = 0;
 		}
-		else 
-		{
-			resizedBlocks = ((((uint64_t) sb->st_size)) / s_targetFsBlockSize) + ((((uint64_t) sb->st_size)) % s_targetFsBlockSize ? 1 : 0);
-			s_sizeFnAccumulator += resizedBlocks;
+	}
+
+private:
+	static void appendEntry(std::string& out,const std::string& path,uint64_t size)
+	{
+		if (!out.empty())
+			out += ",\n";
+		out += "{ \"file\": ";
+		util_appendJsonString(out,path);
+		out += ", \"size\": \"" + toSTLString<uint64_t>(size) + "\" }";
+	}
+
+	static const std::string::size_type s_maxBatchBytes = 32 * 1024;
+
+	uint64_t m_blockSize;
+	PackageManifestEntries* m_entries;
+	uint64_t m_blocks;
+	std::string m_realEntries;
+	std::string m_blockEntries;
+	uint32_t m_batchCount;
+};
+
+// package trees are walked by up to this many threads at once, all walks together
+#define SIZE_WALK_MAX_WORKERS		3
+
+static Mutex s_sizeWalkPoolMutex;
+static GThreadPool* s_sizeWalkPool = NULL;
+
+/*
+ * Sizes a set of package folders. The top level of each folder is read right away; each subdirectory found there is then
+ * walked by a walker of its own, on a worker pool shared by all the walks when there's more than one, and the totals are
+ * added up at the end. The walkers share one set of the hard links seen, so a file linked from several subdirectories is
+ * counted (and listed in the manifest) once, the same however the folders were split up. Everything else is in the object,
+ * so any number of these can run at once.
+ */
+class PackageSizeWalk
+{
+public:
+	PackageSizeWalk(uint64_t blockSize,bool recordEntries)
+		: m_blockSize(blockSize), m_entries(recordEntries ? new PackageManifestEntries() : NULL), m_failed(false)
+	{
+		m_walkers.push_back(new PackageSizeWalker(blockSize,m_entries,&m_links));		//the top levels
+	}
+
+	~PackageSizeWalk()
+	{
+		for (std::vector<PackageSizeWalker*>::iterator it = m_walkers.begin();it != m_walkers.end();++it)
+			delete *it;
+		delete m_entries;
+	}
+
+	//the folder itself isn't counted, only what's in it
+	void addRoot(const std::string& path)
+	{
+		std::vector<std::string> subdirs;
+		if (!m_walkers[0]->walkTopLevel(path,subdirs)) {
+			g_warning("%s: can't read %s: %s", __PRETTY_FUNCTION__, path.c_str(), strerror(errno));
+			m_failed = true;
+			return;
 		}
-		
-		if (s_manifestJobj)
-		{
-			//pull out the two j-arrays
-			std::string bsizeStr = toSTLString<uint64_t>(s_targetFsBlockSize);
-			int addRc = 0;
-			json_object * jArray_real = json_object_object_get(s_manifestJobj,"real");
-			if (!jArray_real)
-			{
-				jArray_real = json_object_new_array();
-				addRc |= 1;
+		m_subdirs.insert(m_subdirs.end(),subdirs.begin(),subdirs.end());
+	}
+
+	void run()
+	{
+		m_walkers[0]->flushEntries();
+
+		std::vector<Job> jobs(m_subdirs.size());
+		for (size_t i = 0;i < m_subdirs.size();++i) {
+			jobs[i].path = &m_subdirs[i];
+			jobs[i].walker = new PackageSizeWalker(m_blockSize,m_entries,&m_links);
+			jobs[i].done = NULL;
+			jobs[i].ok = false;
+			m_walkers.push_back(jobs[i].walker);
+		}
+
+		GThreadPool* pool = (jobs.size() > 1 ? sharedPool() : NULL);
+		GAsyncQueue* done = (pool ? g_async_queue_new() : NULL);
+
+		for (std::vector<Job>::iterator it = jobs.begin();it != jobs.end();++it) {
+			if (pool) {
+				it->done = done;
+				g_thread_pool_push(pool,&(*it),NULL);
 			}
-			json_object * jArray_bsize = json_object_object_get(s_manifestJobj,bsizeStr.c_str());
-			if (!jArray_bsize)
-			{
-				jArray_bsize = json_object_new_array();
-				addRc |= 2;
+			else
+				walkerFn(&(*it),NULL);
+		}
+
+		if (done) {
+			for (size_t i = 0;i < jobs.size();++i)
+				g_async_queue_pop(done);		//one for each job, as it finishes
+			g_async_queue_unref(done);
+		}
+
+		for (std::vector<Job>::iterator it = jobs.begin();it != jobs.end();++it) {
+			if (!it->ok) {
+				g_warning("%s: can't read %s", __PRETTY_FUNCTION__, it->path->c_str());
+				m_failed = true;
 			}
-			
-			//add to arrays
-			std::string sz = toSTLString<uint64_t>(((uint64_t) sb->st_size));
-			json_object * innerJobj = json_object_new_object();
-			json_object_object_add(innerJobj,"file",json_object_new_string(fpath));
-			json_object_object_add(innerJobj,"size",json_object_new_string(sz.c_str()));
-			json_object_array_add(jArray_real,innerJobj);
-			sz = toSTLString<uint64_t>(resizedBlocks * s_targetFsBlockSize);
-			innerJobj = json_object_new_object();
-			json_object_object_add(innerJobj,"file",json_object_new_string(fpath));
-			json_object_object_add(innerJobj,"size",json_object_new_string(sz.c_str()));
-			json_object_array_add(jArray_bsize,innerJobj);
-			
-			//add the arrays to the top level obj, if necessary
-			if (addRc & 1)
-				json_object_object_add(s_manifestJobj,"real",jArray_real);
-			if (addRc & 2)
-				json_object_object_add(s_manifestJobj,bsizeStr.c_str(),jArray_bsize);
 		}
-			
+		m_subdirs.clear();
+	}
+
+	uint64_t blocks() const
+	{
+		uint64_t total = 0;
+		for (std::vector<PackageSizeWalker*>::const_iterator it = m_walkers.begin();it != m_walkers.end();++it)
+			total += (*it)->blocks();
+		return total;
+	}
+
+	uint64_t apparentBytes() const
+	{
+		uint64_t total = 0;
+		for (std::vector<PackageSizeWalker*>::const_iterator it = m_walkers.begin();it != m_walkers.end();++it)
+			total += (*it)->apparentBytes();
+		return total;
 	}
-	return 0;           /* To tell nftw() to continue */
+
+	//true if a folder (or a subdirectory of one) couldn't be read, and so wasn't counted
+	bool failed() const { return m_failed; }
+
+	//the recorded entries, as the elements of a json array
+	bool writeEntries(FILE* fp,bool real) const { return (m_entries ? m_entries->copyTo(fp,real) : true); }
+	bool hasEntries() const { return (m_entries && !m_entries->empty()); }
+	bool entriesComplete() const { return (m_entries && !m_entries->failed()); }
+
+private:
+
+	struct Job {
+		const std::string* path;
+		PackageSizeWalker* walker;
+		GAsyncQueue* done;
+		bool ok;
+	};
+
+	static GThreadPool* sharedPool()
+	{
+		MutexLocker locker(&s_sizeWalkPoolMutex);
+		if (!s_sizeWalkPool) {
+			GError* gerr = NULL;
+			s_sizeWalkPool = g_thread_pool_new(walkerFn,NULL,SIZE_WALK_MAX_WORKERS,FALSE,&gerr);
+			if (!s_sizeWalkPool) {
+				g_warning("%s: unable to create the size walk pool (%s); walking on the calling thread",
+						  __FUNCTION__, (gerr ? gerr->message : "unknown error"));
+				if (gerr)
+					g_error_free(gerr);
+			}
+		}
+		return s_sizeWalkPool;
+	}
+
+	static void walkerFn(gpointer data,gpointer userData)
+	{
+		Job* job = (Job*)data;
+		job->ok = job->walker->walk(*(job->path));
+		job->walker->flushEntries();
+		if (job->done)
+			g_async_queue_push(job->done,job);
+	}
+
+	uint64_t m_blockSize;
+	PackageManifestEntries* m_entries;
+	DiskUsageLinkSet m_links;		//shared by all the walkers: a file is counted once per walk, whichever subtrees link it
+	bool m_failed;
+	std::vector<PackageSizeWalker*> m_walkers;
+	std::vector<std::string> m_subdirs;
+};
+
+//the folders a package's files are in: its apps', its services', and its own (last)
+static void util_packageFolders(const PackageDescription* packageDesc,std::vector<std::string>& r_folders)
+{
+	std::vector<std::string>::const_iterator appIdIt, appIdItEnd;
+	for (appIdIt = packageDesc->appIds().begin(), appIdItEnd = packageDesc->appIds().end(); appIdIt != appIdItEnd; ++appIdIt) {
+		std::string folderPath = Settings::LunaSettings()->appInstallBase + std::string("/") + Settings::LunaSettings()->appInstallRelative + std::string("/") + *appIdIt + std::string("/");
+		r_folders.push_back(folderPath);
+	}
+
+	std::vector<std::string>::const_iterator serviceIdIt, serviceIdItEnd;
+	for (serviceIdIt = packageDesc->serviceIds().begin(), serviceIdItEnd = packageDesc->serviceIds().end(); serviceIdIt != serviceIdItEnd; ++serviceIdIt) {
+		std::string folderPath = Settings::LunaSettings()->serviceInstallBase + std::string("/") + Settings::LunaSettings()->serviceInstallRelative + std::string("/") + *serviceIdIt + std::string("/");
+		r_folders.push_back(folderPath);
+	}
+
+	r_folders.push_back(packageDesc->folderPath());
+}
+
+//queues a background measurement of the package, unless its cached size is still good
+static void util_refreshPackageSize(const std::string& packageId)
+{
+	PackageDescription* packageDesc = ApplicationManager::instance()->getPackageInfoByPackageId(packageId);
+	if (!packageDesc)
+		return;
+
+	std::vector<std::string> folders;
+	util_packageFolders(packageDesc,folders);
+	uint64_t size = 0;
+	bool stale = false;
+	if (PackageSizeCache::instance()->lookup(packageId,packageDesc->version(),PackageSizeCache::stampFor(folders),size,stale) && !stale)
+		return;
+	PackageSizeCache::instance()->refresh(packageId,packageDesc->version(),folders,packageDesc->folderPath());
+}
+
+//the block size of the filesystem the package's folders are measured for (the package folder's own, unless destFsPath is given)
+static uint64_t util_packageBlockSize(const std::string& destFsPath,const std::vector<std::string>& folders)
+{
+	uint64_t blockSize = 0;
+	if (destFsPath.empty()) {
+		ApplicationInstaller::getFsFreeSpaceInBlocks(folders.back(), &blockSize);
+	} else {
+		ApplicationInstaller::getFsFreeSpaceInBlocks(destFsPath, &blockSize);
+	}
+	return blockSize;
+}
+
+//the package size from the package's manifest, if it was written for this version (and installer) and for the folders as they
+//are now (the stamp), with a total for this block size
+static bool util_sizeFromManifest(const std::string& packageId,const std::string& version,uint64_t stamp,uint64_t blockSize,uint64_t& r_size)
+{
+	std::string manifestFilePath = Settings::LunaSettings()->packageManifestsPath + std::string("/") + packageId + std::string(".pmmanifest");
+	json_object * manifestJobj = json_object_from_file((char *)manifestFilePath.c_str());
+	if (!manifestJobj)
+		return false;
+
+	bool found = false;
+	std::string manifestVersion, installerVersion, manifestStamp, sizeStr;
+	extractFromJson(manifestJobj,"version",manifestVersion);
+	extractFromJson(manifestJobj,"installer",installerVersion);
+	extractFromJson(manifestJobj,"stamp",manifestStamp);
+	json_object * totalSizesJobj = JsonGetObject(manifestJobj,"totals");
+	if (manifestVersion == version && installerVersion == ApplicationInstaller::s_installer_version
+		&& manifestStamp == toSTLString<uint64_t>(stamp) && totalSizesJobj
+		&& extractFromJson(totalSizesJobj,toSTLString<uint64_t>(blockSize).c_str(),sizeStr)) {
+		r_size = strtoull(sizeStr.c_str(),NULL,10);
+		found = true;
+	}
+
+	json_object_put(manifestJobj);
+	return found;
+}
+
+//the package size, if it can be had without walking the package's folders: from the PackageSizeCache (one that's out of date
+//is still answered, and measured again in the background) or from a manifest that's still good. Main thread only
+static bool util_knownPackageSize(PackageDescription* packageDesc,const std::vector<std::string>& folders,uint64_t& r_size)
+{
+	const std::string& packageId = packageDesc->id();
+	uint64_t stamp = PackageSizeCache::stampFor(folders);
+
+	bool stale = false;
+	if (PackageSizeCache::instance()->lookup(packageId,packageDesc->version(),stamp,r_size,stale)) {
+		if (stale)
+			PackageSizeCache::instance()->refresh(packageId,packageDesc->version(),folders,packageDesc->folderPath());
+		else if (packageDesc->packageSize() == 0)
+			packageDesc->setPackageSize(r_size);
+		return true;
+	}
+
+	//a manifest the scan (or an earlier walk) wrote is as good as the cache, as long as it's still for these folders. Whatever
+	//size the scan put in the PackageDescription isn't: that may be from a manifest of older contents
+	uint64_t blockSize = util_packageBlockSize("",folders);
+	if (blockSize && util_sizeFromManifest(packageId,packageDesc->version(),stamp,blockSize,r_size)) {
+		PackageSizeCache::instance()->store(packageId,packageDesc->version(),stamp,r_size);
+		packageDesc->setPackageSize(r_size);
+		return true;
+	}
+	return false;
 }
 
 //static
@@ -1414,42 +1732,110 @@ uint64_t ApplicationInstaller::getSizeOfPackageById(const std::string& packageId
 	 * The size of the package encoded in the package descriptor is the size of the package as installed at this moment, calculated w.r.t to the blocksize of the file on disk
 	 * While this may be larger than the actual size in some cases (see Unix command 'du' manpages for a short explanation on this), it should be a safe and good (over)estimate at worst.
 	 *
+	 * Sizes are answered from the PackageSizeCache when it has one; one that's out of date is still answered, and measured
+	 * again in the background. Only a package that has never been measured is walked here (getPackageSizes() walks it on
+	 * a worker thread instead)
 	 */
 
 	PackageDescription* packageDesc = ApplicationManager::instance()->getPackageInfoByPackageId(packageId);
-	if (packageDesc) {
-		if (packageDesc->packageSize() == 0)
-			packageDesc->setPackageSize(getSizeOfPackageOnFsGenerateManifest("", packageDesc, NULL));	//TODO: maybe check for an existing manifest? (though likely it's not there)
-		return (packageDesc->packageSize());
+	if (!packageDesc)
+		return 0;
+
+	std::vector<std::string> folders;
+	util_packageFolders(packageDesc,folders);
+
+	uint64_t size = 0;
+	if (util_knownPackageSize(packageDesc,folders,size))
+		return size;
+
+	//a walk that failed isn't kept anywhere (nor stored by getSizeOfPackageFolders()); the next call measures again
+	if (!getSizeOfPackageFolders("",packageId,packageDesc->version(),folders,size,NULL)) {
+		g_warning("%s: couldn't measure %s", __FUNCTION__, packageId.c_str());
+		return packageDesc->packageSize();		//the scan's figure, if it has one, is a better guess than a partial walk
 	}
-	return 0;
+	packageDesc->setPackageSize(size);
+	return size;
+}
+
+void ApplicationInstaller::getPackageSizes(LSHandle * lshandle,LSMessage *msg,const std::vector<std::pair<std::string,std::string> >& keysAndPackageIds,uint32_t dbSize)
+{
+	PackageSizesParams* cmd = new PackageSizesParams(lshandle,msg,dbSize);
+	bool walkNeeded = false;
+
+	for (std::vector<std::pair<std::string,std::string> >::const_iterator it = keysAndPackageIds.begin();
+		 it != keysAndPackageIds.end(); ++it) {
+		PackageSizesParams::Item item;
+		item.key = it->first;
+		item.packageId = it->second;
+		item.size = 0;
+		item.measured = false;
+
+		PackageDescription* packageDesc = ApplicationManager::instance()->getPackageInfoByPackageId(item.packageId);
+		if (packageDesc) {
+			std::vector<std::string> folders;
+			util_packageFolders(packageDesc,folders);
+			item.version = packageDesc->version();
+			if (!util_knownPackageSize(packageDesc,folders,item.size)) {
+				item.folders.swap(folders);		//left for the worker thread to walk
+				walkNeeded = true;
+			}
+		}
+		cmd->_items.push_back(item);
+	}
+
+	if (!walkNeeded) {
+		replyPackageSizes(cmd);
+		delete cmd;
+		return;
+	}
+
+	//the walks only read the package folders, so these don't wait on installs and removes (readsPackageDb() is false)
+	processOrQueueCommand(cmd);
+}
+
+void ApplicationInstaller::replyPackageSizes(PackageSizesParams* cmd)
+{
+	json_object* reply = json_object_new_object();
+	json_object_object_add(reply,"subscribed",json_object_new_boolean(false));
+	json_object_object_add(reply,"returnValue",json_object_new_boolean(true));
+
+	for (std::vector<PackageSizesParams::Item>::const_iterator it = cmd->_items.begin(); it != cmd->_items.end(); ++it) {
+		uint32_t s = (uint32_t)it->size;
+		if (s > 0)
+			s += cmd->_dbSize;
+		json_object_object_add(reply,it->key.c_str(),json_object_new_int(s));
+	}
+
+	LSError lserror;
+	LSErrorInit(&lserror);
+	if (!LSMessageReply(cmd->_lshandle,cmd->_msg,json_object_to_json_string(reply),&lserror))
+		LSErrorFree(&lserror);
+	json_object_put(reply);
 }
 
 //static
 uint64_t ApplicationInstaller::getSizeOfAppOnFs(const std::string& destFsPath,const std::string& dirName,uint32_t * r_pBsize)
 {
-	MutexLocker lock(&s_sizeFnMutex);
-	s_sizeFnBaseDir = dirName;
-	s_sizeFnAccumulator = 0;
-	s_auxSizeFnAccumulator = 0;
+	uint64_t blockSize = 0;
 	if (destFsPath.empty())
-		getFsFreeSpaceInBlocks(dirName,&s_targetFsBlockSize);
+		getFsFreeSpaceInBlocks(dirName,&blockSize);
 	else
-		getFsFreeSpaceInBlocks(destFsPath,&s_targetFsBlockSize);
+		getFsFreeSpaceInBlocks(destFsPath,&blockSize);
 	
-	if (s_targetFsBlockSize == 0)
+	if (blockSize == 0)
 		return 0;
 	
-	nftw(dirName.c_str(), ApplicationInstaller::_getSizeOfAppCbFn, 20, FTW_PHYS | FTW_DEPTH);
+	PackageSizeWalk walk(blockSize,false);
+	walk.addRoot(dirName);
+	walk.run();
 	if (r_pBsize)
-		*r_pBsize = s_targetFsBlockSize;
-	return s_sizeFnAccumulator * s_targetFsBlockSize;			//up to this point, the size was in fs blocks
+		*r_pBsize = blockSize;
+	return walk.blocks() * blockSize;			//up to this point, the size was in fs blocks
 		
 }
 
 uint64_t ApplicationInstaller::getSizeOfPackageOnFsGenerateManifest(const std::string& destFsPath, PackageDescription* packageDesc, uint32_t * r_pBsize)
 {
-	MutexLocker lock(&s_sizeFnMutex);
 	if (!packageDesc) {
 		g_warning("packageDesc is null in %s", __PRETTY_FUNCTION__);
 		return 0;
@@ -1459,70 +1845,132 @@ uint64_t ApplicationInstaller::getSizeOfPackageOnFsGenerateManifest(const std::s
 		return 0;
 	}
 
-	s_sizeFnAccumulator = 0;
-	s_auxSizeFnAccumulator = 0;
+	std::vector<std::string> folders;
+	util_packageFolders(packageDesc,folders);
+	uint64_t size = 0;
+	if (!getSizeOfPackageFolders(destFsPath,packageDesc->id(),packageDesc->version(),folders,size,r_pBsize))
+		return 0;		//not known; it's measured again when it's asked for
+	return size;
+}
 
-	if (destFsPath.empty()) {
-		getFsFreeSpaceInBlocks(packageDesc->folderPath(), &s_targetFsBlockSize);
-	} else {
-		getFsFreeSpaceInBlocks(destFsPath, &s_targetFsBlockSize);
-	}
+//static
+/*
+ * Measures the package's folders (the package folder last), writes its manifest and keeps the size in the PackageSizeCache.
+ * Touches no PackageDescription, so it can run on any thread. Returns false, with nothing written or stored, if a folder
+ * couldn't be read; r_size is then what could be measured
+ */
+bool ApplicationInstaller::getSizeOfPackageFolders(const std::string& destFsPath,const std::string& packageId,const std::string& version,const std::vector<std::string>& folders,uint64_t& r_size,uint32_t * r_pBsize)
+{
+	r_size = 0;
+	if (folders.empty())
+		return false;
 
-	if (s_targetFsBlockSize == 0) {
-		g_warning("s_targetFsBlockSize is 0 in %s", __PRETTY_FUNCTION__);
-		return 0;
+	uint64_t blockSize = util_packageBlockSize(destFsPath,folders);
+	if (blockSize == 0) {
+		g_warning("blockSize is 0 in %s", __PRETTY_FUNCTION__);
+		return false;
 	}
 
-	//if the manifest jobj is uncleared, clear it
-	if (s_manifestJobj)
-	{
-		json_object_put(s_manifestJobj);
-	}
-	s_manifestJobj = json_object_new_object();
-	json_object_object_add(s_manifestJobj,"version",json_object_new_string(packageDesc->version().c_str()));
-	json_object_object_add(s_manifestJobj,"installer",json_object_new_string(ApplicationInstaller::s_installer_version.c_str()));
+	//taken before the walk, so a change made while it runs makes the entry stale rather than being missed
+	uint64_t stamp = PackageSizeCache::stampFor(folders);
 
-	// add up the sizes of all the apps in this package
-	std::vector<std::string>::const_iterator appIdIt, appIdItEnd;
-	for (appIdIt = packageDesc->appIds().begin(), appIdItEnd = packageDesc->appIds().end(); appIdIt != appIdItEnd; ++appIdIt) {
-		std::string folderPath = Settings::LunaSettings()->appInstallBase + std::string("/") + Settings::LunaSettings()->appInstallRelative + std::string("/") + *appIdIt + std::string("/");
-		s_sizeFnBaseDir = folderPath;
-		nftw(folderPath.c_str(), ApplicationInstaller::_getSizeOfAppCbFn, 20, FTW_PHYS | FTW_DEPTH);
-		printf("DDD: %s looking at app folder %s\n", __PRETTY_FUNCTION__, (*appIdIt).c_str());
-	}
+	PackageSizeWalk walk(blockSize,true);
+	for (std::vector<std::string>::const_iterator it = folders.begin(); it != folders.end(); ++it)
+		walk.addRoot(*it);
+	walk.run();
 
-	// now add up the sizes of all the services in this package
-	std::vector<std::string>::const_iterator serviceIdIt, serviceIdItEnd;
-	for (serviceIdIt = packageDesc->serviceIds().begin(), serviceIdItEnd = packageDesc->serviceIds().end(); serviceIdIt != serviceIdItEnd; ++serviceIdIt) {
-		std::string folderPath = Settings::LunaSettings()->serviceInstallBase + std::string("/") + Settings::LunaSettings()->serviceInstallRelative + std::string("/") + *serviceIdIt + std::string("/");
-		s_sizeFnBaseDir = folderPath;
-		nftw(folderPath.c_str(), ApplicationInstaller::_getSizeOfAppCbFn, 20, FTW_PHYS | FTW_DEPTH);
+	if (r_pBsize)
+		*r_pBsize = blockSize;
+
+	//write the manifest: copied as text from the walk's entries, next to the real file, synced and renamed over it
+	std::string bsizeStr = toSTLString<uint64_t>(blockSize);
+	std::string path = Settings::LunaSettings()->packageManifestsPath + std::string("/") + packageId + std::string(".pmmanifest");
+	std::string tmpPath = path + std::string(".XXXXXX");		//a name of its own, in case the same package is measured twice at once
+	FILE * fp = NULL;
+	if (walk.failed() || !walk.entriesComplete())
+		g_warning("%s: %s wasn't measured completely; not writing its manifest", __PRETTY_FUNCTION__, packageId.c_str());
+	else {
+		int fd = mkstemp(&tmpPath[0]);
+		if (fd >= 0) {
+			fchmod(fd,0644);
+			if (!(fp = fdopen(fd,"w")))
+				close(fd);
+		}
+		if (!fp) {
+			g_warning("%s: can't create %s: %s", __PRETTY_FUNCTION__, tmpPath.c_str(), strerror(errno));
+			if (fd >= 0)
+				unlink(tmpPath.c_str());
+		}
 	}
+	if (fp) {
+		std::string header("{ \"version\": ");
+		util_appendJsonString(header,version);
+		header += ", \"installer\": ";
+		util_appendJsonString(header,ApplicationInstaller::s_installer_version);
+		header += ", \"stamp\": \"" + toSTLString<uint64_t>(stamp) + "\"";		//what the folders looked like when they were measured
+		fputs(header.c_str(),fp);
+		bool written = true;
+		if (walk.hasEntries()) {
+			fputs(",\n\"real\": [\n",fp);
+			written = walk.writeEntries(fp,true) && written;
+			fprintf(fp,"\n],\n\"%s\": [\n",bsizeStr.c_str());
+			written = walk.writeEntries(fp,false) && written;
+			fputs("\n]",fp);
+		}
+		//the total sizes
+		fprintf(fp,",\n\"totals\": { \"real\": \"%llu\", \"%s\": \"%llu\" } }\n",
+				(unsigned long long)walk.apparentBytes(),bsizeStr.c_str(),(unsigned long long)(walk.blocks() * blockSize));
+		if (fflush(fp) != 0 || ferror(fp) != 0 || fsync(fileno(fp)) != 0)
+			written = false;
+		if (fclose(fp) != 0)
+			written = false;
+		if (written && ::rename(tmpPath.c_str(),path.c_str()) == 0) {
+			//and the rename itself
+			int dirFd = ::open(Settings::LunaSettings()->packageManifestsPath.c_str(),O_RDONLY | O_DIRECTORY);
+			if (dirFd >= 0) {
+				fsync(dirFd);
+				close(dirFd);
+			}
+		}
+		else {
+			g_warning("%s: failed to write %s", __PRETTY_FUNCTION__, tmpPath.c_str());
+			unlink(tmpPath.c_str());
+		}
+	}
+
+	r_size = walk.blocks() * blockSize;			//up to this point, the size was in fs blocks
+	//a size missing a folder isn't kept; it's measured again next time instead
+	if (walk.failed())
+		return false;
+	PackageSizeCache::instance()->store(packageId,version,stamp,r_size);
+	return true;
+}
 
-	// finally add the size of the package folder itself
-	std::string packageFolder = packageDesc->folderPath();
-	s_sizeFnBaseDir = packageFolder;
-	nftw(packageFolder.c_str(), ApplicationInstaller::_getSizeOfAppCbFn, 20, FTW_PHYS | FTW_DEPTH);
+//static
+/*
+ * Measures the package's folders the same way, but only that: no manifest is written and nothing is stored. r_stamp is the
+ * stamp of the folders from before the walk. Returns false if a folder couldn't be read (or measured at all)
+ */
+bool ApplicationInstaller::measurePackageFolders(const std::string& destFsPath,const std::vector<std::string>& folders,uint64_t& r_size,uint64_t& r_stamp)
+{
+	if (folders.empty())
+		return false;
 
-	if (r_pBsize)
-		*r_pBsize = s_targetFsBlockSize;
+	uint64_t blockSize = util_packageBlockSize(destFsPath,folders);
+	if (blockSize == 0) {
+		g_warning("blockSize is 0 in %s", __PRETTY_FUNCTION__);
+		return false;
+	}
 
-	//put the total sizes into the manifest obj
-	std::string bsizeStr = toSTLString<uint64_t>(s_targetFsBlockSize);
-	std::string sizeStr = toSTLString<uint64_t>(s_auxSizeFnAccumulator);
-	json_object * totalSizeJobj = json_object_new_object();
-	json_object_object_add(totalSizeJobj,"real",json_object_new_string(sizeStr.c_str()));
-	sizeStr = toSTLString<uint64_t>(s_sizeFnAccumulator * s_targetFsBlockSize);
-	json_object_object_add(totalSizeJobj,bsizeStr.c_str(),json_object_new_string(sizeStr.c_str()));
-	json_object_object_add(s_manifestJobj,"totals",totalSizeJobj);
+	r_stamp = PackageSizeCache::stampFor(folders);
 
-	//write to the manifest file
-	std::string path = Settings::LunaSettings()->packageManifestsPath + std::string("/") + packageDesc->id() + std::string(".pmmanifest");
-	json_object_to_file((char *) path.c_str(), s_manifestJobj);
-	json_object_put(s_manifestJobj);
-	s_manifestJobj = NULL;
+	PackageSizeWalk walk(blockSize,false);
+	for (std::vector<std::string>::const_iterator it = folders.begin(); it != folders.end(); ++it)
+		walk.addRoot(*it);
+	walk.run();
 
-	return s_sizeFnAccumulator * s_targetFsBlockSize;			//up to this point, the size was in fs blocks
+	r_size = walk.blocks() * blockSize;
+	return !walk.failed();
 }
 
 //static
@@ -1546,155 +1994,207 @@ bool ApplicationInstaller::arePathsOnSameFilesystem(const std::string& path1,con
 //	return (s1.st_dev == s2.st_dev);	
 }
 
-//static 
-int ApplicationInstaller::doSignatureVerifyOnFile(const std::string& file,const std::string& signatureFile,const std::string& pubkeyFile)
+static EVP_PKEY * util_readPublicKey(const std::string& pubkeyFile)
 {
-	std::vector<std::string> params;
-	params.push_back("dgst");params.push_back("-sha1");params.push_back("-verify");
-	params.push_back(pubkeyFile);params.push_back("-signature");params.push_back(signatureFile);
-	params.push_back(file);
-	return (ApplicationInstaller::runOpenSSL(params,std::string("")));
+	FILE * fp = fopen(pubkeyFile.c_str(),"r");
+	if (!fp)
+		return NULL;
+	EVP_PKEY * key = PEM_read_PUBKEY(fp,NULL,NULL,NULL);
+	fclose(fp);
+	return key;
 }
 
-//static 
-int ApplicationInstaller::doSignatureVerifyOnFiles(std::vector<std::string>& files,const std::string& signatureFile,const std::string& pubkeyFile)
+//the key of the first certificate in certFile, same as "openssl x509 -in certFile -pubkey"
+static EVP_PKEY * util_readPublicKeyFromCert(const std::string& certFile)
 {
-	std::vector<std::string> params;
-	std::string globbedparam = std::string("/bin/cat ");
-	for (std::vector<std::string>::iterator it = files.begin();it != files.end();++it) {
-		globbedparam += (*it + std::string(" "));
-	}
-	globbedparam += std::string("| openssl dgst -sha1 -verify ") + pubkeyFile + std::string(" -signature ") + signatureFile;
-	params.push_back("-c");params.push_back(globbedparam);
-	return (ApplicationInstaller::runOpenSSL(params,std::string("sh")));
+	FILE * fp = fopen(certFile.c_str(),"r");
+	if (!fp)
+		return NULL;
+	X509 * cert = PEM_read_X509(fp,NULL,NULL,NULL);
+	fclose(fp);
+	if (!cert)
+		return NULL;
+	EVP_PKEY * key = X509_get_pubkey(cert);
+	X509_free(cert);
+	return key;
 }
 
-//static 
-int ApplicationInstaller::extractPublicKeyFromCert(const std::string& certFile,const std::string& pubkeyFile)
+/*
+ * Checks a SHA1 signature over everything fed to it, the same check "openssl dgst -sha1 -verify" does. Files are streamed
+ * through a fixed size buffer, so nothing is ever read into memory whole.
+ */
+class SignatureVerifier
 {
-	if ((certFile.size() == 0) || (pubkeyFile.size() == 0))
-		return 0;
-	
-	//warning: no explicit checks on pubkeyFile path/name validity, so the calls to this function need to be restricted
-	//(or else someone could specify e.g. /usr/bin/LunaSysMgr as the pubkeyFile to write to)
-	//...but as a basic safety check, check for the existence of the file. if it is there, fail.
-	//This will require the file to be deleted before this function is run each time
-	
-	if (doesExistOnFilesystem(pubkeyFile.c_str()))
-		return 0;
-	
-	//extract the public key
-	//openssl x509 -in <certname> -pubkey -out pubkey.pem
-	std::string space = std::string(" ");
-	std::string cmdline = std::string(s_verifyExec)
-	+space+std::string(s_extractKeyOpts[0])
-	+space+std::string(s_extractKeyOpts[1])
-	+space+certFile
-	+space+std::string(s_extractKeyOpts[2])
-	+space+std::string(s_extractKeyOpts[3])
-	+space+pubkeyFile;
-
-	g_warning("ApplicationInstaller::extractPublicKeyFromCert(): executing (via system()): %s",cmdline.c_str());
-	int exit_status = system(cmdline.c_str());
-	if (isNonErrorProcExit((int)exit_status) == false) {
-		g_warning("ApplicationInstaller::extractPublicKeyFromCert(): error: system() call returned %d",exit_status);
-		return 0;
+public:
+	SignatureVerifier(EVP_PKEY * key) : m_ctx(EVP_MD_CTX_new()), m_ok(false)
+	{
+		m_ok = (key && m_ctx && (EVP_DigestVerifyInit(m_ctx,NULL,EVP_sha1(),NULL,key) == 1));
+	}
+	~SignatureVerifier()
+	{
+		if (m_ctx)
+			EVP_MD_CTX_free(m_ctx);
+		ERR_clear_error();		//don't leave this thread's error queue growing
 	}
 
-	return 1;
+	bool ok() const { return m_ok; }
+
+	void update(const void * data,size_t len)
+	{
+		if (m_ok && (EVP_DigestVerifyUpdate(m_ctx,data,len) != 1))
+			m_ok = false;
+	}
+
+	void updateFromFile(const std::string& file)
+	{
+		if (!m_ok)
+			return;
+		int fd = ::open(file.c_str(),O_RDONLY);
+		if (fd < 0) {
+			g_warning("SignatureVerifier: can't open %s: %s",file.c_str(),strerror(errno));
+			m_ok = false;
+			return;
+		}
+		char buf[VERIFY_READ_BUFFER_SIZE];
+		while (m_ok) {
+			ssize_t n = ::read(fd,buf,sizeof(buf));
+			if (n == 0)
+				break;
+			if (n < 0) {
+				if (errno == EINTR)
+					continue;
+				g_warning("SignatureVerifier: error reading %s: %s",file.c_str(),strerror(errno));
+				m_ok = false;
+				break;
+			}
+			update(buf,n);
+		}
+		::close(fd);
+	}
+
+	// >0 verified, 0 signature didn't match, <0 couldn't check it
+	int verify(const std::string& signature)
+	{
+		if (!m_ok)
+			return -1;
+		m_ok = false;		//the context is spent either way
+		return (EVP_DigestVerifyFinal(m_ctx,(unsigned char *)signature.data(),signature.size()) == 1) ? 1 : 0;
+	}
+
+private:
+	EVP_MD_CTX * m_ctx;
+	bool m_ok;
+};
+
+//static 
+int ApplicationInstaller::doSignatureVerifyOnFile(const std::string& file,const std::string& signatureFile,const std::string& pubkeyFile)
+{
+	std::vector<std::string> files;
+	files.push_back(file);
+	return doSignatureVerifyOnFiles(files,signatureFile,pubkeyFile);
 }
 
 //static
 /*
  * Returns <= 0 for error, >0 for success
- * 
- * parameter command can be specified as a "", in which case the default openssl commandname is used
+ *
+ * The files are verified as if they were concatenated, in order, into one
  */
-int ApplicationInstaller::runOpenSSL(std::vector<std::string>& params,const std::string& command)
+int ApplicationInstaller::doSignatureVerifyOnFiles(std::vector<std::string>& files,const std::string& signatureFile,const std::string& pubkeyFile)
 {
-	
-	gchar * g_stdoutBuffer = NULL;
-	gchar * g_stderrBuffer = NULL;
-	std::string re;
-	int rc=0;
-	
-	gchar ** argv = new gchar *[params.size()+2];
-	if (command.size()) {
-		argv[0] = new gchar[command.size()+1];
-		strcpy(argv[0],command.c_str());
+	gchar * sigBuffer = NULL;
+	gsize sigLength = 0;
+	if (!g_file_get_contents(signatureFile.c_str(),&sigBuffer,&sigLength,NULL)) {
+		g_warning("ApplicationInstaller::doSignatureVerifyOnFiles(): can't read signature file %s",signatureFile.c_str());
+		return -1;
 	}
-	else {
-		argv[0] = new gchar[strlen("openssl")+1];
-		strcpy(argv[0],"openssl");
+	std::string signature(sigBuffer,sigLength);
+	g_free(sigBuffer);
+
+	EVP_PKEY * key = util_readPublicKey(pubkeyFile);
+	if (!key) {
+		g_warning("ApplicationInstaller::doSignatureVerifyOnFiles(): can't read public key %s",pubkeyFile.c_str());
+		ERR_clear_error();
+		return -1;
 	}
-	int sz=1;
-	for (std::vector<std::string>::iterator it = params.begin();
-			it != params.end();++it,++sz) 
+
+	int rc;
 	{
-		std::string& str = (*it);
-		argv[sz] = new gchar[str.size()+1];
-		strcpy(argv[sz],str.c_str());
+		SignatureVerifier verifier(key);
+		for (std::vector<std::string>::iterator it = files.begin();it != files.end();++it)
+			verifier.updateFromFile(*it);
+		rc = verifier.verify(signature);
 	}
-	argv[sz] = 0;
-	
- 	GError * gerr = NULL;
-	gint exit_status=0;
-	GSpawnFlags flags = (GSpawnFlags)(G_SPAWN_SEARCH_PATH);
-
-	/*
-	 * gboolean            g_spawn_sync                 (const gchar *working_directory,
-		                                                         gchar **argv,
-		                                                         gchar **envp,
-		                                                         GSpawnFlags flags,
-		                                                         GSpawnChildSetupFunc child_setup,
-		                                                         gpointer user_data,
-		                                                         gchar **standard_output,
-		                                                         gchar **standard_error,
-		                                                         gint *exit_status,
-		                                                         GError **error);
-	 */
+	EVP_PKEY_free(key);
+	return rc;
+}
 
-	gboolean resultStatus = g_spawn_sync(NULL,
-			argv,
-			NULL,
-			flags,
-			NULL,
-			NULL,
-			&g_stdoutBuffer,
-			&g_stderrBuffer,
-			&exit_status,
-			&gerr);
+//static
+/*
+ * Returns <0 if the certificate's key couldn't be read, 0 if the signature doesn't match, >0 for success
+ */
+int ApplicationInstaller::doSignatureVerifyWithCert(const std::string& data,const std::string& signature,const std::string& certFile)
+{
+	EVP_PKEY * key = util_readPublicKeyFromCert(certFile);
+	if (!key) {
+		g_warning("ApplicationInstaller::doSignatureVerifyWithCert(): can't read a public key from %s",certFile.c_str());
+		ERR_clear_error();
+		return -1;
+	}
 
-	if ((!resultStatus) || (!g_stdoutBuffer)) {
-		rc = -1;
-		goto Done_run_ssl;
+	int rc;
+	{
+		SignatureVerifier verifier(key);
+		verifier.update(data.data(),data.size());
+		rc = verifier.verify(signature);
 	}
-	
-	//for some reason, the regexec doesn't like "|" or expects it in some weird way
-	if (compare_regex(".*failure.*",g_stdoutBuffer) || compare_regex(".*error.*",g_stdoutBuffer))
-		rc = 0;
-	else
-		rc =1;
+	EVP_PKEY_free(key);
+	return rc;
+}
 
-Done_run_ssl:
+//static 
+int ApplicationInstaller::extractPublicKeyFromCert(const std::string& certFile,const std::string& pubkeyFile)
+{
+	if ((certFile.size() == 0) || (pubkeyFile.size() == 0))
+		return 0;
+	
+	//warning: no explicit checks on pubkeyFile path/name validity, so the calls to this function need to be restricted
+	//(or else someone could specify e.g. /usr/bin/LunaSysMgr as the pubkeyFile to write to)
+	//...but as a basic safety check, the file must not exist already (O_EXCL). 
+	//This will require the file to be deleted before this function is run each time
+	
+	EVP_PKEY * key = util_readPublicKeyFromCert(certFile);
+	if (!key) {
+		g_warning("ApplicationInstaller::extractPublicKeyFromCert(): can't read a public key from %s",certFile.c_str());
+		ERR_clear_error();
+		return 0;
+	}
 
-	if (g_stdoutBuffer)
-		g_free(g_stdoutBuffer);
-	if (g_stderrBuffer)
-		g_free(g_stderrBuffer);
-	if (gerr) {
-		g_warning("ApplicationInstaller::runOpenSSL(): error - %s",gerr->message);
-		g_error_free(gerr);
+	int rc = 0;
+	FILE * fp = NULL;
+	int fd = ::open(pubkeyFile.c_str(),O_WRONLY | O_CREAT | O_EXCL,0644);
+	if (fd < 0) {
+		g_warning("ApplicationInstaller::extractPublicKeyFromCert(): can't create %s: %s",pubkeyFile.c_str(),strerror(errno));
+		goto Done;
 	}
-	
-	while (sz >= 0) {
-		if (argv[sz])
-			delete[] argv[sz];
-		--sz;
+	fp = fdopen(fd,"w");
+	if (!fp) {
+		::close(fd);
+		unlink(pubkeyFile.c_str());
+		goto Done;
 	}
-	delete[] argv;
-	
-	return rc;	
+	if (PEM_write_PUBKEY(fp,key) == 1)
+		rc = 1;
+	if ((fclose(fp) != 0) || (rc == 0)) {
+		g_warning("ApplicationInstaller::extractPublicKeyFromCert(): error writing %s",pubkeyFile.c_str());
+		unlink(pubkeyFile.c_str());
+		rc = 0;
+	}
+
+Done:
+	EVP_PKEY_free(key);
+	ERR_clear_error();
+	return rc;
 }
 
 //static 
@@ -3378,15 +3878,12 @@ bool ApplicationInstaller::cbRevoke(LSHandle* lshandle,LSMessage *msg,void *user
 	std::string errorText;
 	std::string innerPayload;
 	std::string appIdGlob;
-	std::string appIdGlobTmpFilename;
 	std::string signatureBase64;
 	std::string signatureRaw;
-	std::string signatureTmpFilename;
 	struct json_object * appidArray;
 	std::string appIdForIdx;
 	int listIdx;
-	std::vector<std::string> opensslParams;
-	std::string pubkeyTmpFilename;
+	int verifyRc;
 
     // {"item": string, "payload": {"signature": string, "appId": array}}
     VALIDATE_SCHEMA_AND_RETURN(lshandle,
@@ -3448,29 +3945,13 @@ bool ApplicationInstaller::cbRevoke(LSHandle* lshandle,LSMessage *msg,void *user
 		appIdGlob += appIdForIdx;
 	}
 	
-	//write the signature out to a temp file
-	if (writeToTempFile(signatureRaw,"/tmp/",signatureTmpFilename) == false) {
-		errorText = "couldn't create temp filename for signature";
-		goto Done;
-	}
-	
-	//write appid glob to a temp file
-	if (writeToTempFile(appIdGlob,"/tmp/",appIdGlobTmpFilename) == false) {
-		errorText = "couldn't create temp filename for appid glob";
-		goto Done;
-	}
-	
-	//extract the pubkey to a tempfile
-	//but first delete any old ones there
-	pubkeyTmpFilename = std::string("/tmp/pubsub_pubkey.pem");
-	unlink(pubkeyTmpFilename.c_str());
-	if (ApplicationInstaller::extractPublicKeyFromCert(s_revocationCertFile,pubkeyTmpFilename) <= 0) {
+	//verify the signature of the appid glob against the revocation cert's key
+	verifyRc = ApplicationInstaller::doSignatureVerifyWithCert(appIdGlob,signatureRaw,s_revocationCertFile);
+	if (verifyRc < 0) {
 		errorText = "key extraction from cert failed";
 		goto Done;
 	}
-				
-	//verify the signature
-	if (ApplicationInstaller::doSignatureVerifyOnFile(appIdGlobTmpFilename,signatureTmpFilename,pubkeyTmpFilename) <= 0) {
+	if (verifyRc == 0) {
 		errorText = "verify failed";
 		goto Done;
 	}
@@ -3489,11 +3970,6 @@ Done:
 	if (item_root)
 		json_object_put(item_root);
 	
-	if (signatureTmpFilename.size())
-		deleteFile(signatureTmpFilename.c_str());
-	if (pubkeyTmpFilename.size())
-		deleteFile(pubkeyTmpFilename.c_str());
-	
 	std::string reply;
 	if (errorText.size()) {
 		reply = std::string("{ \"returnValue\":false , \"errorCode\":\"")+errorText+std::string("\"}");
@@ -3936,13 +4412,44 @@ bool ApplicationInstaller::isValidInstallURI(const std::string& url)
 
 void ApplicationInstaller::processOrQueueCommand(CommandParams* cmd)
 {
+	cmd->_queuedAt = g_get_monotonic_time();
+
+	if (!cmd->touchesPackageDb()) {
+		if (cmd->readsPackageDb() && packageDbBusy())
+			m_commandsWaitingForPackageDb.push_back(cmd);		// started by processCommands() once it's free
+		else
+			startConcurrentCommand(cmd);
+		return;
+	}
+
     s_commandParams.push_back(cmd);
 	if (s_commandParams.size() == 1) {
 		// First command in queue. start executing
-		while (processNextCommand()) {}
+		processCommands();
 	}
 }
 
+// runs the queued installs and removes, and once none of them is running, the readers that were waiting for it
+void ApplicationInstaller::processCommands()
+{
+	while (processNextCommand()) {}
+
+	if (m_cmdState.processing)
+		return;
+
+	std::list<CommandParams*> waiting;
+	waiting.swap(m_commandsWaitingForPackageDb);
+	for (std::list<CommandParams*>::iterator it = waiting.begin(); it != waiting.end(); ++it)
+		startConcurrentCommand(*it);
+}
+
+// a reader has to wait while an install or remove runs, and also behind one that is itself waiting for the readers already
+// running (see processNextCommand()), so that a steady stream of readers can't hold off installs
+bool ApplicationInstaller::packageDbBusy() const
+{
+	return m_cmdState.processing || (!s_commandParams.empty() && m_packageDbReadersRunning > 0);
+}
+
 // returns true if it should be called again
 bool ApplicationInstaller::processNextCommand()
 {
@@ -3959,10 +4466,16 @@ bool ApplicationInstaller::processNextCommand()
 
 	if (m_cmdState.processing)
 		return false;
+
+	// ipkg mustn't change the package database under a reader; cbConcurrentCommandDone() calls back when they're done
+	if (m_packageDbReadersRunning > 0)
+		return false;
 	
 	CommandParams* cmd = s_commandParams.front();
 	bool ret;
 	
+	cmd->_startedAt = g_get_monotonic_time();
+
     switch (cmd->_type) {
 	case (CommandParams::Install): {
 		g_warning("Processing install command");
@@ -3988,6 +4501,7 @@ bool ApplicationInstaller::processNextCommand()
 	// Command failed
 	g_critical("%s:%d Command failed: %d", __PRETTY_FUNCTION__, __LINE__,
 			  cmd->_type);
+	reportCommandTimes(cmd,"failed");
 	s_commandParams.pop_front();
 	delete cmd;
 	return true; // call me again
@@ -4106,11 +4620,138 @@ void ApplicationInstaller::oneCommandProcessed()
 
 	CommandParams* cmd = s_commandParams.front();
 	s_commandParams.pop_front();
+	reportCommandTimes(cmd,"done");
 	delete cmd;
 
 	m_cmdState.reset();
 	
-	while (processNextCommand()) {}
+	processCommands();
+}
+
+void ApplicationInstaller::setMaxConcurrentCommands(int max)
+{
+	if (max < 1)
+		max = 1;
+	m_maxConcurrentCommands = max;
+	if (m_concurrentPool)
+		g_thread_pool_set_max_threads(m_concurrentPool,max,NULL);
+}
+
+void ApplicationInstaller::startConcurrentCommand(CommandParams* cmd)
+{
+	if (!m_concurrentPool) {
+		GError* gerr = NULL;
+		m_concurrentPool = g_thread_pool_new(concurrentCommandWorkerFn,
+											 g_main_loop_get_context(HostBase::instance()->mainLoop()),
+											 m_maxConcurrentCommands,FALSE,&gerr);
+		if (!m_concurrentPool) {
+			g_warning("%s: unable to create the worker pool (%s); running the command here",
+					  __FUNCTION__, (gerr ? gerr->message : "unknown error"));
+			if (gerr)
+				g_error_free(gerr);
+			++m_concurrentCommandsRunning;
+			if (cmd->readsPackageDb())
+				++m_packageDbReadersRunning;
+			concurrentCommandWorkerFn(cmd,NULL);
+			cbConcurrentCommandDone(cmd);
+			return;
+		}
+	}
+
+	++m_concurrentCommandsRunning;
+	if (cmd->readsPackageDb())
+		++m_packageDbReadersRunning;
+	g_thread_pool_push(m_concurrentPool,cmd,NULL);
+}
+
+//runs on one of m_concurrentPool's threads. Must not touch anything but cmd and the filesystem; the rest of the command
+//is finished on the main loop by cbConcurrentCommandDone()
+void ApplicationInstaller::concurrentCommandWorkerFn(gpointer data,gpointer userData)
+{
+	CommandParams* cmd = (CommandParams*)data;
+	cmd->_startedAt = g_get_monotonic_time();
+
+	switch (cmd->_type) {
+	case (CommandParams::Size): {
+		SizeParams* sizeParams = static_cast<SizeParams*>(cmd);
+		getAllUserInstalledAppNames(sizeParams->_appNames,Settings::LunaSettings()->appInstallBase);
+		break;
+	}
+	case (CommandParams::PackageSizes): {
+		PackageSizesParams* sizesParams = static_cast<PackageSizesParams*>(cmd);
+		for (std::vector<PackageSizesParams::Item>::iterator it = sizesParams->_items.begin(); it != sizesParams->_items.end(); ++it) {
+			if (!it->folders.empty())
+				it->measured = getSizeOfPackageFolders("",it->packageId,it->version,it->folders,it->size,NULL);
+		}
+		break;
+	}
+	default:
+		g_critical("%s:%d Unexpected command param type: %d",
+				   __PRETTY_FUNCTION__, __LINE__, cmd->_type);
+	}
+
+	if (!userData)
+		return;		//called directly, by startConcurrentCommand()
+
+	GSource* source = g_idle_source_new();
+	g_source_set_callback(source,cbConcurrentCommandDone,cmd,NULL);
+	g_source_attach(source,(GMainContext*)userData);
+	g_source_unref(source);
+}
+
+gboolean ApplicationInstaller::cbConcurrentCommandDone(gpointer data)
+{
+	CommandParams* cmd = (CommandParams*)data;
+
+	switch (cmd->_type) {
+	case (CommandParams::Size): {
+		SizeParams* sizeParams = static_cast<SizeParams*>(cmd);
+		ApplicationInstaller::instance()->replyInstalledSizes(sizeParams->_lshandle,sizeParams->_msg,sizeParams->_appNames);
+		break;
+	}
+	case (CommandParams::PackageSizes): {
+		PackageSizesParams* sizesParams = static_cast<PackageSizesParams*>(cmd);
+		for (std::vector<PackageSizesParams::Item>::iterator it = sizesParams->_items.begin(); it != sizesParams->_items.end(); ++it) {
+			if (it->folders.empty())
+				continue;		//known before the command was queued
+			//the package may have been removed or updated while it was walked; only a size for the version still installed is kept
+			PackageDescription* packageDesc = ApplicationManager::instance()->getPackageInfoByPackageId(it->packageId);
+			if (!packageDesc || packageDesc->version() != it->version)
+				continue;
+			if (it->measured) {
+				packageDesc->setPackageSize(it->size);
+			} else {
+				g_warning("%s: couldn't measure %s", __FUNCTION__, it->packageId.c_str());
+				it->size = packageDesc->packageSize();
+			}
+		}
+		ApplicationInstaller::instance()->replyPackageSizes(sizesParams);
+		break;
+	}
+	default:
+		break;
+	}
+
+	reportCommandTimes(cmd,"done");
+
+	ApplicationInstaller* installer = ApplicationInstaller::instance();
+	--(installer->m_concurrentCommandsRunning);
+	if (cmd->readsPackageDb() && --(installer->m_packageDbReadersRunning) == 0)
+		installer->processCommands();		// an install or remove may have been waiting for the last reader
+	delete cmd;
+
+	return FALSE;
+}
+
+void ApplicationInstaller::reportCommandTimes(const CommandParams* cmd,const char* outcome)
+{
+	gint64 now = g_get_monotonic_time();
+	gint64 startedAt = (cmd->_startedAt ? cmd->_startedAt : now);
+
+	g_message("%s: command %d %s: waited %lld ms in queue, ran %lld ms",
+			  __FUNCTION__, cmd->_type, outcome,
+			  (long long)((startedAt - cmd->_queuedAt) / 1000),
+			  (long long)((now - startedAt) / 1000));
 }
 
 void ApplicationInstaller::slotMediaPartitionAvailable(bool val)
@@ -4155,6 +4796,9 @@ void ApplicationInstaller::enterBrickMode()
 		::waitpid(m_cmdState.pid, &status, WNOHANG);
 
 		m_cmdState.reset();
+
+		// readers that were waiting on the killed command can run; the rest of the queue stays until exitBrickMode()
+		processCommands();
 	}
 }
 
@@ -4173,12 +4817,12 @@ void ApplicationInstaller::exitBrickMode()
 		return;
 	
 	// Resume any pending install/remove commands
-	while (processNextCommand()) {}
+	processCommands();
 }
 
 bool ApplicationInstaller::allowSuspend()
 {
-	return !m_cmdState.processing;
+	return !m_cmdState.processing && m_concurrentCommandsRunning == 0 && m_commandsWaitingForPackageDb.empty();
 }
 
 json_object * ApplicationInstaller::packageInfoFileToJson(const std::string& packageId)
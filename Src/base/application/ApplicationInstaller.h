@@ -54,11 +54,13 @@ class CommandParams {
 public:
 	enum Type {
 		Install = 0,
-		Remove
+		Remove,
+		Size,
+		PackageSizes
 	};
 
 	CommandParams(Type t) :
-		_type(t), _childStdOutChannel(0), _childStdOutSource(0) {
+		_type(t), _childStdOutChannel(0), _childStdOutSource(0), _queuedAt(0), _startedAt(0) {
 	}
 	
 	virtual ~CommandParams() {
@@ -71,9 +73,17 @@ public:
 		}
 	}
 
+	// installs and removes run ipkg (or ApplicationInstallerUtility, which does), so only one of them may run at a time.
+	// Anything else runs on the installer's worker threads
+	bool touchesPackageDb() const { return _type == Install || _type == Remove; }
+	// ...but those that read the package database (ipkg list_installed) still must not overlap an install or remove
+	bool readsPackageDb() const { return _type == Size; }
+
 	Type _type;
 	GIOChannel* _childStdOutChannel;
 	GSource* _childStdOutSource;
+	gint64 _queuedAt;			// monotonic usecs; for the queue wait / run time reported when the command is done
+	gint64 _startedAt;
 };
 
 class InstallParams : public CommandParams {
@@ -104,6 +114,46 @@ public:
 	const int 		  _cause;
 };
 
+class SizeParams : public CommandParams {
+public:
+	SizeParams(LSHandle * lshandle,LSMessage * msg)
+		: CommandParams(CommandParams::Size), _lshandle(lshandle), _msg(msg)
+	{
+		LSMessageRef(_msg);
+	}
+	virtual ~SizeParams() {
+		LSMessageUnref(_msg);
+	}
+	LSHandle * _lshandle;
+	LSMessage * _msg;
+	std::vector<std::string> _appNames;		// filled in on a worker thread
+};
+
+class PackageSizesParams : public CommandParams {
+public:
+	struct Item {
+		std::string key;			// what the size is replied under
+		std::string packageId;
+		std::string version;
+		std::vector<std::string> folders;	// left empty when the size was known without a walk
+		uint64_t size;
+		bool measured;				// set on a worker thread
+	};
+
+	PackageSizesParams(LSHandle * lshandle,LSMessage * msg,uint32_t dbSize)
+		: CommandParams(CommandParams::PackageSizes), _lshandle(lshandle), _msg(msg), _dbSize(dbSize)
+	{
+		LSMessageRef(_msg);
+	}
+	virtual ~PackageSizesParams() {
+		LSMessageUnref(_msg);
+	}
+	LSHandle * _lshandle;
+	LSMessage * _msg;
+	uint32_t _dbSize;			// added to each size that isn't 0
+	std::vector<Item> _items;
+};
+
 class ApplicationInstaller : public QObject
 {
 	Q_OBJECT
@@ -146,20 +196,16 @@ public:
 
 	static uint64_t getSizeOfAppDir(const std::string& dirName);
 	
-	static Mutex		s_sizeFnMutex;
-	static uint64_t		s_sizeFnAccumulator;
-	static uint64_t		s_auxSizeFnAccumulator;
-	static uint64_t		s_targetFsBlockSize;
-	static std::string  s_sizeFnBaseDir;
-	static json_object * s_manifestJobj;
-	
-	static int _getSizeCbFn(const char *fpath, const struct stat *sb,int typeflag, struct FTW *ftwbuf);
-	static int _getSizeOfAppCbFn(const char *fpath, const struct stat *sb,int typeflag, struct FTW *ftwbuf);
-	
 //	static uint64_t getSizeOfAppDir_opt(const std::string& dirName);
 	static uint64_t getSizeOfAppOnFs(const std::string& destFsPath,const std::string& dirName,uint32_t * r_pBsize=NULL);
 	static uint64_t getSizeOfPackageOnFsGenerateManifest(const std::string& destFsPath, PackageDescription* packageDesc, uint32_t * r_pBsize);
 	static uint64_t getSizeOfPackageById(const std::string& packageId);
+	// replies to msg with the size of each package, keyed by the first of each pair (plus dbSize
+	// for each package that has a size); sizes that need a walk are measured on
+	// the installer's worker threads and the reply is sent from the main loop once they're done
+	void getPackageSizes(LSHandle * lshandle,LSMessage *msg,const std::vector<std::pair<std::string,std::string> >& keysAndPackageIds,uint32_t dbSize);
+	static bool getSizeOfPackageFolders(const std::string& destFsPath,const std::string& packageId,const std::string& version,const std::vector<std::string>& folders,uint64_t& r_size,uint32_t * r_pBsize);
+	static bool measurePackageFolders(const std::string& destFsPath,const std::vector<std::string>& folders,uint64_t& r_size,uint64_t& r_stamp);
 
 	static uint64_t getFsFreeSpaceInMB(const std::string& pathOnFs);
 	static uint64_t getFsFreeSpaceInBlocks(const std::string& pathOnFs,uint64_t * pBlockSize = 0);
@@ -174,6 +220,7 @@ public:
 	static bool isValidInstallURI(const std::string& url);
 
 	bool allowSuspend();
+	void setMaxConcurrentCommands(int max);		// how many commands that don't touch the package database may run at once (--installer-workers)
 
 	json_object * packageInfoFileToJson(const std::string& packageId);
 
@@ -208,6 +255,7 @@ private:
 	bool processInstallCommand(InstallParams* params);
 	bool processRemoveCommand(RemoveParams* params);
 	bool processNextCommand();
+	void processCommands();
 
 	void closeApp(const std::string& appId);
 
@@ -220,8 +268,8 @@ private:
 
 	static int doSignatureVerifyOnFile(const std::string& file,const std::string& signatureFile,const std::string& pubkeyFile);
 	static int doSignatureVerifyOnFiles(std::vector<std::string>& files,const std::string& signatureFile,const std::string& pubkeyFile);
+	static int doSignatureVerifyWithCert(const std::string& data,const std::string& signature,const std::string& certFile);
 	static int extractPublicKeyFromCert(const std::string& certFile,const std::string& pubkeyFile);
-	static int runOpenSSL(std::vector<std::string>& params,const std::string& command);
 	static int runIpkgRemove(const std::string& ipkgRoot,const std::string& packageName);
 	
 	static std::list<CommandParams*> s_commandParams;
@@ -244,6 +292,22 @@ private:
 	};
 
 	CommandState m_cmdState;
+
+	static const int s_defaultMaxConcurrentCommands = 2;
+	GThreadPool* m_concurrentPool;		// runs the commands that don't touch the package database
+	int m_maxConcurrentCommands;
+	int m_concurrentCommandsRunning;		// queued or running in m_concurrentPool; main thread only
+	int m_packageDbReadersRunning;			// those of them that read the package database; installs and removes wait for these
+	std::list<CommandParams*> m_commandsWaitingForPackageDb;	// readers held back while an install or remove runs
+
+	bool packageDbBusy() const;
+	void startConcurrentCommand(CommandParams* cmd);
+	static void concurrentCommandWorkerFn(gpointer data,gpointer userData);
+	static gboolean cbConcurrentCommandDone(gpointer data);
+	static void reportCommandTimes(const CommandParams* cmd,const char* outcome);
+	void replyInstalledSizes(LSHandle * lshandle,LSMessage *msg,const std::vector<std::string>& appNames);
+	void replyPackageSizes(PackageSizesParams* cmd);
+	static int collectAppSizes(const std::vector<std::string>& appNames,std::vector<std::pair<std::string,uint64_t> >& appList);
 	
 	//------------------------------------------------ DEBUG -----------------------------------------------------------
 	
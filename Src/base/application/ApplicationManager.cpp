@@ -40,6 +40,9 @@
 #include "ApplicationInstaller.h"
 #include "EventReporter.h"
 #include "ApplicationProcessManager.h"
+#include "RegistrySnapshot.h"
+#include "AppFolderWatcher.h"
+#include "LaunchPointJournal.h"
 
 #if !(defined(TARGET_DESKTOP) || defined(TARGET_EMULATOR))
 // TODO:  Reactivate ServiceInstaller
@@ -90,6 +93,13 @@ Mutex ApplicationManager::s_mutexExecLockFunctions;
 
 static std::string rot13( const char* s );
 static bool hardwareFeaturesRequirementSatisfied(uint32_t hardwareFeaturesNeeded);
+static ApplicationDescription* parseApplicationFolder(const std::string& appFolderPath,const std::string& locale,bool deferRegistration,bool offMainThread);
+static PackageDescription* parsePackageFolder(const std::string& packageFolderPath,const std::string& locale);
+static ServiceDescription* parseServiceFolder(const std::string& serviceFolderPath);
+static uint64_t monotonicTimeMs();
+
+// upper bound on the number of threads parsing app folders during the initial scan
+static const int sMaxScanWorkers = 4;
 
 unsigned long ApplicationManager::s_ticketGenerator = 1;
 
@@ -109,6 +119,12 @@ ApplicationManager::ApplicationManager()
 {
     m_service = 0;
     m_initialScan = true;
+    m_launchPointGeneration = 1;
+    m_launchPointIndexGeneration = 0;
+    m_appFolderWatcher = 0;
+    m_deferScanRegistrations = false;
+    m_launchPointBatchDepth = 0;
+    m_launchPointBatchTimer = 0;
 
     ////hmmm, maybe better to load these in init()? need to consider race based on request-before-init...
     if (doesExistOnFilesystem(Settings::LunaSettings()->lunaCmdHandlerSavedPath.c_str()))
@@ -123,6 +139,7 @@ ApplicationManager::~ApplicationManager()
 {
     clear();
     stopService();
+    delete m_appFolderWatcher;
     s_instance = 0;
 }
 
@@ -136,16 +153,21 @@ void ApplicationManager::clear()
     }
 
     m_registeredApps.clear();
+    m_registeredAppsById.clear();
     m_initialScan = true;
+    if (m_appFolderWatcher)
+        m_appFolderWatcher->stop();        //the next scan is a full one and re-arms it
 
     for (unsigned int i=0; i < m_systemApps.size(); ++i) {
         delete m_systemApps[i];
     }
 
     m_systemApps.clear();
+    m_systemAppsById.clear();
 }
 
 static const char* s_hiddenAppsPath = "/var/luna/data/.hidden-apps.json";
+static const char* s_registrySnapshotPath = "/var/luna/data/.appmanager-registry";
 
 bool ApplicationManager::init(  )
 {
@@ -323,25 +345,66 @@ void ApplicationManager::scan()
 
     if (m_initialScan) {
         m_initialScan=false;                //TODO: reset this if scans fail
+
+        uint64_t parseStartMs = monotonicTimeMs();
+        RegistrySnapshot::instance()->beginScan(s_registrySnapshotPath,LocalePreferences::instance()->locale().toStdString());
+        prefetchInitialScan();
+        uint64_t mergeStartMs = monotonicTimeMs();
+        m_deferScanRegistrations = true;
+
         scanForSystemApplications();
         scanForApplications();
         scanForPackages();
         createPackageDescriptionForOldApps();
         scanForServices();
         scanForPendingApplications();
+        m_deferScanRegistrations = false;
+        completeInitialScanRegistrations();
+        dropInitialScanPrefetch();
+        RegistrySnapshot::instance()->commitScan();
 
         scanForLaunchPoints(Settings::LunaSettings()->lunaPresetLaunchPointsPath);
         scanForLaunchPoints(Settings::LunaSettings()->lunaLaunchPointsPath);
+
+        //from now on rescans only need to look at the app folders that changed
+        std::vector<std::string> appRoots;
+        for (std::vector<std::string>::const_iterator root_it = Settings::LunaSettings()->lunaAppsPaths.begin();
+             root_it != Settings::LunaSettings()->lunaAppsPaths.end(); ++root_it) {
+            std::string appFolder = *root_it;
+            if (appFolder.empty())
+                continue;
+            if (appFolder[appFolder.size() - 1] != '/')
+                appFolder += "/";
+            appRoots.push_back(appFolder);
+        }
+        if (!m_appFolderWatcher)
+            m_appFolderWatcher = new AppFolderWatcher();
+        m_appFolderWatcher->start(appRoots);
+
+        uint64_t endMs = monotonicTimeMs();
+        g_message("%s: initial scan took %llu ms (parallel parse: %llu ms, merge: %llu ms)", __FUNCTION__,
+                  (unsigned long long)(endMs - parseStartMs),
+                  (unsigned long long)(mergeStartMs - parseStartMs),
+                  (unsigned long long)(endMs - mergeStartMs));
         return;
     }
 
     //..at this point, it's a "rescan"....
+    //all the launch point changes it produces go out to batch subscribers together
+    beginLaunchPointBatch();
+
     std::vector<ApplicationDescription *> removed;            //these pointers will point to things in m_registeredApps
     std::vector<ApplicationDescription *> added;            //these pointers will point to NEW ApplicationDescription objects
     std::vector<ApplicationDescription *> changed;            //these pointers will point to things in m_registeredApps
 
     ApplicationDescription * pAppDesc, *pRegAppDesc;
-    ApplicationManager::instance()->discoverAppChanges(added,removed,changed);
+    std::set<std::string> changedFolders;
+    if (m_appFolderWatcher && m_appFolderWatcher->takeChanges(changedFolders)) {
+        g_message("%s: %d app folders changed since the last scan", __FUNCTION__, (int)changedFolders.size());
+        discoverAppChanges(changedFolders,added,removed,changed);
+    }
+    else
+        ApplicationManager::instance()->discoverAppChanges(added,removed,changed);
 
     std::vector<ApplicationDescription *>::iterator it = added.begin();
 
@@ -387,6 +450,7 @@ void ApplicationManager::scan()
 
         //now update the app descriptor for this app
         pRegAppDesc->update(*pAppDesc);
+        invalidateLaunchPoints();
         //and post a launchpoint update
         postLaunchPointChange(pRegAppDesc->getDefaultLaunchPoint(), "updated");
         // remove the update appdesc from our pending list
@@ -416,12 +480,14 @@ void ApplicationManager::scan()
         pAppDesc = *it;
         if (pAppDesc->isRemoveFlagged()) {
             it = m_registeredApps.erase(it);
+            unindexApp(m_registeredApps,m_registeredAppsById,pAppDesc);
             pAppDesc->launchPoints(launchPoints);
             for (LaunchPointList::iterator lpit = launchPoints.begin();lpit != launchPoints.end();lpit++) {
                 const LaunchPoint *pLpoint = *lpit;
                 if (pLpoint->isDefault()) {
                     postLaunchPointChange(pLpoint, "removed");
                     pAppDesc->removeLaunchPoint(pLpoint);
+                    invalidateLaunchPoints();
                 }
                 else {
                     std::string erc;
@@ -443,7 +509,7 @@ void ApplicationManager::scan()
     it = added.begin();
     while (it !=  added.end()) {
         pAppDesc = *it;                                //pAppDesc points to a NEW ApplicationDescriptor
-        m_registeredApps.push_back(pAppDesc);
+        indexApp(m_registeredApps,m_registeredAppsById,pAppDesc);
         const LaunchPoint *pLpoint = pAppDesc->getDefaultLaunchPoint();
         if (pLpoint) {
             postLaunchPointChange(pLpoint,"added");
@@ -454,6 +520,8 @@ void ApplicationManager::scan()
         ApplicationInstaller::instance()->notifyAppInstalled(pAppDesc->id(),pAppDesc->version());
         it++;
     }
+
+    endLaunchPointBatch();
 }
 
 void ApplicationManager::postInstallScan(const std::string& appId) {
@@ -464,7 +532,7 @@ void ApplicationManager::postInstallScan(const std::string& appId) {
     ApplicationDescription* appDesc = installApp(appId);
     PackageDescription* packageDesc = PackageDescription::fromApplicationDescription(appDesc);
     if (packageDesc) {
-        m_registeredPackages[packageDesc->id()] = packageDesc;
+        registerPackage(packageDesc);
     }
 
     createOrUpdatePackageManifest(packageDesc);
@@ -481,7 +549,7 @@ void ApplicationManager::postInstallScan(json_object * pPackageInfoJson, const s
     if (!packageDesc)
         return;
 
-    m_registeredPackages[packageDesc->id()] = packageDesc;
+    registerPackage(packageDesc);
 
     std::vector<std::string>::const_iterator appIdIt, appIdItEnd;
     for (appIdIt = packageDesc->appIds().begin(), appIdItEnd = packageDesc->appIds().end(); appIdIt != appIdItEnd; ++appIdIt) {
@@ -550,7 +618,7 @@ ApplicationDescription* ApplicationManager::installSysApp(const std::string& app
 
     // newly installed app
     g_message("(A)\t%s", pAppDesc->id().c_str());
-    m_registeredApps.push_back(pAppDesc);
+    indexApp(m_registeredApps,m_registeredAppsById,pAppDesc);
     const LaunchPoint *pLpoint = pAppDesc->getDefaultLaunchPoint();
     if (pLpoint)
     {
@@ -590,6 +658,7 @@ ApplicationDescription* ApplicationManager::installApp(const std::string& appId)
             disableDockModeLaunchPoint(existingAppDesc->id().c_str());
         }
         existingAppDesc->update(*newAppDesc);
+        invalidateLaunchPoints();
         g_message("%s: updated app descriptor: new value: %s",__FUNCTION__,existingAppDesc->toString().c_str());
 
         //and post a launchpoint update
@@ -609,7 +678,7 @@ ApplicationDescription* ApplicationManager::installApp(const std::string& appId)
         // newly installed app
         g_message("(A)\t%s", newAppDesc->id().c_str());
         EventReporter::instance()->report("install", newAppDesc->id().c_str());
-        m_registeredApps.push_back(newAppDesc);
+        indexApp(m_registeredApps,m_registeredAppsById,newAppDesc);
         const LaunchPoint *pLpoint = newAppDesc->getDefaultLaunchPoint();
         if (pLpoint) {
             postLaunchPointChange(pLpoint, "added");
@@ -756,58 +825,112 @@ std::vector<const LaunchPoint*> ApplicationManager::allLaunchPoints()
 {
     MutexLocker locker(&m_mutex);
 
-    std::vector<const LaunchPoint*> launchPoints;
-    std::vector<ApplicationDescription*>::const_iterator it, itEnd;
-    for (it = m_registeredApps.begin(), itEnd = m_registeredApps.end();    it != itEnd; ++it) {
+    refreshLaunchPointIndex();
+    return m_visibleLaunchPoints;
+}
 
-        ApplicationDescription* appDesc = *it;
+std::vector<const LaunchPoint*> ApplicationManager::allPendingLaunchPoints()
+{
+    MutexLocker locker(&m_mutex);
 
-        if (appDesc == NULL)
-            continue;
+    refreshLaunchPointIndex();
+    return m_visiblePendingLaunchPoints;
+}
 
-        if (appDesc->isVisible() == false)
-            continue;
+void ApplicationManager::invalidateLaunchPoints()
+{
+    MutexLocker locker(&m_mutex);
 
-        if (!hardwareFeaturesRequirementSatisfied(appDesc->hardwareFeaturesNeeded()))
+    ++m_launchPointGeneration;
+}
+
+///BE SURE TO EXTERNALLY LOCK APPLIST IF NEEDED!!!
+void ApplicationManager::refreshLaunchPointIndex()
+{
+    if (m_launchPointIndexGeneration == m_launchPointGeneration)
+        return;
+
+    m_launchPointsById.clear();
+    m_pendingLaunchPointsById.clear();
+    m_visibleLaunchPoints.clear();
+    m_visiblePendingLaunchPoints.clear();
+    m_titleSearchTokens.clear();
+    m_keywordSearchTokens.clear();
+    m_menuNameSearchTokens.clear();
+
+    std::vector<ApplicationDescription*>::const_iterator it, itEnd;
+    for (it = m_registeredApps.begin(), itEnd = m_registeredApps.end(); it != itEnd; ++it) {
+
+        ApplicationDescription* appDesc = *it;
+        if (appDesc == NULL)
             continue;
 
+        bool visible = appDesc->isVisible() && hardwareFeaturesRequirementSatisfied(appDesc->hardwareFeaturesNeeded());
         for (LaunchPointList::const_iterator iter = appDesc->launchPoints().begin();
         iter != appDesc->launchPoints().end(); ++iter) {
 
-            launchPoints.push_back(*iter);
+            //first one wins, as it did with the old front-to-back scan
+            m_launchPointsById.insert(std::make_pair((*iter)->launchPointId(),*iter));
+            if (visible) {
+                m_visibleLaunchPoints.push_back(*iter);
+                addSearchTokens(*iter);
+            }
         }
     }
 
-    return launchPoints;
-}
+    std::sort(m_titleSearchTokens.begin(),m_titleSearchTokens.end());
+    std::sort(m_keywordSearchTokens.begin(),m_keywordSearchTokens.end());
+    std::sort(m_menuNameSearchTokens.begin(),m_menuNameSearchTokens.end());
 
-std::vector<const LaunchPoint*> ApplicationManager::allPendingLaunchPoints()
-{
-    MutexLocker locker(&m_mutex);
-
-    std::vector<const LaunchPoint*> launchPoints;
-    std::vector<ApplicationDescription*>::const_iterator it, itEnd;
     for (it = m_pendingApps.begin(), itEnd = m_pendingApps.end(); it != itEnd; ++it) {
 
         ApplicationDescription* appDesc = *it;
-
         if (appDesc == NULL)
             continue;
 
-        if (appDesc->isVisible() == false)
-            continue;
-
-        if (!hardwareFeaturesRequirementSatisfied(appDesc->hardwareFeaturesNeeded()))
-            continue;
-
+        bool visible = appDesc->isVisible() && hardwareFeaturesRequirementSatisfied(appDesc->hardwareFeaturesNeeded());
         for (LaunchPointList::const_iterator iter = appDesc->launchPoints().begin();
         iter != appDesc->launchPoints().end(); ++iter) {
 
-            launchPoints.push_back(*iter);
+            m_pendingLaunchPointsById.insert(std::make_pair((*iter)->launchPointId(),*iter));
+            if (visible)
+                m_visiblePendingLaunchPoints.push_back(*iter);
         }
     }
 
-    return launchPoints;
+    m_launchPointIndexGeneration = m_launchPointGeneration;
+}
+
+//the tokens are exactly what searchLaunchPoints() used to test every app against: a title matches if the search term is a
+//prefix of the title or of the part of it following any delimiter; the default launch point additionally matches on a
+//keyword (exact or prefix) or a prefix of the app's menu name
+void ApplicationManager::addSearchTokens(const LaunchPoint* lp)
+{
+    static const char* delimiters = " ,._-:;()\\[]{}\"/";
+
+    const gchar* lcTitle = lp->lowercaseTitle();
+    if (lcTitle && *lcTitle) {
+        m_titleSearchTokens.push_back(SearchToken(lcTitle,lp));
+        for (const gchar* p = lcTitle + 1; *p; ++p) {
+            if (strchr(delimiters,*(p - 1)))
+                m_titleSearchTokens.push_back(SearchToken(p,lp));
+        }
+    }
+
+    ApplicationDescription* appDesc = lp->appDesc();
+    if (!lp->isDefault() || !appDesc)
+        return;
+
+    std::list<std::string> keywords = appDesc->keywords();
+    for (std::list<std::string>::const_iterator it = keywords.begin(); it != keywords.end(); ++it) {
+        gchar* lcKeyword = g_utf8_strdown(it->c_str(), -1);
+        m_keywordSearchTokens.push_back(SearchToken(lcKeyword,lp));
+        g_free(lcKeyword);
+    }
+
+    gchar* lcMenuName = g_utf8_strdown(appDesc->menuName().c_str(), -1);
+    m_menuNameSearchTokens.push_back(SearchToken(lcMenuName,lp));
+    g_free(lcMenuName);
 }
 
 std::vector<ApplicationDescription*> ApplicationManager::allApps()
@@ -828,43 +951,25 @@ ApplicationDescription* ApplicationManager::getAppById( const std::string& appId
 {
     MutexLocker locker(&m_mutex);
 
-    for( std::vector<ApplicationDescription*>::iterator it=m_registeredApps.begin();
-    it != m_registeredApps.end(); ++it )
-    {
-        ApplicationDescription* app = *it;
-        if( app->id() == appId )
-            return app;
-    }
+    ApplicationDescription* app = getAppById(appId,m_registeredAppsById);
+    if (app)
+        return app;
 
-    for( std::vector<ApplicationDescription*>::iterator it=m_systemApps.begin();
-    it != m_systemApps.end(); ++it )
-    {
-        ApplicationDescription* app = *it;
-        if (app->id() == appId )
-            return app;
-    }
-    return 0;
+    return getAppById(appId,m_systemAppsById);
 }
 
 ApplicationDescription* ApplicationManager::getAppByIdHardwareCompatibleAppsOnly( const std::string& appId )
 {
     MutexLocker locker(&m_mutex);
 
-    for( std::vector<ApplicationDescription*>::iterator it=m_registeredApps.begin();
-    it != m_registeredApps.end(); ++it )
-    {
-        ApplicationDescription* app = *it;
-        if ((app->id() == appId) && (hardwareFeaturesRequirementSatisfied(app->hardwareFeaturesNeeded())))
-            return app;
-    }
+    ApplicationDescription* app = getAppById(appId,m_registeredAppsById);
+    if (app && hardwareFeaturesRequirementSatisfied(app->hardwareFeaturesNeeded()))
+        return app;
+
+    app = getAppById(appId,m_systemAppsById);
+    if (app && hardwareFeaturesRequirementSatisfied(app->hardwareFeaturesNeeded()))
+        return app;
 
-    for( std::vector<ApplicationDescription*>::iterator it=m_systemApps.begin();
-    it != m_systemApps.end(); ++it )
-    {
-        ApplicationDescription* app = *it;
-        if ((app->id() == appId) && (hardwareFeaturesRequirementSatisfied(app->hardwareFeaturesNeeded())))
-            return app;
-    }
     return 0;
 }
 
@@ -927,14 +1032,7 @@ ApplicationDescription* ApplicationManager::getPendingAppById(const std::string&
 {
     MutexLocker locker(&m_mutex);
 
-    std::vector<ApplicationDescription*>::iterator it, itEnd;
-    for (it=m_pendingApps.begin(), itEnd = m_pendingApps.end(); it != itEnd; ++it)
-    {
-        ApplicationDescription* app = *it;
-        if( app->id() == appId )
-            return app;
-    }
-    return 0;
+    return getAppById(appId,m_pendingAppsById);
 }
 
 bool ApplicationManager::getAppsByPackageId(const std::string& packageId, std::vector<ApplicationDescription *>& r_apps)
@@ -973,34 +1071,57 @@ bool ApplicationManager::getServicesByPackageId(const std::string& packageId, st
 
 PackageDescription* ApplicationManager::getPackageInfoByAppId(const std::string& anyAppIdInPackage)
 {
-    for (std::map<std::string, PackageDescription*>::const_iterator it = m_registeredPackages.begin(); it != m_registeredPackages.end(); ++it) {
-        PackageDescription* packageDesc = (*it).second;
-        std::vector<std::string> appIds = packageDesc->appIds();
-        std::vector<std::string>::const_iterator appIdIt, appIdItEnd;
-        for (appIdIt = appIds.begin(), appIdItEnd = appIds.end(); appIdIt != appIdItEnd; ++appIdIt) {
-            if (anyAppIdInPackage == *appIdIt) {
-                return packageDesc;
-            }
-        }
-    }
+    std::map<std::string, PackageDescription*>::const_iterator find_it = m_packagesByAppId.find(anyAppIdInPackage);
+    if (find_it != m_packagesByAppId.end())
+        return find_it->second;
     return NULL;
 }
 
 PackageDescription* ApplicationManager::getPackageInfoByServiceId(const std::string& anyServiceIdInPackage)
 {
-    for (std::map<std::string, PackageDescription*>::const_iterator it = m_registeredPackages.begin(); it != m_registeredPackages.end(); ++it) {
-        PackageDescription* packageDesc = (*it).second;
-        std::vector<std::string> serviceIds = packageDesc->serviceIds();
-        std::vector<std::string>::const_iterator serviceIdIt, serviceIdItEnd;
-        for (serviceIdIt = serviceIds.begin(), serviceIdItEnd = serviceIds.end(); serviceIdIt != serviceIdItEnd; ++serviceIdIt) {
-            if (anyServiceIdInPackage == *serviceIdIt) {
-                return packageDesc;
-            }
-        }
-    }
+    std::map<std::string, PackageDescription*>::const_iterator find_it = m_packagesByServiceId.find(anyServiceIdInPackage);
+    if (find_it != m_packagesByServiceId.end())
+        return find_it->second;
     return NULL;
 }
 
+void ApplicationManager::registerPackage(PackageDescription* packageDesc)
+{
+    std::map<std::string, PackageDescription*>::iterator find_it = m_registeredPackages.find(packageDesc->id());
+    if (find_it != m_registeredPackages.end() && find_it->second != packageDesc) {
+        //a re-registration (e.g. package update) replaces the old description's index entries
+        unregisterPackage(find_it->second);
+    }
+
+    m_registeredPackages[packageDesc->id()] = packageDesc;
+
+    std::vector<std::string>::const_iterator idIt, idItEnd;
+    for (idIt = packageDesc->appIds().begin(), idItEnd = packageDesc->appIds().end(); idIt != idItEnd; ++idIt)
+        m_packagesByAppId[*idIt] = packageDesc;
+    for (idIt = packageDesc->serviceIds().begin(), idItEnd = packageDesc->serviceIds().end(); idIt != idItEnd; ++idIt)
+        m_packagesByServiceId[*idIt] = packageDesc;
+}
+
+void ApplicationManager::unregisterPackage(PackageDescription* packageDesc)
+{
+    std::map<std::string, PackageDescription*>::iterator find_it = m_registeredPackages.find(packageDesc->id());
+    if (find_it != m_registeredPackages.end() && find_it->second == packageDesc)
+        m_registeredPackages.erase(find_it);
+
+    //only drop the entries that still point at this package; another package may have claimed the id since
+    std::vector<std::string>::const_iterator idIt, idItEnd;
+    for (idIt = packageDesc->appIds().begin(), idItEnd = packageDesc->appIds().end(); idIt != idItEnd; ++idIt) {
+        find_it = m_packagesByAppId.find(*idIt);
+        if (find_it != m_packagesByAppId.end() && find_it->second == packageDesc)
+            m_packagesByAppId.erase(find_it);
+    }
+    for (idIt = packageDesc->serviceIds().begin(), idItEnd = packageDesc->serviceIds().end(); idIt != idItEnd; ++idIt) {
+        find_it = m_packagesByServiceId.find(*idIt);
+        if (find_it != m_packagesByServiceId.end() && find_it->second == packageDesc)
+            m_packagesByServiceId.erase(find_it);
+    }
+}
+
 PackageDescription* ApplicationManager::getPackageInfoByPackageId(const std::string& packageId)
 {
     std::map<std::string, PackageDescription*>::iterator find_it = m_registeredPackages.find(packageId);
@@ -1028,6 +1149,33 @@ ApplicationDescription* ApplicationManager::getAppById( const std::string& appId
     return 0;
 }
 
+void ApplicationManager::indexApp(std::vector<ApplicationDescription*>& appList,AppIdIndex& index,ApplicationDescription* appDesc)
+{
+    appList.push_back(appDesc);
+    invalidateLaunchPoints();
+    //if the id is already in the index, the earlier entry keeps winning lookups (same as the old front-to-back list scans did)
+    index.insert(std::make_pair(appDesc->id(),appDesc));
+}
+
+void ApplicationManager::unindexApp(const std::vector<ApplicationDescription*>& appList,AppIdIndex& index,ApplicationDescription* appDesc)
+{
+    invalidateLaunchPoints();
+
+    AppIdIndex::iterator find_it = index.find(appDesc->id());
+    if (find_it == index.end() || find_it->second != appDesc)
+        return;
+
+    index.erase(find_it);
+
+    //if a duplicate with the same id is still in the list, it becomes the indexed one
+    for (std::vector<ApplicationDescription*>::const_iterator it = appList.begin(); it != appList.end(); ++it) {
+        if ((*it != appDesc) && ((*it)->id() == appDesc->id())) {
+            index[appDesc->id()] = *it;
+            break;
+        }
+    }
+}
+
 const LaunchPoint* ApplicationManager::getLaunchPointByIdHardwareCompatibleAppsOnly(const std::string& launchPointId)
 {
     if (launchPointId.empty())
@@ -1035,46 +1183,28 @@ const LaunchPoint* ApplicationManager::getLaunchPointByIdHardwareCompatibleAppsO
 
     MutexLocker locker(&m_mutex);
 
-    std::vector<ApplicationDescription*>::const_iterator it, itEnd;
-    for (it = m_registeredApps.begin(), itEnd = m_registeredApps.end(); it != itEnd; ++it)
-    {
-        ApplicationDescription* appDesc = *it;
-        if (appDesc == NULL)
-            continue;    //BAD
-        if (!(hardwareFeaturesRequirementSatisfied(appDesc->hardwareFeaturesNeeded())))
-            continue;
-
-        for (LaunchPointList::const_iterator iter = appDesc->launchPoints().begin();
-                iter != appDesc->launchPoints().end(); ++iter) {
-
-            const LaunchPoint* lp = *iter;
-            if (launchPointId == lp->launchPointId()) {
-                // always include pending versions
-                if (lp->isDefault()) {
-                    ApplicationDescription* pending = getPendingAppById(lp->appDesc()->id());
-                    if (pending) {
-                        lp = pending->getDefaultLaunchPoint();
-                    }
+    refreshLaunchPointIndex();
+
+    LaunchPointIdIndex::const_iterator find_it = m_launchPointsById.find(launchPointId);
+    if (find_it != m_launchPointsById.end()) {
+        const LaunchPoint* lp = find_it->second;
+        if (hardwareFeaturesRequirementSatisfied(lp->appDesc()->hardwareFeaturesNeeded())) {
+            // always include pending versions
+            if (lp->isDefault()) {
+                ApplicationDescription* pending = getPendingAppById(lp->appDesc()->id());
+                if (pending) {
+                    lp = pending->getDefaultLaunchPoint();
                 }
-                return lp;
             }
+            return lp;
         }
     }
 
-    for (it = m_pendingApps.begin(), itEnd = m_pendingApps.end(); it != itEnd; ++it)
-    {
-        ApplicationDescription* appDesc = *it;
-        if (appDesc == NULL)
-            continue;    //BAD
-        if (!(hardwareFeaturesRequirementSatisfied(appDesc->hardwareFeaturesNeeded())))
-            continue;
-        for (LaunchPointList::const_iterator iter = appDesc->launchPoints().begin();
-                iter != appDesc->launchPoints().end(); ++iter) {
-
-            const LaunchPoint* lp = *iter;
-            if (launchPointId == lp->launchPointId())
-                return lp;
-        }
+    find_it = m_pendingLaunchPointsById.find(launchPointId);
+    if (find_it != m_pendingLaunchPointsById.end()) {
+        const LaunchPoint* lp = find_it->second;
+        if (hardwareFeaturesRequirementSatisfied(lp->appDesc()->hardwareFeaturesNeeded()))
+            return lp;
     }
 
     return 0;
@@ -1087,40 +1217,24 @@ const LaunchPoint* ApplicationManager::getLaunchPointById(const std::string& lau
 
     MutexLocker locker(&m_mutex);
 
-    std::vector<ApplicationDescription*>::const_iterator it, itEnd;
-    for (it = m_registeredApps.begin(), itEnd = m_registeredApps.end(); it != itEnd; ++it)
-    {
-        ApplicationDescription* appDesc = *it;
-
-        for (LaunchPointList::const_iterator iter = appDesc->launchPoints().begin();
-        iter != appDesc->launchPoints().end(); ++iter) {
+    refreshLaunchPointIndex();
 
-            const LaunchPoint* lp = *iter;
-            if (launchPointId == lp->launchPointId()) {
-                // always include pending versions
-                if (lp->isDefault()) {
-                    ApplicationDescription* pending = getPendingAppById(lp->appDesc()->id());
-                    if (pending) {
-                        lp = pending->getDefaultLaunchPoint();
-                    }
-                }
-                return lp;
+    LaunchPointIdIndex::const_iterator find_it = m_launchPointsById.find(launchPointId);
+    if (find_it != m_launchPointsById.end()) {
+        const LaunchPoint* lp = find_it->second;
+        // always include pending versions
+        if (lp->isDefault()) {
+            ApplicationDescription* pending = getPendingAppById(lp->appDesc()->id());
+            if (pending) {
+                lp = pending->getDefaultLaunchPoint();
             }
         }
+        return lp;
     }
 
-    for (it = m_pendingApps.begin(), itEnd = m_pendingApps.end(); it != itEnd; ++it)
-    {
-        ApplicationDescription* appDesc = *it;
-
-        for (LaunchPointList::const_iterator iter = appDesc->launchPoints().begin();
-        iter != appDesc->launchPoints().end(); ++iter) {
-
-            const LaunchPoint* lp = *iter;
-            if (launchPointId == lp->launchPointId())
-                return lp;
-        }
-    }
+    find_it = m_pendingLaunchPointsById.find(launchPointId);
+    if (find_it != m_pendingLaunchPointsById.end())
+        return find_it->second;
 
     return 0;
 }
@@ -1170,7 +1284,7 @@ void ApplicationManager::scanForPackages()
                 if (::stat(onePackageFolderPath.c_str(), &stBuf) == 0 && stBuf.st_mode & S_IFDIR) {
                     PackageDescription* packageDesc = scanOnePackageFolder(onePackageFolderPath);
                     if (packageDesc) {
-                        m_registeredPackages[packageDesc->id()] = packageDesc;
+                        registerPackage(packageDesc);
                         if (packageDesc->accountIds().size() > 0) {
                             std::vector<ApplicationDescription*> apps;
                             getAppsByPackageId(packageDesc->id(), apps);
@@ -1205,7 +1319,7 @@ void ApplicationManager::createPackageDescriptionForOldApps()
             // This app did not have a packageinfo under /packages. We therefore need to create the PackageDescription for it
             PackageDescription* packageDesc = PackageDescription::fromApplicationDescription(appDesc);
             if (packageDesc) {
-                m_registeredPackages[packageDesc->id()] = packageDesc;
+                registerPackage(packageDesc);
                 createOrUpdatePackageManifest(packageDesc);
             }
         }
@@ -1287,7 +1401,7 @@ void ApplicationManager::scanForSystemApplications()
                 //force non-removable
                 appDesc->setRemovable(false);
                 appDesc->setVersion(platformVersion);
-                m_systemApps.push_back(appDesc);
+                indexApp(m_systemApps,m_systemAppsById,appDesc);
             }
             else {
                 delete appDesc;
@@ -1321,7 +1435,7 @@ void ApplicationManager::scanForPendingApplications()
                     else
                         appDesc->setStatus(ApplicationDescription::Status_Installing);
                     appDesc->setRemovable(true); // always deletable
-                    m_pendingApps.push_back(appDesc);
+                    indexApp(m_pendingApps,m_pendingAppsById,appDesc);
                     //LAUNCHER3-ADD:
                     Q_EMIT signalScanFoundApp(appDesc);
                 }
@@ -1355,6 +1469,15 @@ void ApplicationManager::scanForLaunchPoints(std::string launchPointFolder)
     if (launchPointFolder == Settings::LunaSettings()->lunaPresetLaunchPointsPath)
         forceNonRemovable=true;
 
+    //the dynamic launch points are kept in a journal (which also picks up any still stored as one file each)
+    if (launchPointFolder == Settings::LunaSettings()->lunaLaunchPointsPath) {
+        std::map<std::string,std::string> entries;
+        LaunchPointJournal::instance()->open(launchPointFolder, entries);
+        for (std::map<std::string,std::string>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+            addScannedLaunchPoint(LaunchPoint::fromJSON(0, it->second.c_str(), it->first), forceNonRemovable);
+        return;
+    }
+
     if (launchPointFolder[launchPointFolder.size() - 1] != '/')
         launchPointFolder += '/';
 
@@ -1372,33 +1495,34 @@ void ApplicationManager::scanForLaunchPoints(std::string launchPointFolder)
 
         std::string filePath = launchPointFolder + list[i]->d_name;
 
-        LaunchPoint* launchPoint = LaunchPoint::fromFile(0, filePath);
-        if (!launchPoint) {
-            free(list[i]);
-            continue;
-        }
-        else {
-            if (forceNonRemovable)
-                launchPoint->setRemovable(false);
-        }
-
-        ApplicationDescription* appDesc = getAppById(launchPoint->id());
-        if (!appDesc) {
-            free(list[i]);
-            delete launchPoint;
-            continue;
-        }
-
-        launchPoint->setAppDesc(appDesc);
-        appDesc->addLaunchPoint(launchPoint);
-        //LAUNCHER3-ADD
-        Q_EMIT signalScanFoundAuxiliaryLaunchPoint(appDesc,launchPoint);
+        addScannedLaunchPoint(LaunchPoint::fromFile(0, filePath), forceNonRemovable);
         free(list[i]);
     }
 
     free(list);
 }
 
+void ApplicationManager::addScannedLaunchPoint(LaunchPoint* launchPoint,bool forceNonRemovable)
+{
+    if (!launchPoint)
+        return;
+
+    if (forceNonRemovable)
+        launchPoint->setRemovable(false);
+
+    ApplicationDescription* appDesc = getAppById(launchPoint->id());
+    if (!appDesc) {
+        delete launchPoint;
+        return;
+    }
+
+    launchPoint->setAppDesc(appDesc);
+    appDesc->addLaunchPoint(launchPoint);
+    invalidateLaunchPoints();
+    //LAUNCHER3-ADD
+    Q_EMIT signalScanFoundAuxiliaryLaunchPoint(appDesc,launchPoint);
+}
+
 void ApplicationManager::scanApplicationsFolders(const std::string& appFoldersPath)
 {
     std::string folderPath(appFoldersPath);
@@ -1467,7 +1591,7 @@ void ApplicationManager::scanApplicationsFolders(const std::string& appFoldersPa
                             qDebug() << " ============= App: " << QString(appDesc->id().c_str()) << " is Removable = " << (appDesc->isRemovable() ? "TRUE" : "FALSE")
                                     << " , UserHideable = " << (appDesc->isUserHideable() ? "TRUE" : "FALSE");
 
-                            m_registeredApps.push_back(appDesc);
+                            indexApp(m_registeredApps,m_registeredAppsById,appDesc);
                             //LAUNCHER3-ADD:
                             Q_EMIT signalScanFoundApp(appDesc);
                             //--end
@@ -1545,44 +1669,19 @@ void ApplicationManager::scanApplicationsFolders(const std::string& appFoldersPa
 
 ApplicationDescription* ApplicationManager::scanOneApplicationFolder(const std::string& appFolderPath)
 {
-    // Do we have a locale setting
-    std::string locale = LocalePreferences::instance()->locale().toStdString();
-
-    // Look for the language/region specific appinfo.json
-
-    std::string language, region;
-    std::size_t underscorePos = locale.find("_");
-    if (underscorePos != std::string::npos) {
-        language = locale.substr(0, underscorePos);
-        region = locale.substr(underscorePos+1);
-    }
-    
-    std::string appJsonPath;
     ApplicationDescription* appDesc = 0;
 
-    if (!language.empty() && !region.empty()) {
-        appJsonPath = appFolderPath + "/resources/" + language + "/" + region +"/appinfo.json";
-        appDesc = ApplicationDescription::fromFile(appJsonPath, appFolderPath);
-    }
-    
-    if (!appDesc) {
-        // try the language-only one
-        appJsonPath = appFolderPath + "/resources/" + language + "/appinfo.json";
-        appDesc = ApplicationDescription::fromFile(appJsonPath, appFolderPath);
-    }
-
-    if (!appDesc) {
-        //try the old version
-        appJsonPath = appFolderPath + "/resources/" + locale + "/appinfo.json";
-        appDesc = ApplicationDescription::fromFile(appJsonPath, appFolderPath);
+    std::map<std::string,ApplicationDescription *>::iterator prefetch_it = m_prefetchedApps.find(appFolderPath);
+    if (prefetch_it != m_prefetchedApps.end()) {
+        //already parsed by the initial scan workers; its registrations are left for completeInitialScanRegistrations(),
+        //so nothing is registered for apps the scan ends up rejecting or discarding as duplicates
+        appDesc = prefetch_it->second;
+        m_prefetchedApps.erase(prefetch_it);
     }
-
-    if (!appDesc) {
-
-        // FIXME: AppId needs to be based on folder name (and not specified in appinfo.json)
-        // try the default one
-        appJsonPath = appFolderPath + "/appinfo.json";
-        appDesc = ApplicationDescription::fromFile(appJsonPath, appFolderPath);
+    else {
+        //during the initial scan, the apps the workers couldn't pre-parse (sysmgr builtins, mostly) leave their registrations
+        //to completeInitialScanRegistrations() too, so that the whole scan registers in scan order
+        appDesc = parseApplicationFolder(appFolderPath,LocalePreferences::instance()->locale().toStdString(),m_deferScanRegistrations,false);
     }
 
     if (!appDesc) {
@@ -1639,10 +1738,113 @@ ApplicationDescription* ApplicationManager::scanOneApplicationFolder(const std::
 
 PackageDescription* ApplicationManager::scanOnePackageFolder(const std::string& packageFolderPath)
 {
-    PackageDescription* packageDesc = NULL;
+    std::map<std::string,PackageDescription *>::iterator prefetch_it = m_prefetchedPackages.find(packageFolderPath);
+    if (prefetch_it != m_prefetchedPackages.end()) {
+        PackageDescription* packageDesc = prefetch_it->second;
+        m_prefetchedPackages.erase(prefetch_it);
+        return packageDesc;
+    }
 
-    // Do we have a locale setting
-    std::string locale = LocalePreferences::instance()->locale().toStdString();
+    return parsePackageFolder(packageFolderPath,LocalePreferences::instance()->locale().toStdString());
+}
+
+ServiceDescription* ApplicationManager::scanOneServiceFolder(const std::string& serviceFolderPath)
+{
+    ServiceDescription* serviceDesc = NULL;
+
+    std::map<std::string,ServiceDescription *>::iterator prefetch_it = m_prefetchedServices.find(serviceFolderPath);
+    if (prefetch_it != m_prefetchedServices.end()) {
+        serviceDesc = prefetch_it->second;
+        m_prefetchedServices.erase(prefetch_it);
+        return serviceDesc;
+    }
+
+    return parseServiceFolder(serviceFolderPath);
+}
+
+//must be called straight after the parse, before anything adjusts appDesc
+static void recordApplicationSource(const std::string& appFolderPath,const std::string& appJsonPath,const RegistrySnapshot::SourceStamps& stamps,const ApplicationDescription* appDesc)
+{
+    std::string snapshot;
+    //sysmgr builtins are only half-parsed when deferred, and a registered app no longer has its mime registrations to hand
+    if (appDesc->isRegistrationDeferred() && appDesc->type() != ApplicationDescription::Type_SysmgrBuiltin)
+        snapshot = appDesc->toSnapshotString();
+    RegistrySnapshot::instance()->recordSource(appFolderPath,appJsonPath,stamps,snapshot);
+}
+
+//stamps appJsonPath for the RegistrySnapshot before reading it
+static ApplicationDescription* parseApplicationJson(const std::string& appJsonPath,const std::string& appFolderPath,bool deferRegistration,bool offMainThread,RegistrySnapshot::SourceStamps& r_stamps)
+{
+    RegistrySnapshot::stampJson(appJsonPath,r_stamps);
+    return ApplicationDescription::fromFile(appJsonPath, appFolderPath, deferRegistration, offMainThread);
+}
+
+static ApplicationDescription* parseApplicationFolder(const std::string& appFolderPath,const std::string& locale,bool deferRegistration,bool offMainThread)
+{
+    // Look for the language/region specific appinfo.json
+
+    std::string language, region;
+    std::size_t underscorePos = locale.find("_");
+    if (underscorePos != std::string::npos) {
+        language = locale.substr(0, underscorePos);
+        region = locale.substr(underscorePos+1);
+    }
+
+    std::string appJsonPath;
+    ApplicationDescription* appDesc = 0;
+
+    //if the folder is unchanged since the last scan, reuse what was parsed then, or at least go straight to the appinfo.json
+    //it was read from. Snapshotted descriptions carry their mime registrations unregistered, so they only stand in for deferred parses
+    std::string snapshot;
+    RegistrySnapshot::SourceStamps stamps;
+    if (RegistrySnapshot::instance()->lookupSource(appFolderPath,appJsonPath,snapshot,stamps)) {
+        if (deferRegistration && !snapshot.empty())
+            appDesc = ApplicationDescription::fromSnapshotString(snapshot);
+        if (appDesc) {
+            RegistrySnapshot::instance()->recordSource(appFolderPath,appJsonPath,stamps,snapshot);
+            return appDesc;
+        }
+        appDesc = ApplicationDescription::fromFile(appJsonPath, appFolderPath, deferRegistration, offMainThread);		//stamped by lookupSource()
+        if (appDesc) {
+            recordApplicationSource(appFolderPath,appJsonPath,stamps,appDesc);
+            return appDesc;
+        }
+    }
+
+    if (!language.empty() && !region.empty()) {
+        appJsonPath = appFolderPath + "/resources/" + language + "/" + region +"/appinfo.json";
+        appDesc = parseApplicationJson(appJsonPath, appFolderPath, deferRegistration, offMainThread, stamps);
+    }
+
+    if (!appDesc) {
+        // try the language-only one
+        appJsonPath = appFolderPath + "/resources/" + language + "/appinfo.json";
+        appDesc = parseApplicationJson(appJsonPath, appFolderPath, deferRegistration, offMainThread, stamps);
+    }
+
+    if (!appDesc) {
+        //try the old version
+        appJsonPath = appFolderPath + "/resources/" + locale + "/appinfo.json";
+        appDesc = parseApplicationJson(appJsonPath, appFolderPath, deferRegistration, offMainThread, stamps);
+    }
+
+    if (!appDesc) {
+
+        // FIXME: AppId needs to be based on folder name (and not specified in appinfo.json)
+        // try the default one
+        appJsonPath = appFolderPath + "/appinfo.json";
+        appDesc = parseApplicationJson(appJsonPath, appFolderPath, deferRegistration, offMainThread, stamps);
+    }
+
+    if (appDesc)
+        recordApplicationSource(appFolderPath,appJsonPath,stamps,appDesc);
+
+    return appDesc;
+}
+
+static PackageDescription* parsePackageFolder(const std::string& packageFolderPath,const std::string& locale)
+{
+    PackageDescription* packageDesc = NULL;
 
     // Look for the language/region specific appinfo.json
 
@@ -1655,20 +1857,33 @@ PackageDescription* ApplicationManager::scanOnePackageFolder(const std::string&
 
     std::string packageJsonPath;
 
+    std::string unused;
+    RegistrySnapshot::SourceStamps stamps;
+    if (RegistrySnapshot::instance()->lookupSource(packageFolderPath,packageJsonPath,unused,stamps)) {
+        packageDesc = PackageDescription::fromFile(packageJsonPath, packageFolderPath);
+        if (packageDesc) {
+            RegistrySnapshot::instance()->recordSource(packageFolderPath,packageJsonPath,stamps,std::string());
+            return packageDesc;
+        }
+    }
+
     if (!language.empty() && !region.empty()) {
         packageJsonPath = packageFolderPath + "/resources/" + language + "/" + region +"/packageinfo.json";
+        RegistrySnapshot::stampJson(packageJsonPath,stamps);
         packageDesc = PackageDescription::fromFile(packageJsonPath, packageFolderPath);
     }
 
     if (!packageDesc) {
         // try the language-only one
         packageJsonPath = packageFolderPath + "/resources/" + language + "/packageinfo.json";
+        RegistrySnapshot::stampJson(packageJsonPath,stamps);
         packageDesc = PackageDescription::fromFile(packageJsonPath, packageFolderPath);
     }
 
     if (!packageDesc) {
         //try the old version
         packageJsonPath = packageFolderPath + "/resources/" + locale + "/packageinfo.json";
+        RegistrySnapshot::stampJson(packageJsonPath,stamps);
         packageDesc = PackageDescription::fromFile(packageJsonPath, packageFolderPath);
     }
 
@@ -1676,22 +1891,231 @@ PackageDescription* ApplicationManager::scanOnePackageFolder(const std::string&
         // FIXME: AppId needs to be based on folder name (and not specified in appinfo.json)
         // try the default one
         packageJsonPath = packageFolderPath + "/packageinfo.json";
+        RegistrySnapshot::stampJson(packageJsonPath,stamps);
         packageDesc = PackageDescription::fromFile(packageJsonPath, packageFolderPath);
     }
+
+    if (packageDesc)
+        RegistrySnapshot::instance()->recordSource(packageFolderPath,packageJsonPath,stamps,std::string());
+
     return packageDesc;
 }
 
-ServiceDescription* ApplicationManager::scanOneServiceFolder(const std::string& serviceFolderPath)
+static ServiceDescription* parseServiceFolder(const std::string& serviceFolderPath)
 {
-    ServiceDescription* serviceDesc = NULL;
-
     //TODO: localize it!
     std::string serviceJsonPath = serviceFolderPath + "/services.json";
+    ServiceDescription* serviceDesc = NULL;
+
+    std::string snapshot;
+    RegistrySnapshot::SourceStamps stamps;
+    if (RegistrySnapshot::instance()->lookupSource(serviceFolderPath,serviceJsonPath,snapshot,stamps) && !snapshot.empty()) {
+        serviceDesc = ServiceDescription::fromSnapshotString(snapshot);
+        if (serviceDesc) {
+            RegistrySnapshot::instance()->recordSource(serviceFolderPath,serviceJsonPath,stamps,snapshot);
+            return serviceDesc;
+        }
+    }
+
+    RegistrySnapshot::stampJson(serviceJsonPath,stamps);
     serviceDesc = ServiceDescription::fromFile(serviceJsonPath);
+    if (serviceDesc)
+        RegistrySnapshot::instance()->recordSource(serviceFolderPath,serviceJsonPath,stamps,serviceDesc->toSnapshotString());
 
     return serviceDesc;
 }
 
+static uint64_t monotonicTimeMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+namespace {
+
+struct ScanPrefetchJob {
+
+    enum Kind {
+        App = 0,
+        Package,
+        Service
+    };
+
+    ScanPrefetchJob(Kind k,const std::string& path)
+    : kind(k), folderPath(path), appDesc(0), packageDesc(0), serviceDesc(0) {}
+
+    Kind kind;
+    std::string folderPath;
+    ApplicationDescription* appDesc;
+    PackageDescription* packageDesc;
+    ServiceDescription* serviceDesc;
+};
+
+}
+
+//runs on a scan worker thread: no registry, MimeSystem or QObject access in here
+static void scanPrefetchWorkerFn(gpointer data,gpointer userData)
+{
+    ScanPrefetchJob* job = static_cast<ScanPrefetchJob*>(data);
+    const std::string* locale = static_cast<const std::string*>(userData);
+
+    struct stat stBuf;
+    if (::stat(job->folderPath.c_str(), &stBuf) != 0 || !(stBuf.st_mode & S_IFDIR))
+        return;
+
+    switch (job->kind) {
+    case ScanPrefetchJob::App:
+        job->appDesc = parseApplicationFolder(job->folderPath,*locale,true,true);
+        if (job->appDesc && job->appDesc->type() == ApplicationDescription::Type_SysmgrBuiltin) {
+            //needs the main thread to set up; leave it to the serial scan
+            delete job->appDesc;
+            job->appDesc = 0;
+        }
+        break;
+    case ScanPrefetchJob::Package:
+        job->packageDesc = parsePackageFolder(job->folderPath,*locale);
+        break;
+    case ScanPrefetchJob::Service:
+        job->serviceDesc = parseServiceFolder(job->folderPath);
+        break;
+    }
+}
+
+//queues a job for every (non-hidden) entry of folder. folder must end in '/', matching how the scanFor*() functions build paths
+static void queueScanPrefetchJobs(const std::string& folder,ScanPrefetchJob::Kind kind,std::vector<ScanPrefetchJob*>& jobs)
+{
+    struct dirent** list = NULL;
+    int count = ::scandir(folder.c_str(), &list, 0, 0);
+    if (count < 0)
+        return;
+
+    for (int i = 0; i < count; i++) {
+        if (list[i]) {
+            if (list[i]->d_name[0] != '.')
+                jobs.push_back(new ScanPrefetchJob(kind,folder + list[i]->d_name));
+            free(list[i]);
+        }
+    }
+
+    if (list)
+        free(list);
+}
+
+void ApplicationManager::prefetchInitialScan()
+{
+    MutexLocker locker(&m_mutex);
+
+    std::vector<ScanPrefetchJob*> jobs;
+    std::string folder;
+
+    //system apps (see scanForSystemApplications())
+    folder = Settings::LunaSettings()->lunaAppLauncherPath;
+    if (folder[folder.size() - 1] != '/')
+        folder += '/';
+    jobs.push_back(new ScanPrefetchJob(ScanPrefetchJob::App,folder));
+    folder = Settings::LunaSettings()->lunaSystemPath;
+    if (folder[folder.size() - 1] != '/')
+        folder += '/';
+    jobs.push_back(new ScanPrefetchJob(ScanPrefetchJob::App,folder));
+
+    //apps (see scanForApplications())
+    for (std::vector<std::string>::const_iterator it = Settings::LunaSettings()->lunaAppsPaths.begin();
+         it != Settings::LunaSettings()->lunaAppsPaths.end(); ++it) {
+        folder = *it;
+        if (folder.empty())
+            continue;
+        if (folder[folder.size() - 1] != '/')
+            folder += "/";
+        queueScanPrefetchJobs(folder,ScanPrefetchJob::App,jobs);
+    }
+
+    //packages (see scanForPackages())
+    folder = Settings::LunaSettings()->packageInstallBase + std::string("/") + Settings::LunaSettings()->packageInstallRelative;
+    if (folder[folder.size() - 1] != '/')
+        folder += "/";
+    queueScanPrefetchJobs(folder,ScanPrefetchJob::Package,jobs);
+
+    //services (see scanForServices())
+    folder = Settings::LunaSettings()->serviceInstallBase + std::string("/") + Settings::LunaSettings()->serviceInstallRelative;
+    if (folder[folder.size() - 1] != '/')
+        folder += "/";
+    queueScanPrefetchJobs(folder,ScanPrefetchJob::Service,jobs);
+
+    //pending apps (see scanForPendingApplications())
+    folder = Settings::LunaSettings()->pendingAppsPath;
+    if (folder[folder.size() - 1] != '/')
+        folder += '/';
+    queueScanPrefetchJobs(folder,ScanPrefetchJob::App,jobs);
+
+    //the locale is read here, once; the workers must not touch LocalePreferences
+    std::string locale = LocalePreferences::instance()->locale().toStdString();
+
+    long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int numWorkers = std::max(2,std::min((int)numCpus,sMaxScanWorkers));
+
+    GError* gerr = NULL;
+    GThreadPool* pool = g_thread_pool_new(scanPrefetchWorkerFn,&locale,numWorkers,FALSE,&gerr);
+    if (!pool) {
+        g_warning("%s: unable to create the scan thread pool (%s); scanning serially", __FUNCTION__, (gerr ? gerr->message : "unknown error"));
+        if (gerr)
+            g_error_free(gerr);
+        for (std::vector<ScanPrefetchJob*>::iterator it = jobs.begin(); it != jobs.end(); ++it)
+            delete *it;
+        return;
+    }
+
+    for (std::vector<ScanPrefetchJob*>::iterator it = jobs.begin(); it != jobs.end(); ++it)
+        g_thread_pool_push(pool,*it,NULL);
+
+    //wait for all queued jobs to complete
+    g_thread_pool_free(pool,FALSE,TRUE);
+
+    for (std::vector<ScanPrefetchJob*>::iterator it = jobs.begin(); it != jobs.end(); ++it) {
+        ScanPrefetchJob* job = *it;
+        if (job->appDesc)
+            m_prefetchedApps[job->folderPath] = job->appDesc;
+        if (job->packageDesc)
+            m_prefetchedPackages[job->folderPath] = job->packageDesc;
+        if (job->serviceDesc)
+            m_prefetchedServices[job->folderPath] = job->serviceDesc;
+        delete job;
+    }
+
+    g_message("%s: pre-parsed %d apps, %d packages, %d services with %d workers (%d folders)", __FUNCTION__,
+              (int)m_prefetchedApps.size(), (int)m_prefetchedPackages.size(), (int)m_prefetchedServices.size(),
+              numWorkers, (int)jobs.size());
+}
+
+void ApplicationManager::completeInitialScanRegistrations()
+{
+    MutexLocker locker(&m_mutex);
+
+    //same order the scan found them in (and so the same handler precedence as registering them one by one)
+    std::vector<ApplicationDescription*> apps;
+    apps.insert(apps.end(),m_systemApps.begin(),m_systemApps.end());
+    apps.insert(apps.end(),m_registeredApps.begin(),m_registeredApps.end());
+    apps.insert(apps.end(),m_pendingApps.begin(),m_pendingApps.end());
+
+    ApplicationDescription::completeRegistrations(apps);
+}
+
+void ApplicationManager::dropInitialScanPrefetch()
+{
+    MutexLocker locker(&m_mutex);
+
+    //anything not picked up by the scan (e.g. a folder that went away in between) is discarded
+    for (std::map<std::string,ApplicationDescription *>::iterator it = m_prefetchedApps.begin(); it != m_prefetchedApps.end(); ++it)
+        delete it->second;
+    m_prefetchedApps.clear();
+    for (std::map<std::string,PackageDescription *>::iterator it = m_prefetchedPackages.begin(); it != m_prefetchedPackages.end(); ++it)
+        delete it->second;
+    m_prefetchedPackages.clear();
+    for (std::map<std::string,ServiceDescription *>::iterator it = m_prefetchedServices.begin(); it != m_prefetchedServices.end(); ++it)
+        delete it->second;
+    m_prefetchedServices.clear();
+}
+
 //TODO: Need a better mechanism to discover app changes.
 //         FULL new ApplicationDescription objects (icon and all!) for apps it finds on disk. This is also developer error-prone because:
 //        added:  this list gets the pointer to a NEW ApplicationDescriptor, which MUST BE DEALLOCATED in the caller (or above)
@@ -1757,6 +2181,73 @@ void ApplicationManager::discoverAppChanges(std::vector<ApplicationDescription *
     }
 }
 
+//same contract as above, but only looks at the given app folders (as reported by the AppFolderWatcher) instead of walking all of them
+void ApplicationManager::discoverAppChanges(const std::set<std::string>& changedFolders,std::vector<ApplicationDescription *>& added,std::vector<ApplicationDescription *>& removed,std::vector<ApplicationDescription *>& changed) {
+    //DANGER: temporal non-safety; apps may change state after the lists are generated. Call under proper locks
+
+    if (changedFolders.empty())
+        return;
+
+    //which registered app came from which folder
+    std::map<std::string,ApplicationDescription *> appsByFolder;
+    for (std::vector<ApplicationDescription *>::iterator it = m_registeredApps.begin(); it != m_registeredApps.end(); ++it) {
+        if (*it)
+            appsByFolder[(*it)->folderPath()] = *it;
+    }
+
+    std::set<ApplicationDescription *> removedSet;
+    for (std::set<std::string>::const_iterator folder_it = changedFolders.begin(); folder_it != changedFolders.end(); ++folder_it) {
+
+        const std::string& folderPath = *folder_it;
+        luna_log(sAppMgrChnl, "rescanning app folder %s", folderPath.c_str());
+
+        ApplicationDescription * pPrevAppDesc = NULL;
+        std::map<std::string,ApplicationDescription *>::iterator prev_it = appsByFolder.find(folderPath);
+        if (prev_it != appsByFolder.end())
+            pPrevAppDesc = prev_it->second;
+
+        ApplicationDescription * pAppDesc = NULL;
+        struct stat st;
+        if (::stat(folderPath.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+            pAppDesc = scanOneApplicationFolder(folderPath);
+
+        //whatever used to live in this folder and isn't there anymore, is gone
+        if (pPrevAppDesc && (!pAppDesc || pAppDesc->id() != pPrevAppDesc->id())) {
+            if (removedSet.insert(pPrevAppDesc).second)
+                removed.push_back(pPrevAppDesc);
+        }
+
+        if (!pAppDesc)
+            continue;
+
+        ApplicationDescription * pRegAppDesc = getAppById(pAppDesc->id(),m_registeredAppsById);
+        if (pRegAppDesc == NULL)
+            added.push_back(pAppDesc);
+        else if (pRegAppDesc->folderPath() != folderPath && removedSet.find(pRegAppDesc) == removedSet.end()) {
+            //same id as an app registered from another folder; the full walk keeps the first one found, and so do we
+            delete pAppDesc;
+        }
+        else if (pAppDesc->strictCompare(*pRegAppDesc) == false)
+            changed.push_back(pAppDesc);
+        else
+            delete pAppDesc;        //not needed...this represents unchanged app
+    }
+
+    if (!removedSet.empty()) {
+        //an app that went away may have been shadowing one with the same id in another folder (or another root), which
+        //has to come back now. Only the full walk resolves ids in the same order the initial scan did, so redo it that way
+        g_message("%s: %d apps went away; re-resolving all app folders", __FUNCTION__, (int)removedSet.size());
+        for (std::vector<ApplicationDescription *>::iterator it = added.begin(); it != added.end(); ++it)
+            delete *it;
+        for (std::vector<ApplicationDescription *>::iterator it = changed.begin(); it != changed.end(); ++it)
+            delete *it;
+        added.clear();
+        removed.clear();
+        changed.clear();
+        discoverAppChanges(added,removed,changed);
+    }
+}
+
 bool ApplicationManager::removePendingApp(const std::string& id)
 {
     MutexLocker locker(&m_mutex);
@@ -1767,8 +2258,9 @@ bool ApplicationManager::removePendingApp(const std::string& id)
         ApplicationDescription* appDesc = *it;
         if (appDesc->id() == id) {
             g_warning("%s: successfully removed '%s' from the set of pending applications", __PRETTY_FUNCTION__, id.c_str());
-            delete appDesc;
             m_pendingApps.erase(it);
+            unindexApp(m_pendingApps,m_pendingAppsById,appDesc);
+            delete appDesc;
             return true;
         }
     }
@@ -1798,7 +2290,7 @@ bool ApplicationManager::removePackage( const std::string& id,int cause)
         serviceInstallerUninstallApp(*serviceIdIt, sServiceInstallerTypeService, Settings::LunaSettings()->appInstallBase);
     }
 
-    m_registeredPackages.erase(id);
+    unregisterPackage(packageDesc);
     delete packageDesc;
 
     return true;
@@ -1815,12 +2307,15 @@ bool ApplicationManager::removeSysApp(const std::string& id)
         pAppDesc = *it;
         g_warning("%s",pAppDesc->id().c_str());
         if (pAppDesc->id() == id) {
+            it = m_registeredApps.erase(it);
+            unindexApp(m_registeredApps,m_registeredAppsById,pAppDesc);
             pAppDesc->launchPoints(launchPoints);
             for (LaunchPointList::iterator lpit = launchPoints.begin();lpit != launchPoints.end();lpit++) {
                 const LaunchPoint *pLpoint = *lpit;
                 if (pLpoint->isDefault()) {
                     postLaunchPointChange(pLpoint, "removed");
                     pAppDesc->removeLaunchPoint(pLpoint);
+                    invalidateLaunchPoints();
                 }
                 else {
                     std::string erc;
@@ -1855,6 +2350,7 @@ bool ApplicationManager::removeSysApp(const std::string& id)
         pAppDesc = *it;
         if (pAppDesc->id() == id) {
             m_pendingApps.erase(it);
+            unindexApp(m_pendingApps,m_pendingAppsById,pAppDesc);
             postLaunchPointChange(pAppDesc->getDefaultLaunchPoint(), "removed");
             ApplicationInstaller::instance()->notifyAppRemoved(pAppDesc->id(),pAppDesc->version(),0);
             delete pAppDesc;
@@ -1879,6 +2375,7 @@ bool ApplicationManager::removeApp( const std::string& appId,int cause)
             pAppDesc->executionLock();
             pAppDesc->flagForRemoval();    //not needed but it helps in debugging later, in case any of this fn fails
             it = m_registeredApps.erase(it);
+            unindexApp(m_registeredApps,m_registeredAppsById,pAppDesc);
 
             ApplicationProcessManager::instance()->killByAppId(pAppDesc->id());
 
@@ -1888,6 +2385,7 @@ bool ApplicationManager::removeApp( const std::string& appId,int cause)
                 if (pLpoint->isDefault()) {
                     postLaunchPointChange(pLpoint, "removed");
                     pAppDesc->removeLaunchPoint(pLpoint);
+                    invalidateLaunchPoints();
                 }
                 else {
                     std::string erc;
@@ -1922,6 +2420,7 @@ bool ApplicationManager::removeApp( const std::string& appId,int cause)
         pAppDesc = *it;
         if (pAppDesc->id() == appId) {
             m_pendingApps.erase(it);
+            unindexApp(m_pendingApps,m_pendingAppsById,pAppDesc);
             postLaunchPointChange(pAppDesc->getDefaultLaunchPoint(), "removed");
             ApplicationInstaller::instance()->notifyAppRemoved(pAppDesc->id(),pAppDesc->version(),cause);
             delete pAppDesc;
@@ -2060,35 +2559,29 @@ std::string ApplicationManager::addLaunchPoint(const std::string& id,
         appDesc->isRemoveFlagged())
         return "";
 
-    std::string launchPointFolder = Settings::LunaSettings()->lunaLaunchPointsPath;
-    if (!launchPointFolder.size()) {
+    if (!Settings::LunaSettings()->lunaLaunchPointsPath.size()) {
         luna_warn(sAppMgrChnl, "Launch Point Folder path not set");
         return "";
     }
 
-    if (launchPointFolder[launchPointFolder.size()-1] != '/')
-        launchPointFolder += "/";
-
-    // We need a unique filename
-    std::string lpId = findUniqueFileName(launchPointFolder);
-
-    launchPointFolder += lpId;
+    std::string lpId = LaunchPointJournal::instance()->allocateId();
 
     LaunchPoint* lp = new LaunchPoint(appDesc, id, lpId, title, menuName, icon, params,removable);
 
     json_object* json = lp->toJSON();
 
-    bool success = json_object_to_file((char*)launchPointFolder.c_str(), json) != -1;
+    bool success = LaunchPointJournal::instance()->put(lpId, json_object_to_json_string(json));
     if (json)
         json_object_put(json);
 
     if (!success) {
-        luna_warn(sAppMgrChnl, "Failed to write file: %s", launchPointFolder.c_str());
+        luna_warn(sAppMgrChnl, "Failed to persist launch point %s", lpId.c_str());
         delete lp;
         return "";
     }
 
     appDesc->addLaunchPoint(lp);
+    invalidateLaunchPoints();
 
     postLaunchPointChange(lp, "added");
 
@@ -2115,20 +2608,14 @@ bool ApplicationManager::removeLaunchPoint(const std::string& launchPointId,std:
         return false;
     }
 
-    std::string launchPointFolder = Settings::LunaSettings()->lunaLaunchPointsPath;
-    if (!launchPointFolder.size()) {
+    if (!Settings::LunaSettings()->lunaLaunchPointsPath.size()) {
         luna_warn(sAppMgrChnl, "Launch Point Folder path not set");
         extendedReturnCause = std::string("launch point folder not set");
         return false;
     }
 
-    if (launchPointFolder[launchPointFolder.size() - 1] != '/')
-        launchPointFolder += "/";
-
-    launchPointFolder += launchPointId;
-
-    // First delete the LP file
-    if (!deleteFile(launchPointFolder.c_str())) {
+    // First delete the LP from the journal
+    if (!LaunchPointJournal::instance()->remove(launchPointId)) {
         extendedReturnCause = std::string("launch point deletion failed");
         return false;
     }
@@ -2137,6 +2624,7 @@ bool ApplicationManager::removeLaunchPoint(const std::string& launchPointId,std:
 
     ApplicationDescription* appDesc = lp->appDesc();
     appDesc->removeLaunchPoint(lp);
+    invalidateLaunchPoints();
 
     return true;
 }
@@ -2157,42 +2645,6 @@ bool ApplicationManager::updateLaunchPointIcon(const std::string& launchPointId,
     return success;
 }
 
-std::string ApplicationManager::findUniqueFileName(const std::string& folder)
-{
-    static bool randSeeded = false;
-    if (!randSeeded) {
-
-        struct timeval tv;
-        gettimeofday(&tv, 0);
-
-        srand(tv.tv_sec * 1000000 + tv.tv_usec);
-        randSeeded = true;
-    }
-
-    const int len = 16;
-    char numStr[len];
-    int num;
-    std::string filePath;
-    struct stat stBuf;
-
-    while (true) {
-
-        // Random number between 1 and 1000000
-        num = 1 + (int) (1000000.0 * (rand() / (RAND_MAX + 1.0)));
-
-        snprintf(numStr, len, "%08d", num);
-
-        g_message("Checking file: %s", numStr);
-
-        filePath = folder + numStr;
-
-        if (stat(filePath.c_str(), &stBuf) == 0)
-            continue; // File exists
-
-        return std::string(numStr);
-    }
-}
-
 bool ApplicationManager::isNumber(const std::string& str) const
 {
     if (str.empty())
@@ -2293,19 +2745,66 @@ std::string ApplicationManager::getContentType(const std::string& mime)
  *
  * @see http://en.wikipedia.org/wiki/MIME
  */
+#ifdef USE_LIBMAGIC
+//one magic session for the life of the process (magic_load() reads the whole database), and the results for recently sniffed
+//files, keyed by (device, inode, mtime, size) so a changed file is simply a different key. A magic_t can't be used by two
+//threads at once, so everything here is under s_magicMutex; callers may be on any thread
+static Mutex s_magicMutex;
+static magic_t s_magicCookie = 0;
+static bool s_magicLoadFailed = false;
+static const size_t s_magicCacheSize = 128;
+static std::map<std::string,std::pair<std::string,std::list<std::string>::iterator> > s_magicCache;
+static std::list<std::string> s_magicCacheLru;        //most recently used first
+#endif
+
 std::string ApplicationManager::deriveMimeTypeFromFileMagic( const std::string& localFilePath )
 {
     std::string    mime;
 #ifdef USE_LIBMAGIC
     if (!localFilePath.empty()) {
-        magic_t cookie = ::magic_open(MAGIC_MIME);
-        if (cookie) {
-            magic_load(cookie, NULL);
-            const char* pszMime = magic_file(cookie, localFilePath.c_str());
-            if (NULL != pszMime) {
-                mime = pszMime;
+        std::string key;
+        struct stat stBuf;
+        if (::stat(localFilePath.c_str(), &stBuf) == 0) {
+            gchar* keyStr = g_strdup_printf("%llu|%llu|%lld|%lld", (unsigned long long)stBuf.st_dev, (unsigned long long)stBuf.st_ino,
+                                            (long long)stBuf.st_mtime, (long long)stBuf.st_size);
+            key = keyStr;
+            g_free(keyStr);
+        }
+
+        MutexLocker locker(&s_magicMutex);
+
+        if (!key.empty()) {
+            std::map<std::string,std::pair<std::string,std::list<std::string>::iterator> >::iterator it = s_magicCache.find(key);
+            if (it != s_magicCache.end()) {
+                s_magicCacheLru.splice(s_magicCacheLru.begin(), s_magicCacheLru, it->second.second);
+                return it->second.first;
+            }
+        }
+
+        if (!s_magicCookie && !s_magicLoadFailed) {
+            s_magicCookie = ::magic_open(MAGIC_MIME);
+            if (s_magicCookie && magic_load(s_magicCookie, NULL) != 0) {
+                g_warning("%s: unable to load the magic database: %s", __FUNCTION__, magic_error(s_magicCookie));
+                magic_close(s_magicCookie);
+                s_magicCookie = 0;
+            }
+            s_magicLoadFailed = (s_magicCookie == 0);
+        }
+        if (!s_magicCookie)
+            return mime;
+
+        const char* pszMime = magic_file(s_magicCookie, localFilePath.c_str());
+        if (NULL != pszMime) {
+            mime = pszMime;
+        }
+
+        if (!key.empty()) {
+            s_magicCacheLru.push_front(key);
+            s_magicCache[key] = std::make_pair(mime, s_magicCacheLru.begin());
+            if (s_magicCacheLru.size() > s_magicCacheSize) {
+                s_magicCache.erase(s_magicCacheLru.back());
+                s_magicCacheLru.pop_back();
             }
-            magic_close(cookie);
         }
     }
 #endif
@@ -2317,8 +2816,24 @@ bool cmptitle::operator()(const LaunchPoint* lp1, const LaunchPoint* lp2) const
     return lp1->compareByKeys(lp2) < 0;
 }
 
+//adds lp to r_matches, keeping only the first 'limit' launch points in cmptitle order (0 = no limit)
+static void addSearchMatch(SearchSet& r_matches, const LaunchPoint* lp, unsigned int limit)
+{
+    if (limit && r_matches.size() >= limit && !cmptitle()(lp, *(r_matches.rbegin())))
+        return;
+
+    r_matches.insert(lp);
+    if (limit && r_matches.size() > limit)
+        r_matches.erase(--r_matches.end());
+}
+
+static bool isSearchable(const LaunchPoint* lp)
+{
+    return lp && lp->appDesc() && !lp->appDesc()->isRemoveFlagged();
+}
+
 void ApplicationManager::searchLaunchPoints(SearchSet& matchedByTitle, SearchSet& matchedByKeyword,
-        const std::string& searchTerm) const
+        const std::string& searchTerm, unsigned int limit)
         {
     if (searchTerm.empty())
         return;
@@ -2326,62 +2841,43 @@ void ApplicationManager::searchLaunchPoints(SearchSet& matchedByTitle, SearchSet
     matchedByTitle.clear();
     matchedByKeyword.clear();
 
-    std::vector<ApplicationDescription*>::const_iterator appDescIt = m_registeredApps.begin();
-    std::vector<ApplicationDescription*>::const_iterator appDescEndIt = m_registeredApps.end();
-
-    gchar* lcSearchTerm = g_utf8_strdown(searchTerm.c_str(), -1);
-
-    for (; appDescIt != appDescEndIt; ++appDescIt) {
+    MutexLocker locker(&m_mutex);
 
-        ApplicationDescription* appDesc = *appDescIt;
-        if (!appDesc)
-            continue;
+    refreshLaunchPointIndex();
 
-        if (!appDesc->isVisible() || appDesc->isRemoveFlagged())
-            continue;
-
-        if (!hardwareFeaturesRequirementSatisfied(appDesc->hardwareFeaturesNeeded()))
-            continue;
+    gchar* lcSearchTerm = g_utf8_strdown(searchTerm.c_str(), -1);
+    std::string term(lcSearchTerm);
+    g_free(lcSearchTerm);
 
-        LaunchPointList::const_iterator lpIt = appDesc->launchPoints().begin();
-        LaunchPointList::const_iterator lpEndIt = appDesc->launchPoints().end();
+    SearchTokenTable::const_iterator it;
 
-        for (; lpIt != lpEndIt; ++lpIt) {
+    for (it = std::lower_bound(m_titleSearchTokens.begin(), m_titleSearchTokens.end(), SearchToken(term));
+         it != m_titleSearchTokens.end() && it->text.compare(0, term.size(), term) == 0; ++it) {
+        if (isSearchable(it->lp))
+            addSearchMatch(matchedByTitle, it->lp, limit);
+    }
 
-            bool foundMatch = false;
-            const LaunchPoint* lp = *lpIt;
-            if (!lp)
-                continue;
+    if (limit && matchedByTitle.size() >= limit)
+        return;
 
-            if (lp->matchesTitle(lcSearchTerm)) {
-                g_message("found match by title: %s", lp->title().c_str());
-                matchedByTitle.insert(lp);
-            }
-            else if (lp->isDefault() && !foundMatch) {
-                // whole/partial keyword starts with search term?
-                if (searchTerm.size() >= 3 && Settings::LunaSettings()->usePartialKeywordAppSearch) {
-                    foundMatch = appDesc->doesMatchKeywordPartial(lcSearchTerm);
-                }
-                else {
-                    foundMatch  = appDesc->doesMatchKeywordExact(lcSearchTerm);
-                }
-                // menu name starts with search term?
-                if (!foundMatch) {
-                    gchar* lcMenuName = g_utf8_strdown(appDesc->menuName().c_str(), -1);
-                    foundMatch = g_str_has_prefix(lcMenuName, lcSearchTerm);
-                    g_free(lcMenuName);
-                }
+    unsigned int keywordLimit = limit ? (limit - matchedByTitle.size()) : 0;
 
-                if (foundMatch) {
-                    g_message("found match by keyword/appmenu: %s", lp->title().c_str());
-                    matchedByKeyword.insert(lp);
-                }
-            }
-        }
+    // whole/partial keyword starts with search term?
+    bool partialKeywords = searchTerm.size() >= 3 && Settings::LunaSettings()->usePartialKeywordAppSearch;
+    for (it = std::lower_bound(m_keywordSearchTokens.begin(), m_keywordSearchTokens.end(), SearchToken(term));
+         it != m_keywordSearchTokens.end() && it->text.compare(0, term.size(), term) == 0; ++it) {
+        if (!partialKeywords && it->text.size() != term.size())
+            continue;
+        if (isSearchable(it->lp) && matchedByTitle.find(it->lp) == matchedByTitle.end())
+            addSearchMatch(matchedByKeyword, it->lp, keywordLimit);
     }
 
-    if (lcSearchTerm)
-        g_free(lcSearchTerm);
+    // menu name starts with search term?
+    for (it = std::lower_bound(m_menuNameSearchTokens.begin(), m_menuNameSearchTokens.end(), SearchToken(term));
+         it != m_menuNameSearchTokens.end() && it->text.compare(0, term.size(), term) == 0; ++it) {
+        if (isSearchable(it->lp) && matchedByTitle.find(it->lp) == matchedByTitle.end())
+            addSearchMatch(matchedByKeyword, it->lp, keywordLimit);
+    }
 }
 
 std::string    ApplicationManager::mimeTableAsJsonString()
@@ -2529,6 +3025,7 @@ void ApplicationManager::handleApplicationStatusUpdates(LSMessage* msg)
                         if (appDesc) {
                             // update status
                             appDesc->update(appStatus, appExists);
+                            invalidateLaunchPoints();		//title, icon and progress may all have changed
                             QBitArray statusBits = QBitArray(LaunchPointUpdatedReason::SIZEOF);
                             statusBits.setBit(LaunchPointUpdatedReason::Status);
                             statusBits.setBit(LaunchPointUpdatedReason::Icon);
@@ -2539,7 +3036,7 @@ void ApplicationManager::handleApplicationStatusUpdates(LSMessage* msg)
                             appDesc = ApplicationDescription::fromApplicationStatus(appStatus, appExists);
                             if (appDesc)
                             {
-                                m_pendingApps.push_back(appDesc);
+                                indexApp(m_pendingApps,m_pendingAppsById,appDesc);
                             }
                         }
                     }
@@ -2585,6 +3082,7 @@ void ApplicationManager::handleApplicationStatusUpdates(LSMessage* msg)
                 // update status
                 g_debug("%s [INSTALLER]: ApplicationStatus State = %d - updating status of an installing app", __FUNCTION__,(int)(appStatus.state));
                 appDesc->update(appStatus, appExists);
+                invalidateLaunchPoints();		//title, icon and progress may all have changed
                 QBitArray statusBits = QBitArray(LaunchPointUpdatedReason::SIZEOF);
                 statusBits.setBit(LaunchPointUpdatedReason::Status);
                 statusBits.setBit(LaunchPointUpdatedReason::Progress);
@@ -2594,7 +3092,7 @@ void ApplicationManager::handleApplicationStatusUpdates(LSMessage* msg)
                 appDesc = ApplicationDescription::fromApplicationStatus(appStatus, appExists);
                 if (appDesc) {
                     g_debug("%s [INSTALLER]: ApplicationStatus State = %d - initial status of an installing app", __FUNCTION__,(int)(appStatus.state));
-                    m_pendingApps.push_back(appDesc);
+                    indexApp(m_pendingApps,m_pendingAppsById,appDesc);
                     QBitArray statusBits = QBitArray(LaunchPointAddedReason::SIZEOF);
                     statusBits.setBit(LaunchPointAddedReason::InstallerStatusUpdate);
                     Q_EMIT signalLaunchPointAdded(appDesc->getDefaultLaunchPoint(),statusBits);
@@ -44,6 +44,7 @@ class LaunchPoint;
 class CommandHandler;
 class ResourceHandler;
 class RedirectHandler;
+class AppFolderWatcher;
 
 //LAUNCHER3-ADDED:
 namespace LaunchPointUpdatedReason
@@ -123,7 +124,8 @@ public:
 	bool getAppsByPackageId(const std::string& packageId, std::vector<ApplicationDescription *>& r_apps);
 	bool getServicesByPackageId(const std::string& packageId, std::vector<ServiceDescription *>& r_services);
 
-	void searchLaunchPoints(SearchSet& matchedByTitle, SearchSet& matchedByKeyword, const std::string& searchTerm) const;
+	//limit > 0 returns at most that many launch points in total (title matches first), in cmptitle order
+	void searchLaunchPoints(SearchSet& matchedByTitle, SearchSet& matchedByKeyword, const std::string& searchTerm, unsigned int limit = 0);
 
 	bool 					removePendingApp(const std::string& id);
 	bool                    removePackage(const std::string& id,int cause);
@@ -210,6 +212,9 @@ public:
 	void postApplicationHasBeenTerminated(const std::string& title, const std::string& menuname, const std::string& id);
 
 	LSHandle* getServiceHandle() { return m_service; }
+
+	//subscription key of the launchPointChanges subscribers that asked for batched changes
+	static const char* s_launchPointChangesBatchKey;
 Q_SIGNALS:
 
 	//LAUNCHER3-ADD: (modified)
@@ -245,12 +250,20 @@ private:
 	void scanForSystemApplications();
 	void scanForPendingApplications();
 	void scanForLaunchPoints(std::string launchPointFolder);
+	void addScannedLaunchPoint(LaunchPoint* launchPoint,bool forceNonRemovable);
 	void scanApplicationsFolders(const std::string& appFolders);
 	void scanApplicationsFolders(const std::string& appFoldersPath,std::map<std::string,ApplicationDescription *>& foundApps);
 	ApplicationDescription* scanOneApplicationFolder(const std::string& appFolderPath);
 	PackageDescription* scanOnePackageFolder(const std::string& packageFolderPath);
 	ServiceDescription* scanOneServiceFolder(const std::string& serviceFolderPath);
 
+	//parses every app/package/service folder of the initial scan on a worker pool ahead of time; the regular (serial) scanFor*()
+	//functions then pick up the pre-parsed descriptions through scanOne*Folder() so all precedence rules stay where they are
+	void prefetchInitialScan();
+	void dropInitialScanPrefetch();
+	//the pre-parsed apps' mime registrations wait until the scan has settled which apps are kept, and are then done in one batch
+	void completeInitialScanRegistrations();
+
 	ApplicationDescription* installApp(const std::string& appId);
 	ApplicationDescription* installSysApp(const std::string& appId);
 	bool                    removeApp(const std::string& id,int cause);
@@ -258,13 +271,30 @@ private:
 
 	//discoverAppChanges: temporal non-safety; apps may change state after the lists are generated. Call under proper locks
 	void discoverAppChanges(std::vector<ApplicationDescription *>& added,std::vector<ApplicationDescription *>& removed,std::vector<ApplicationDescription *>& changed);
+	void discoverAppChanges(const std::set<std::string>& changedFolders,std::vector<ApplicationDescription *>& added,std::vector<ApplicationDescription *>& removed,std::vector<ApplicationDescription *>& changed);
 
 	ApplicationDescription* getAppById( const std::string& appId,const std::map<std::string,ApplicationDescription *>& appMap);
 
+	typedef std::map<std::string,ApplicationDescription *> AppIdIndex;
+
+	//indexApp/unindexApp keep the by-id indexes below in sync with their app lists. Call under m_mutex
+	void indexApp(std::vector<ApplicationDescription*>& appList,AppIdIndex& index,ApplicationDescription* appDesc);
+	void unindexApp(const std::vector<ApplicationDescription*>& appList,AppIdIndex& index,ApplicationDescription* appDesc);
+
+	//registerPackage/unregisterPackage maintain m_registeredPackages together with the app/service id -> package indexes
+	void registerPackage(PackageDescription* packageDesc);
+	void unregisterPackage(PackageDescription* packageDesc);
+
+	//getLaunchPointById() and all(Pending)LaunchPoints() are served from an id index and cached visible lists. They are
+	//rebuilt on first use after invalidateLaunchPoints() has bumped the generation; call it whenever apps or launch points
+	//are added, removed or updated
+	void invalidateLaunchPoints();
+	void refreshLaunchPointIndex();
+	void addSearchTokens(const LaunchPoint* lp);
+
 	void scanFolderResursively( const std::string& path );
 	void clear();
 	void dumpStats();
-	std::string findUniqueFileName(const std::string& folder);
 	bool isNumber(const std::string& str) const;
 	static bool isValidMimeType( const std::string& mime );
 	static bool isGenericMimeType( const std::string& mime );
@@ -292,9 +322,47 @@ private:
 	std::vector<ApplicationDescription*> m_systemApps;
 	std::vector<ApplicationDescription*> m_pendingApps;
 
+	// by-id lookup indexes for the three lists above. The vectors keep the scan order (which is what gets reported
+	// to the launcher); the indexes are what getAppById() and friends use
+	AppIdIndex m_registeredAppsById;
+	AppIdIndex m_systemAppsById;
+	AppIdIndex m_pendingAppsById;
+
+	//initial scan prefetch results, keyed by the folder path scanOne*Folder() will be called with
+	std::map<std::string,ApplicationDescription *> m_prefetchedApps;
+	std::map<std::string,PackageDescription *> m_prefetchedPackages;
+	std::map<std::string,ServiceDescription *> m_prefetchedServices;
+	//set while the initial scan merges; apps parsed then (prefetched or not) register in completeInitialScanRegistrations()
+	bool m_deferScanRegistrations;
+
+	//tracks which app folders changed between rescans; started once the initial scan is done
+	AppFolderWatcher* m_appFolderWatcher;
+
+	typedef std::map<std::string,const LaunchPoint *> LaunchPointIdIndex;
+	LaunchPointIdIndex m_launchPointsById;				//launch points of registered apps
+	LaunchPointIdIndex m_pendingLaunchPointsById;		//launch points of pending apps
+	LaunchPointCollection m_visibleLaunchPoints;
+	LaunchPointCollection m_visiblePendingLaunchPoints;
+	uint32_t m_launchPointGeneration;
+	uint32_t m_launchPointIndexGeneration;
+
+	//searchLaunchPoints() prefix tables over the visible launch points, sorted by (lowercased) text; rebuilt with the index above
+	struct SearchToken {
+		SearchToken(const std::string& t,const LaunchPoint* l = 0) : text(t), lp(l) {}
+		bool operator<(const SearchToken& c) const { return text < c.text; }
+		std::string text;
+		const LaunchPoint* lp;
+	};
+	typedef std::vector<SearchToken> SearchTokenTable;
+	SearchTokenTable m_titleSearchTokens;
+	SearchTokenTable m_keywordSearchTokens;
+	SearchTokenTable m_menuNameSearchTokens;
+
 	std::set<const LaunchPoint*> m_dockModeLaunchPoints;
 
 	std::map<std::string, PackageDescription*> m_registeredPackages;
+	std::map<std::string, PackageDescription*> m_packagesByAppId;			//reverse index: app id -> owning package
+	std::map<std::string, PackageDescription*> m_packagesByServiceId;		//reverse index: service id -> owning package
 	std::map<std::string, ServiceDescription*> m_registeredServices;
 
 	Mutex m_mutex;
@@ -302,6 +370,22 @@ private:
 	bool	startService();
 	void	stopService();
 	void    postLaunchPointChange(const LaunchPoint* lp, const std::string& change);
+
+	//launchPointChanges subscribers that asked for "batch" get the queued changes as one array, either after a short
+	//window or when the outermost begin/endLaunchPointBatch() pair (e.g. a rescan) ends
+	struct QueuedLaunchPointChange {
+		std::string change;			//net change; empty if it cancelled out
+		json_object* json;
+	};
+	void    queueLaunchPointChange(const std::string& launchPointId, const std::string& change, json_object* json);
+	void    beginLaunchPointBatch();
+	void    endLaunchPointBatch();
+	void    flushLaunchPointChanges();
+	static gboolean cbFlushLaunchPointChanges(gpointer data);
+	std::vector<QueuedLaunchPointChange> m_queuedLaunchPointChanges;
+	std::map<std::string,size_t> m_queuedLaunchPointChangesById;
+	int m_launchPointBatchDepth;
+	guint m_launchPointBatchTimer;
 	LSHandle*	m_service;
 	static long s_ticketId;
 	bool m_initialScan;
@@ -26,6 +26,7 @@
 #include "HostBase.h"
 #include "JSONUtils.h"
 #include "MimeSystem.h"
+#include "MutexLocker.h"
 #include "PackageDescription.h"
 #include "ServiceDescription.h"
 #include "Settings.h"
@@ -1924,7 +1925,7 @@ static bool servicecallback_getSizeOf(LSHandle* lshandle, LSMessage *message,
 	array_list* appIdArray = 0;
 	std::string appId;
 	std::string errorText;
-	std::vector<std::pair<std::string,uint32_t> > sizes;
+	std::vector<std::pair<std::string,std::string> > packageIds;		// (appId as asked for, package it's measured by)
 	bool includeDbSize = true;
 
     // {"includeDbSize": bool, "appIds": array}
@@ -1964,10 +1965,7 @@ static bool servicecallback_getSizeOf(LSHandle* lshandle, LSMessage *message,
 				errorText = "Could not find the PackageDescription for the appId";
 				goto Done_servicecallback_getSizeOf;
 			}
-			uint32_t s = ApplicationInstaller::getSizeOfPackageById(packageDesc->id());
-			if (includeDbSize && s > 0)
-				s += APPINFO_SIZEOF_APPDB;
-			sizes.push_back(std::pair<std::string,uint32_t>(appId,s));
+			packageIds.push_back(std::pair<std::string,std::string>(appId,packageDesc->id()));
 		}
 	}
 	else {
@@ -1985,12 +1983,8 @@ static bool servicecallback_getSizeOf(LSHandle* lshandle, LSMessage *message,
 		for (int i = 0; i < array_list_length(appIdArray); i++) {
 			json_object* obj = (json_object*) array_list_get_idx(appIdArray, i);
 			appId = json_object_get_string(obj);
-			if (appId.length()) {
-				uint32_t s = ApplicationInstaller::getSizeOfPackageById(appId);
-				if (includeDbSize && s > 0)
-					s += APPINFO_SIZEOF_APPDB;
-				sizes.push_back(std::pair<std::string,uint32_t>(appId,s));
-			}
+			if (appId.length())
+				packageIds.push_back(std::pair<std::string,std::string>(appId,appId));
 		}
 	}
 	
@@ -1999,19 +1993,16 @@ static bool servicecallback_getSizeOf(LSHandle* lshandle, LSMessage *message,
 	if (root)
 		json_object_put(root);
 
+	if (errorText.empty()) {
+		//packages that were never measured are walked on the installer's worker threads; it replies when they're done
+		ApplicationInstaller::instance()->getPackageSizes(lshandle,message,packageIds,includeDbSize ? APPINFO_SIZEOF_APPDB : 0);
+		return true;
+	}
+
 	json_object * reply = json_object_new_object();
 	json_object_object_add(reply, "subscribed", json_object_new_boolean(false));
-	if (errorText.size() > 0) {
-		json_object_object_add(reply, "returnValue", json_object_new_boolean(false));
-		json_object_object_add(reply, "errorCode", json_object_new_string(errorText.c_str()));
-	}
-	else {
-		json_object_object_add(reply, "returnValue", json_object_new_boolean(true));
-		for (std::vector<std::pair<std::string,uint32_t> >::iterator it = sizes.begin();it != sizes.end();++it) 
-		{
-			json_object_object_add(reply,(char*)(*it).first.c_str(),json_object_new_int((*it).second));
-		}
-	}
+	json_object_object_add(reply, "returnValue", json_object_new_boolean(false));
+	json_object_object_add(reply, "errorCode", json_object_new_string(errorText.c_str()));
 
 	if (!LSMessageReply(lshandle, message, json_object_to_json_string(reply), &lserror))
 		LSErrorFree (&lserror);
@@ -2037,11 +2028,13 @@ of each app.
 \subsection com_palm_application_manager_search_apps_syntax Syntax:
 \code
 {
-    "keyword": string
+    "keyword": string,
+    "limit": integer
 }
 \endcode
 
 \param keyword Keyword to search with.
+\param limit Optional. Return at most this many apps (title matches first). All matches are returned if omitted or 0.
 
 \subsection com_palm_application_manager_search_apps_returns Returns:
 \code
@@ -2100,12 +2093,14 @@ static bool servicecallback_searchForApps(LSHandle* lshandle, LSMessage *message
 	SearchSet::const_iterator it, itEnd;
 
 	std::string keyword, errMsg;
+	json_object* label = 0;
+	int limit = 0;
 
-    // {"keyword": string}
+    // {"keyword": string, "limit": integer}
 
     VALIDATE_SCHEMA_AND_RETURN(lshandle,
                                message,
-                               SCHEMA_1(REQUIRED(keyword, string)));
+                               SCHEMA_2(REQUIRED(keyword, string), OPTIONAL(limit, integer)));
 
 	const char* str = LSMessageGetPayload(message);
 	if (!str) {
@@ -2125,7 +2120,16 @@ static bool servicecallback_searchForApps(LSHandle* lshandle, LSMessage *message
 		goto Done;
 	}
 
-	ApplicationManager::instance()->searchLaunchPoints(matchedByTitle, matchedByKeyword, keyword);
+	label = JsonGetObject(root, "limit");
+	if (label) {
+		limit = json_object_get_int(label);
+		if (limit < 0) {
+			errMsg = "'limit' must not be negative";
+			goto Done;
+		}
+	}
+
+	ApplicationManager::instance()->searchLaunchPoints(matchedByTitle, matchedByKeyword, keyword, limit);
 
 	array = json_object_new_array();
 
@@ -3259,11 +3263,14 @@ Subscription method to be informed when changes occur in launchPoints.
 \subsection com_palm_application_manager_launch_point_changes_syntax Syntax:
 \code
 {
-    "subscribe": boolean
+    "subscribe": boolean,
+    "batch": boolean
 }
 \endcode
 
 \param subscribe Set to true to be to be informed when changes occur in launchPoints.
+\param batch Optional. Set to true to receive the changes as arrays (see below) instead of one message per change. Only
+       valid with "subscribe": true.
 
 \subsection com_palm_application_manager_launch_point_changes_returns Returns:
 \code
@@ -3320,6 +3327,22 @@ Example of a status change message when a launch point is added:
     "change": "added"
 }
 \endcode
+
+Batch subscribers get the changes that happened within a short window (or during one rescan) in a single message. Only the
+last change of each launch point is reported; a launch point added and removed again within the window is left out:
+\code
+{
+    "changes": [
+        {
+            "id": "com.palm.app.musicplayer",
+            ...
+            "launchPointId": "00453104",
+            "change": "added"
+        },
+        ...
+    ]
+}
+\endcode
 */
 static bool servicecallback_launchPointChanges(LSHandle* lsHandle, LSMessage *message, void *userData)
 {
@@ -3327,8 +3350,11 @@ static bool servicecallback_launchPointChanges(LSHandle* lsHandle, LSMessage *me
 	LSErrorInit(&lsError);
 	std::string errMsg;
 	json_object* json = 0;
+	json_object* root = 0;
 	bool success = false;
 	bool subscribed = false;
+	bool subscribe = false;
+	bool batch = false;
 
     // {}
 
@@ -3336,12 +3362,29 @@ static bool servicecallback_launchPointChanges(LSHandle* lsHandle, LSMessage *me
                                message,
                                SCHEMA_ANY);
 
-	if (!LSMessageIsSubscription(message)) {
+	root = json_tokener_parse(LSMessageGetPayload(message));
+	if (root) {
+		json_object* label = JsonGetObject(root, "subscribe");
+		if (label && json_object_is_type(label, json_type_boolean))
+			subscribe = json_object_get_boolean(label);
+		label = JsonGetObject(root, "batch");
+		if (label && json_object_is_type(label, json_type_boolean))
+			batch = json_object_get_boolean(label);
+	}
+
+	//LSSubscriptionAdd() registers whatever it's given, so "subscribe" is checked here rather than left to it; a "batch"
+	//without "subscribe": true is turned away with the rest
+	if (!subscribe || !LSMessageIsSubscription(message)) {
 		errMsg = "Only supports subscriptions";
 		goto Done;
 	}
 
-	success = LSSubscriptionProcess(lsHandle, message, &subscribed, &lsError);
+	if (batch) {
+		success = LSSubscriptionAdd(lsHandle, ApplicationManager::s_launchPointChangesBatchKey, message, &lsError);
+		subscribed = success;
+	}
+	else
+		success = LSSubscriptionProcess(lsHandle, message, &subscribed, &lsError);
 	if (!success) {
 		LSErrorFree (&lsError);
 		errMsg = "Failed to process subscription";
@@ -3359,6 +3402,8 @@ static bool servicecallback_launchPointChanges(LSHandle* lsHandle, LSMessage *me
 		LSErrorFree (&lsError);
 
 	json_object_put(json);
+	if (root)
+		json_object_put(root);
 
 	return true;
 }
@@ -3487,7 +3532,13 @@ Get the complete mime table.
             }
         },
         ...
-    ]
+    ],
+    "resolutionCache": {
+        "entries": int,
+        "hits": int,
+        "misses": int,
+        "generation": int
+    }
 }
 \endcode
 
@@ -3497,6 +3548,7 @@ Get the complete mime table.
 \param redirects Object array with objects for different URL patterns and their redirect handlers.
 \param url The URL pattern.
 \param handlers Object which contains the primary handler followed by alternate handlers.
+\param resolutionCache Statistics of the cache of url resolutions: how many it holds, lookups answered from it (hits) and not (misses) since startup, and the current table generation (entries from older generations are stale).
 
 \subsection com_palm_application_manager_dump_mime_table_examples Examples:
 \code
@@ -7095,6 +7147,20 @@ void ApplicationManager::stopService()
 		LSErrorFree(&lserror);
 }
 
+const char* ApplicationManager::s_launchPointChangesBatchKey = "launchPointChangesBatch";
+static const guint s_launchPointBatchWindowMs = 100;
+
+static bool hasSubscribers(LSHandle* service, const char* key)
+{
+	LSSubscriptionIter* iter = NULL;
+	if (!LSSubscriptionAcquire(service, key, &iter, NULL) || !iter)
+		return false;
+
+	bool result = LSSubscriptionHasNext(iter);
+	LSSubscriptionRelease(iter);
+	return result;
+}
+
 void ApplicationManager::postLaunchPointChange(const LaunchPoint* lp, const std::string& change)
 {
 
@@ -7104,6 +7170,7 @@ void ApplicationManager::postLaunchPointChange(const LaunchPoint* lp, const std:
 	LSErrorInit(&lsError);
 	json_object* json = 0;
 
+	invalidateLaunchPoints();
 
 	if (change == "removed") {
 		Q_EMIT signalLaunchPointRemoved(lp);
@@ -7121,6 +7188,7 @@ void ApplicationManager::postLaunchPointChange(const LaunchPoint* lp, const std:
 		Q_EMIT signalLaunchPointAdded(lp,statusBits);
 	}
 
+	//serialize now: a removed launch point is deleted as soon as we return
 	json = lp->toJSON();
 	json_object_object_add(json, "change", json_object_new_string(change.c_str()));
 	g_message("%s: Posting LaunchPoint change %s", __PRETTY_FUNCTION__, json_object_to_json_string(json));
@@ -7128,10 +7196,118 @@ void ApplicationManager::postLaunchPointChange(const LaunchPoint* lp, const std:
 			json_object_to_json_string(json), &lsError))
 		LSErrorFree (&lsError);
 
+	if (hasSubscribers(m_service, s_launchPointChangesBatchKey)) {
+		queueLaunchPointChange(lp->launchPointId(), change, json);
+		json = 0;
+	}
+
 	if (json)
 		json_object_put(json);
 }
 
+//takes ownership of json
+void ApplicationManager::queueLaunchPointChange(const std::string& launchPointId, const std::string& change, json_object* json)
+{
+	MutexLocker locker(&m_mutex);
+
+	std::map<std::string,size_t>::iterator it = m_queuedLaunchPointChangesById.find(launchPointId);
+	if (it == m_queuedLaunchPointChangesById.end()) {
+		QueuedLaunchPointChange queued;
+		queued.change = change;
+		queued.json = json;
+		m_queuedLaunchPointChangesById[launchPointId] = m_queuedLaunchPointChanges.size();
+		m_queuedLaunchPointChanges.push_back(queued);
+	}
+	else {
+		//the latest state supersedes whatever was queued before, but subscribers must still see a net add/remove as such
+		QueuedLaunchPointChange& queued = m_queuedLaunchPointChanges[it->second];
+		std::string netChange = change;
+		if (queued.change == "added" && change == "updated")
+			netChange = "added";
+		else if (queued.change == "added" && change == "removed")
+			netChange = "";						//never seen by the subscribers; drop it
+		else if (queued.change == "removed" && change == "added")
+			netChange = "updated";
+		else if (queued.change.empty() && change == "updated")
+			netChange = "added";
+
+		if (queued.json)
+			json_object_put(queued.json);
+		queued.change = netChange;
+		queued.json = 0;
+		if (!netChange.empty()) {
+			queued.json = json;
+			json_object_object_add(json, "change", json_object_new_string(netChange.c_str()));
+		}
+		else
+			json_object_put(json);
+	}
+
+	if (m_launchPointBatchDepth == 0 && m_launchPointBatchTimer == 0)
+		m_launchPointBatchTimer = g_timeout_add(s_launchPointBatchWindowMs, cbFlushLaunchPointChanges, this);
+}
+
+gboolean ApplicationManager::cbFlushLaunchPointChanges(gpointer data)
+{
+	ApplicationManager* self = static_cast<ApplicationManager*>(data);
+	MutexLocker locker(&self->m_mutex);
+
+	self->m_launchPointBatchTimer = 0;
+	self->flushLaunchPointChanges();
+	return FALSE;
+}
+
+void ApplicationManager::beginLaunchPointBatch()
+{
+	MutexLocker locker(&m_mutex);
+
+	++m_launchPointBatchDepth;
+}
+
+void ApplicationManager::endLaunchPointBatch()
+{
+	MutexLocker locker(&m_mutex);
+
+	if (m_launchPointBatchDepth == 0 || --m_launchPointBatchDepth > 0)
+		return;
+
+	if (m_launchPointBatchTimer) {
+		g_source_remove(m_launchPointBatchTimer);
+		m_launchPointBatchTimer = 0;
+	}
+	flushLaunchPointChanges();
+}
+
+///BE SURE TO EXTERNALLY LOCK APPLIST IF NEEDED!!!
+void ApplicationManager::flushLaunchPointChanges()
+{
+	if (m_queuedLaunchPointChanges.empty())
+		return;
+
+	json_object* changes = json_object_new_array();
+	for (std::vector<QueuedLaunchPointChange>::iterator it = m_queuedLaunchPointChanges.begin();
+		 it != m_queuedLaunchPointChanges.end(); ++it) {
+		if (it->json)
+			json_object_array_add(changes, it->json);		//the array takes over the reference
+	}
+	m_queuedLaunchPointChanges.clear();
+	m_queuedLaunchPointChangesById.clear();
+
+	if (json_object_array_length(changes) > 0) {
+		json_object* payload = json_object_new_object();
+		json_object_object_add(payload, "changes", changes);
+		g_message("%s: Posting %d LaunchPoint changes", __PRETTY_FUNCTION__, json_object_array_length(changes));
+
+		LSError lsError;
+		LSErrorInit(&lsError);
+		if (!LSSubscriptionReply(m_service, s_launchPointChangesBatchKey, json_object_to_json_string(payload), &lsError))
+			LSErrorFree (&lsError);
+		json_object_put(payload);
+	}
+	else
+		json_object_put(changes);
+}
+
 /*!
  *	\fn com.palm.applicationManager/running
  *	\brief List all running applications in the system manager.
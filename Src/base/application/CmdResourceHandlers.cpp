@@ -24,34 +24,169 @@
 #include <stdlib.h>
 #include <string.h>
 #include <string>
+#include <glib.h>
 #include "CmdResourceHandlers.h"
 #include "MimeSystem.h"
 #include <json.h>
 #include <json_util.h>
+#include "MutexLocker.h"
+
+static Mutex s_internMutex;
+static std::map<std::string,InternedString::Entry *> s_internedStrings;
+
+//shared by every empty InternedString; never counted, never freed
+static InternedString::Entry * emptyEntry()
+{
+	static InternedString::Entry * s_emptyEntry = new InternedString::Entry(std::string());
+	return s_emptyEntry;
+}
+
+InternedString::InternedString() : m_entry(emptyEntry())
+{
+}
+
+InternedString::InternedString(const std::string& s)
+{
+	if (s.empty()) {
+		m_entry = emptyEntry();
+		return;
+	}
+
+	MutexLocker locker(&s_internMutex);
+	std::map<std::string,Entry *>::iterator it = s_internedStrings.find(s);
+	if (it != s_internedStrings.end()) {
+		m_entry = it->second;
+		g_atomic_int_inc(&m_entry->refCount);
+	}
+	else {
+		m_entry = new Entry(s);
+		s_internedStrings[s] = m_entry;
+	}
+}
+
+InternedString::InternedString(const InternedString& c) : m_entry(c.m_entry)
+{
+	ref(m_entry);
+}
+
+InternedString& InternedString::operator=(const InternedString& c)
+{
+	if (m_entry != c.m_entry) {
+		ref(c.m_entry);
+		unref(m_entry);
+		m_entry = c.m_entry;
+	}
+	return *this;
+}
+
+InternedString::~InternedString()
+{
+	unref(m_entry);
+}
+
+void InternedString::ref(Entry * p)
+{
+	//the caller holds a reference already, so this can't be racing the last unref
+	if (p != emptyEntry())
+		g_atomic_int_inc(&p->refCount);
+}
+
+void InternedString::unref(Entry * p)
+{
+	if (p == emptyEntry())
+		return;
+
+	//dropping anything but the last reference doesn't need the lock. The last one is dropped under it, so that a lookup
+	//(which takes its reference under the lock) can't find an entry that is about to be freed
+	while (true) {
+		gint count = g_atomic_int_get(&p->refCount);
+		if (count > 1) {
+			if (g_atomic_int_compare_and_exchange(&p->refCount, count, count - 1))
+				return;
+			continue;
+		}
+
+		MutexLocker locker(&s_internMutex);
+		if (g_atomic_int_dec_and_test(&p->refCount)) {
+			s_internedStrings.erase(p->str);
+			delete p;
+		}
+		return;
+	}
+}
+
+/**
+ * A compiled URL regular expression. Copies of a RedirectHandler share one (reference counted) instead of compiling the
+ * expression again; it is never modified once compiled, and regexec() may be run on it from several threads at once.
+ */
+class RedirectHandler::CompiledRe
+{
+public:
+	static CompiledRe * compile(const std::string& urlRe)		///< NULL if urlRe is empty or doesn't compile
+	{
+		if (urlRe.empty())
+			return NULL;
+		CompiledRe * p = new CompiledRe();
+		if (0 != regcomp(&p->m_reg, urlRe.c_str(), REG_EXTENDED | REG_ICASE | REG_NOSUB)) {
+			delete p;
+			return NULL;
+		}
+		p->m_compiled = true;
+		return p;
+	}
+	
+	CompiledRe * ref()
+	{
+		g_atomic_int_inc(&m_refCount);
+		return this;
+	}
+	
+	void unref()
+	{
+		if (g_atomic_int_dec_and_test(&m_refCount))
+			delete this;
+	}
+	
+	bool matches(const std::string& url) const
+	{
+		return regexec(&m_reg, url.c_str(), 0, NULL, 0) == 0;
+	}
+	
+private:
+	CompiledRe() : m_refCount(1), m_compiled(false) {}
+	~CompiledRe()
+	{
+		if (m_compiled)
+			regfree(&m_reg);
+	}
+	
+	regex_t m_reg;
+	volatile gint m_refCount;
+	bool m_compiled;
+};
 
 /**
  * Constructor.
  */
 RedirectHandler::RedirectHandler(const std::string& urlRe, const std::string& appId , bool schemeform ) :
-	m_urlRe(urlRe), m_appId(appId) , m_valid(true) , m_schemeForm(schemeform) , m_tag("")
+	m_urlRe(urlRe), m_appId(appId) , m_valid(true) , m_schemeForm(schemeform) 
 {
 	m_index = MimeSystem::assignIndex();
-	if (!urlRe.empty() && 0 == regcomp(&m_urlReg, urlRe.c_str(), REG_EXTENDED | REG_ICASE | REG_NOSUB)) {
-	}
-	else {
-		::memset(&m_urlReg, 0, sizeof(m_urlReg));
-	}
+	m_urlReg = CompiledRe::compile(urlRe);
 }
 
 RedirectHandler::RedirectHandler(const std::string& urlRe, const std::string& appId , bool schemeform, const std::string& handler_tag) :
 	m_urlRe(urlRe), m_appId(appId) , m_valid(true), m_schemeForm(schemeform) , m_tag(handler_tag)
 {
 	m_index = MimeSystem::assignIndex();
-	if (!urlRe.empty() && 0 == regcomp(&m_urlReg, urlRe.c_str(), REG_EXTENDED | REG_ICASE | REG_NOSUB)) {
-	}
-	else {
-		::memset(&m_urlReg, 0, sizeof(m_urlReg));
-	}
+	m_urlReg = CompiledRe::compile(urlRe);
+}
+
+RedirectHandler::RedirectHandler(const RedirectHandler& sameUrl, const std::string& appId , bool schemeform) :
+	m_urlRe(sameUrl.m_urlRe), m_appId(appId) , m_valid(true), m_schemeForm(schemeform) 
+{
+	m_index = MimeSystem::assignIndex();
+	m_urlReg = (sameUrl.m_urlReg ? sameUrl.m_urlReg->ref() : NULL);
 }
 
 RedirectHandler::RedirectHandler(const RedirectHandler& c) 
@@ -64,21 +199,18 @@ RedirectHandler::RedirectHandler(const RedirectHandler& c)
 	m_schemeForm = c.m_schemeForm;
 	m_verbs = c.m_verbs;
 	
-	if (!m_urlRe.empty() && 0 == regcomp(&m_urlReg, m_urlRe.c_str(), REG_EXTENDED | REG_ICASE | REG_NOSUB)) {
-	}
-	else {
-		::memset(&m_urlReg, 0, sizeof(m_urlReg));
-	}
-	
+	m_urlReg = (c.m_urlReg ? c.m_urlReg->ref() : NULL);
 }
 RedirectHandler& RedirectHandler::operator=(const RedirectHandler& c) 
 {
 	if (this == &c)
 		return *this;
 	
-	if (reValid()) {
-		regfree(&m_urlReg);
-	}
+	//take the new reference first; c may be a copy sharing the same compiled expression
+	CompiledRe * p_urlReg = (c.m_urlReg ? c.m_urlReg->ref() : NULL);
+	if (m_urlReg)
+		m_urlReg->unref();
+	m_urlReg = p_urlReg;
 	
 	m_urlRe = c.m_urlRe;
 	m_appId = c.m_appId;
@@ -88,18 +220,11 @@ RedirectHandler& RedirectHandler::operator=(const RedirectHandler& c)
 	m_schemeForm = c.m_schemeForm;
 	m_verbs = c.m_verbs;
 	
-	if (!m_urlRe.empty() && 0 == regcomp(&m_urlReg, m_urlRe.c_str(), REG_EXTENDED | REG_ICASE | REG_NOSUB)) {
-	}
-	else {
-		::memset(&m_urlReg, 0, sizeof(m_urlReg));
-	}
-	
 	return *this;
 }
 
-RedirectHandler::RedirectHandler() : m_valid(false), m_schemeForm(false), m_index(0)
+RedirectHandler::RedirectHandler() : m_urlReg(NULL), m_valid(false), m_schemeForm(false), m_index(0)
 {
-	::memset(&m_urlReg, 0, sizeof(m_urlReg));
 }
 
 /**
@@ -107,9 +232,8 @@ RedirectHandler::RedirectHandler() : m_valid(false), m_schemeForm(false), m_inde
  */
 RedirectHandler::~RedirectHandler()
 {
-	if (reValid()) {
-		regfree(&m_urlReg);
-	}
+	if (m_urlReg)
+		m_urlReg->unref();
 }
 
 /**
@@ -118,7 +242,7 @@ RedirectHandler::~RedirectHandler()
  */
 bool RedirectHandler::matches(const std::string& url) const
 {
-	return !url.empty() && reValid() && regexec(&m_urlReg, url.c_str(), 0, NULL, 0) == 0;
+	return !url.empty() && reValid() && m_urlReg->matches(url);
 }
 
 /**
@@ -126,7 +250,7 @@ bool RedirectHandler::matches(const std::string& url) const
  */
 bool RedirectHandler::reValid() const
 {
-	return m_urlReg.buffer != NULL;
+	return m_urlReg != NULL;
 }
 
 bool RedirectHandler::addVerb(const std::string& verb,const std::string& jsonizedParams)
@@ -134,6 +258,7 @@ bool RedirectHandler::addVerb(const std::string& verb,const std::string& jsonize
 	struct json_object * jobj = json_tokener_parse(jsonizedParams.c_str());
 	if (!jobj)
 		return false;
+	json_object_put(jobj);		//only parsed to validate the params
 	
 	m_verbs[verb] = jsonizedParams;
 	
@@ -156,11 +281,11 @@ std::string	RedirectHandler::toJsonString()
 struct json_object * RedirectHandler::toJson()			//WARNING: memory allocated; caller must clean
 {
 	struct json_object * jobj = json_object_new_object();
-	json_object_object_add(jobj,(char *)"url",json_object_new_string(m_urlRe.c_str()));
-	json_object_object_add(jobj,(char *)"appId",json_object_new_string(m_appId.c_str()));
+	json_object_object_add(jobj,(char *)"url",json_object_new_string(m_urlRe.str().c_str()));
+	json_object_object_add(jobj,(char *)"appId",json_object_new_string(m_appId.str().c_str()));
 	json_object_object_add(jobj,(char *)"index",json_object_new_int(m_index));
-	if (m_tag.size())
-		json_object_object_add(jobj,(char *)"tag",json_object_new_string(m_tag.c_str()));
+	if (m_tag.str().size())
+		json_object_object_add(jobj,(char *)"tag",json_object_new_string(m_tag.str().c_str()));
 	json_object_object_add(jobj,(char *)"schemeForm",json_object_new_boolean(m_schemeForm));
 	if (m_verbs.size()) {
 		json_object * jparam = json_object_new_object();
@@ -185,7 +310,6 @@ ResourceHandler::ResourceHandler( const std::string& ext, const std::string& con
 , m_appId(appId)
 , m_stream(stream)
 , m_valid(true)
-, m_tag("")
 {
 	m_index = MimeSystem::assignIndex();
 }
@@ -205,6 +329,13 @@ ResourceHandler::ResourceHandler( const std::string& ext,
 	m_index = MimeSystem::assignIndex();
 }
 
+ResourceHandler::ResourceHandler()
+: m_stream(false)
+, m_valid(false)
+, m_index(0)
+{
+}
+
 ResourceHandler::ResourceHandler(const ResourceHandler& c) 
 {
 	m_fileExt = c.m_fileExt;
@@ -239,6 +370,7 @@ bool ResourceHandler::addVerb(const std::string& verb,const std::string& jsonize
 	struct json_object * jobj = json_tokener_parse(jsonizedParams.c_str());
 	if (!jobj)
 		return false;
+	json_object_put(jobj);		//only parsed to validate the params
 	
 	m_verbs[verb] = jsonizedParams;
 	
@@ -261,13 +393,13 @@ std::string	ResourceHandler::toJsonString()
 struct json_object * ResourceHandler::toJson()			//WARNING: memory allocated; caller must clean
 {
 	struct json_object * jobj = json_object_new_object();
-	json_object_object_add(jobj,(char *)"mime",json_object_new_string(m_contentType.c_str()));
-	json_object_object_add(jobj,(char *)"extension",json_object_new_string(m_fileExt.c_str()));
-	json_object_object_add(jobj,(char *)"appId",json_object_new_string(m_appId.c_str()));
+	json_object_object_add(jobj,(char *)"mime",json_object_new_string(m_contentType.str().c_str()));
+	json_object_object_add(jobj,(char *)"extension",json_object_new_string(m_fileExt.str().c_str()));
+	json_object_object_add(jobj,(char *)"appId",json_object_new_string(m_appId.str().c_str()));
 	json_object_object_add(jobj,(char *)"streamable",json_object_new_boolean(m_stream));
 	json_object_object_add(jobj,(char *)"index",json_object_new_int(m_index));
-	if (m_tag.size())
-		json_object_object_add(jobj,(char *)"tag",json_object_new_string(m_tag.c_str()));
+	if (m_tag.str().size())
+		json_object_object_add(jobj,(char *)"tag",json_object_new_string(m_tag.str().c_str()));
 	if (m_verbs.size()) {
 		json_object * jparam = json_object_new_object();
 		for (std::map<std::string,std::string>::iterator it = m_verbs.begin();
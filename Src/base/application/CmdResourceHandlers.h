@@ -30,6 +30,45 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <glib.h>
+
+/**
+ * A reference to the one shared copy of a string. The same few app ids, mime types, extensions and tags show up in a great
+ * many handlers (and in every copy of them handed out by the MimeSystem), so the handlers keep these instead of strings of
+ * their own. Equal strings always share one copy, so comparing the references compares the strings.
+ *
+ * The shared copies are reference counted and freed along with the last handler using them, so the table only ever holds the
+ * strings of handlers that currently exist. Copying a reference is an atomic increment; only making one from a std::string
+ * (a table lookup) and dropping the last one take the table's lock. The empty string is never counted, so default-constructed
+ * handlers don't touch the table at all.
+ */
+class InternedString
+{
+public:
+	InternedString();								///< the empty string
+	explicit InternedString(const std::string& s);
+	InternedString(const InternedString& c);
+	InternedString& operator=(const InternedString& c);
+	~InternedString();
+
+	struct Entry
+	{
+		Entry(const std::string& s) : str(s), refCount(1) {}
+		std::string str;
+		volatile gint refCount;
+	};
+
+	const std::string& str() const { return m_entry->str; }
+
+	bool operator==(const InternedString& c) const { return m_entry == c.m_entry; }
+	bool operator!=(const InternedString& c) const { return m_entry != c.m_entry; }
+
+private:
+	static void ref(Entry * p);
+	static void unref(Entry * p);
+
+	Entry * m_entry;
+};
 
 /**
  * Maps a URL regular expression to the application id that can handle a matching
@@ -44,11 +83,12 @@ class RedirectHandler
 	public:
 		RedirectHandler(const std::string& urlRe, const std::string& appId, bool schemeform );
 		RedirectHandler(const std::string& urlRe, const std::string& appId, bool schemeform, const std::string& handler_tag);
+		RedirectHandler(const RedirectHandler& sameUrl, const std::string& appId, bool schemeform);		///< another app's handler for sameUrl's url; shares its compiled expression
 		virtual ~RedirectHandler();
 		RedirectHandler();
 		
-		const std::string& urlRe() const { return m_urlRe; }
-		const std::string& appId() const { return m_appId; }
+		const std::string& urlRe() const { return m_urlRe.str(); }
+		const std::string& appId() const { return m_appId.str(); }
 		bool matches(const std::string& url) const;
 		bool reValid() const;
 		
@@ -65,7 +105,7 @@ class RedirectHandler
 		}
 		bool equals(const std::string& url,const std::string& appId)
 		{
-			return ((m_urlRe == url) && (m_appId == appId));
+			return ((m_urlRe.str() == url) && (m_appId.str() == appId));
 		}
 		
 		RedirectHandler(const RedirectHandler& c);
@@ -77,8 +117,8 @@ class RedirectHandler
 		void markInvalid() { m_valid = false; }
 		bool isSchemeForm() const { return m_schemeForm;}
 		
-		const std::string& tag() const { return m_tag; }
-		void setTag(const std::string& newtag) { m_tag = newtag;}
+		const std::string& tag() const { return m_tag.str(); }
+		void setTag(const std::string& newtag) { m_tag = InternedString(newtag);}
 		uint32_t index() { return m_index; }
 		uint32_t setIndex(uint32_t newindex) { uint32_t t = m_index; m_index = newindex; return t;}
 
@@ -89,12 +129,14 @@ class RedirectHandler
 		
 	private:
 		
-		std::string m_urlRe; ///< The URL regular expression
-		std::string m_appId;
-		regex_t m_urlReg; ///< The compiled URL regular expression
+		class CompiledRe;
+		
+		InternedString m_urlRe; ///< The URL regular expression
+		InternedString m_appId;
+		CompiledRe * m_urlReg; ///< The compiled URL regular expression; shared by (immutable between) all copies of this handler
 		bool	m_valid;
 		bool	m_schemeForm;
-		std::string m_tag;
+		InternedString m_tag;
 		uint32_t m_index;
 		std::map<std::string,std::string>	m_verbs;				// < Verb , json-ized string of parameters >
 
@@ -118,7 +160,7 @@ class ResourceHandler
 				const std::string& handler_tag);
 		
 		~ResourceHandler() { }
-		ResourceHandler() : m_stream(false), m_valid(false), m_index(0) {}
+		ResourceHandler();
 		
 		ResourceHandler(const ResourceHandler& c);
 		ResourceHandler& operator=(const ResourceHandler& c);
@@ -135,22 +177,22 @@ class ResourceHandler
 
 		bool match(const std::string& extension,const std::string& appId,const std::string& mimeType,bool stream) const
 		{
-			return ((m_fileExt == extension) && (m_contentType == mimeType) && (m_appId == appId) && (m_stream == stream));
+			return ((m_fileExt.str() == extension) && (m_contentType.str() == mimeType) && (m_appId.str() == appId) && (m_stream == stream));
 		}
 		bool match(const std::string& extension,const std::string& appId,const std::string& mimeType) const
 		{
-			return ((m_fileExt == extension) && (m_contentType == mimeType) && (m_appId == appId));		
+			return ((m_fileExt.str() == extension) && (m_contentType.str() == mimeType) && (m_appId.str() == appId));		
 		}
 		bool match(const std::string& appId,const std::string& mimeType) const
 		{
-			return ((m_contentType == mimeType) && (m_appId == appId));		
+			return ((m_contentType.str() == mimeType) && (m_appId.str() == appId));		
 		}
 		
-		const std::string& appId() const { return m_appId; }
-		const std::string& fileExt() const { return m_fileExt; }
-		const std::string& contentType() const { return m_contentType; }
-		const std::string& tag() const { return m_tag; }
-		void setTag(const std::string& newtag) { m_tag = newtag;}
+		const std::string& appId() const { return m_appId.str(); }
+		const std::string& fileExt() const { return m_fileExt.str(); }
+		const std::string& contentType() const { return m_contentType.str(); }
+		const std::string& tag() const { return m_tag.str(); }
+		void setTag(const std::string& newtag) { m_tag = InternedString(newtag);}
 		uint32_t index() { return m_index; }
 		uint32_t setIndex(uint32_t newindex) { uint32_t t = m_index; m_index = newindex; return t;}
 		bool stream() const { return m_stream; }
@@ -168,12 +210,12 @@ class ResourceHandler
 		const std::map<std::string,std::string>& verbs() { return m_verbs;}
 		
 	private:
-		std::string m_fileExt;
-		std::string m_contentType;
-		std::string m_appId;
+		InternedString m_fileExt;
+		InternedString m_contentType;
+		InternedString m_appId;
 		bool m_stream;
 		bool m_valid;
-		std::string m_tag;
+		InternedString m_tag;
 		uint32_t	m_index;
 		std::map<std::string,std::string>	m_verbs;				// < Verb , json-ized string of parameters >
 };
@@ -0,0 +1,176 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+
+
+#include "Common.h"
+
+#include <glib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include "DiskUsage.h"
+#include "MutexLocker.h"
+
+// deeper trees than this aren't something an app package should have; don't run out of descriptors on them
+const int DiskUsageWalker::s_maxDepth = 64;
+
+bool DiskUsageLinkSet::insert(dev_t dev,ino_t ino)
+{
+	MutexLocker locker(&m_mutex);
+	return m_seen.insert(std::make_pair(dev,ino)).second;
+}
+
+DiskUsageWalker::DiskUsageWalker(DiskUsageLinkSet* sharedLinks)
+	: m_sharedLinks(sharedLinks)
+	, m_apparentBytes(0)
+	, m_allocatedBytes(0)
+	, m_entries(0)
+	, m_errors(0)
+{
+}
+
+DiskUsageWalker::~DiskUsageWalker()
+{
+}
+
+void DiskUsageWalker::reset()
+{
+	m_seenLinks.clear();
+	m_apparentBytes = 0;
+	m_allocatedBytes = 0;
+	m_entries = 0;
+	m_errors = 0;
+}
+
+bool DiskUsageWalker::walk(const std::string& path,bool countRoot)
+{
+	struct stat st;
+	if (path.empty() || ::fstatat(AT_FDCWD,path.c_str(),&st,AT_SYMLINK_NOFOLLOW) != 0)
+		return false;
+
+	std::string entryPath(path);
+	if (S_ISDIR(st.st_mode)) {
+		int fd = ::open(path.c_str(),O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+		if (fd < 0) {
+			g_warning("%s: can't open %s: %s", __FUNCTION__, path.c_str(), strerror(errno));
+			++m_errors;
+			return false;
+		}
+		walkDirectory(fd,entryPath,1);		//closes fd
+		entryPath = path;
+	}
+
+	if (countRoot && count(st))
+		visit(entryPath,st);
+	return true;
+}
+
+bool DiskUsageWalker::walkTopLevel(const std::string& path,std::vector<std::string>& r_subdirs)
+{
+	int fd = ::open(path.c_str(),O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	std::string entryPath(path);
+	walkDirectory(fd,entryPath,1,&r_subdirs);		//closes fd
+	return true;
+}
+
+//takes ownership of dirFd. path is the directory's path on the way in and out; it's used as the buffer for the entries' paths.
+//With r_subdirs, subdirectories are handed back there instead of being walked (or counted)
+void DiskUsageWalker::walkDirectory(int dirFd,std::string& path,int depth,std::vector<std::string>* r_subdirs)
+{
+	DIR* dir = ::fdopendir(dirFd);
+	if (!dir) {
+		g_warning("%s: can't read %s: %s", __FUNCTION__, path.c_str(), strerror(errno));
+		::close(dirFd);
+		++m_errors;
+		return;
+	}
+
+	std::string::size_type baseLength = path.size();
+	if (baseLength == 0 || path[baseLength - 1] != '/') {
+		path += '/';
+		++baseLength;
+	}
+
+	struct dirent* entry;
+	while ((entry = ::readdir(dir)) != NULL) {
+		const char* name = entry->d_name;
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+			continue;
+
+		path.resize(baseLength);
+		path += name;
+
+		struct stat st;
+		if (::fstatat(dirFd,name,&st,AT_SYMLINK_NOFOLLOW) != 0) {
+			++m_errors;
+			continue;
+		}
+
+		if (S_ISDIR(st.st_mode) && r_subdirs) {
+			r_subdirs->push_back(path);
+			continue;
+		}
+
+		if (S_ISDIR(st.st_mode)) {
+			if (depth >= s_maxDepth) {
+				g_warning("%s: not going deeper than %d levels, at %s", __FUNCTION__, s_maxDepth, path.c_str());
+				++m_errors;
+			}
+			else {
+				int fd = ::openat(dirFd,name,O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+				if (fd >= 0) {
+					walkDirectory(fd,path,depth + 1);
+					path.resize(baseLength);
+					path += name;
+				}
+				else
+					++m_errors;
+			}
+		}
+
+		if (count(st))
+			visit(path,st);
+	}
+
+	::closedir(dir);		//closes dirFd too
+	path.resize(baseLength);
+}
+
+//false if the entry was counted already (another hard link to the same file)
+bool DiskUsageWalker::count(const struct stat& st)
+{
+	if (!S_ISDIR(st.st_mode) && st.st_nlink > 1) {
+		bool first = (m_sharedLinks ? m_sharedLinks->insert(st.st_dev,st.st_ino)
+									: m_seenLinks.insert(std::make_pair(st.st_dev,st.st_ino)).second);
+		if (!first)
+			return false;
+	}
+
+	m_apparentBytes += (uint64_t)st.st_size;
+	m_allocatedBytes += (uint64_t)st.st_blocks * 512;
+	++m_entries;
+	return true;
+}
@@ -0,0 +1,104 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+
+
+#ifndef DISKUSAGE_H_
+#define DISKUSAGE_H_
+
+#include "Common.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string>
+#include <set>
+#include <vector>
+#include <utility>
+
+#include "Mutex.h"
+
+/*
+ * The hard links seen by a group of walkers that together measure one tree (e.g. its subtrees, walked on different threads),
+ * so that a file linked from two of the subtrees is counted once, however the tree was split up. Thread safe.
+ */
+class DiskUsageLinkSet
+{
+public:
+	// false if the file was seen already
+	bool insert(dev_t dev,ino_t ino);
+
+private:
+	Mutex m_mutex;
+	std::set<std::pair<dev_t,ino_t> > m_seen;
+};
+
+/*
+ * Adds up the disk usage of directory trees the way "du" does, without running it: the tree is read with openat()/fstatat()
+ * relative to each directory's descriptor, symlinks are not followed, and a file with several hard links inside the walked
+ * trees is counted once. Both the apparent size (st_size) and the allocated size (st_blocks) are kept.
+ *
+ * A walker only touches its own members, so walkers on different threads don't get in each other's way. Hard links are only
+ * recognized within what one walker has seen, unless the walkers share a DiskUsageLinkSet. Subclasses that want to see every
+ * entry override visit().
+ */
+class DiskUsageWalker
+{
+public:
+
+	explicit DiskUsageWalker(DiskUsageLinkSet* sharedLinks = NULL);
+	virtual ~DiskUsageWalker();
+
+	// adds path (itself too, unless countRoot is false) and everything under it to the totals. Returns false if path couldn't be read
+	bool walk(const std::string& path,bool countRoot = true);
+	// adds only the entries directly in directory path that aren't directories, and returns the paths of its subdirectories
+	// instead, so they can be walked separately (e.g. by other walkers, on other threads)
+	bool walkTopLevel(const std::string& path,std::vector<std::string>& r_subdirs);
+	void reset();
+
+	uint64_t apparentBytes() const { return m_apparentBytes; }
+	uint64_t allocatedBytes() const { return m_allocatedBytes; }
+	uint64_t allocatedBytesInKB() const { return (m_allocatedBytes + 1023) / 1024; }	// what "du -s" prints
+	uint32_t entries() const { return m_entries; }
+	uint32_t errors() const { return m_errors; }
+
+protected:
+
+	// called for each counted entry, after everything under it if it's a directory (like nftw()'s FTW_DEPTH)
+	virtual void visit(const std::string& path,const struct stat& st) {}
+
+private:
+
+	DiskUsageWalker(const DiskUsageWalker&);
+	DiskUsageWalker& operator=(const DiskUsageWalker&);
+
+	void walkDirectory(int dirFd,std::string& path,int depth,std::vector<std::string>* r_subdirs = NULL);
+	bool count(const struct stat& st);
+
+	static const int s_maxDepth;
+
+	std::set<std::pair<dev_t,ino_t> > m_seenLinks;		// files with st_nlink > 1 that were counted already
+	DiskUsageLinkSet* m_sharedLinks;		// used instead of m_seenLinks, if given
+	uint64_t m_apparentBytes;
+	uint64_t m_allocatedBytes;
+	uint32_t m_entries;
+	uint32_t m_errors;
+};
+
+#endif /* DISKUSAGE_H_ */
@@ -0,0 +1,97 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+
+
+#ifndef FLATMAP_H_
+#define FLATMAP_H_
+
+#include "Common.h"
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+/*
+ * The part of std::map's interface the MimeSystem nodes use, kept in one sorted vector. Meant for the small (a handful of
+ * entries) per-node tables: one allocation for the lot instead of one per entry, and lookups that stay in one cache line or two.
+ *
+ * Unlike std::map, inserting or erasing invalidates iterators and references into the map.
+ */
+template <typename K,typename V>
+class FlatMap
+{
+public:
+
+	typedef std::pair<K,V> value_type;
+	typedef typename std::vector<value_type>::iterator iterator;
+	typedef typename std::vector<value_type>::const_iterator const_iterator;
+
+	iterator begin() { return m_items.begin(); }
+	iterator end() { return m_items.end(); }
+	const_iterator begin() const { return m_items.begin(); }
+	const_iterator end() const { return m_items.end(); }
+
+	size_t size() const { return m_items.size(); }
+	bool empty() const { return m_items.empty(); }
+	void clear() { m_items.clear(); }
+
+	iterator find(const K& key)
+	{
+		iterator it = std::lower_bound(m_items.begin(),m_items.end(),key,KeyLess());
+		if (it != m_items.end() && !(key < it->first))
+			return it;
+		return m_items.end();
+	}
+	const_iterator find(const K& key) const
+	{
+		const_iterator it = std::lower_bound(m_items.begin(),m_items.end(),key,KeyLess());
+		if (it != m_items.end() && !(key < it->first))
+			return it;
+		return m_items.end();
+	}
+
+	V& operator[](const K& key)
+	{
+		iterator it = std::lower_bound(m_items.begin(),m_items.end(),key,KeyLess());
+		if (it == m_items.end() || key < it->first)
+			it = m_items.insert(it,value_type(key,V()));
+		return it->second;
+	}
+
+	void erase(iterator it) { m_items.erase(it); }
+	size_t erase(const K& key)
+	{
+		iterator it = find(key);
+		if (it == m_items.end())
+			return 0;
+		m_items.erase(it);
+		return 1;
+	}
+
+private:
+
+	struct KeyLess {
+		bool operator()(const value_type& item,const K& key) const { return item.first < key; }
+	};
+
+	std::vector<value_type> m_items;
+};
+
+#endif /* FLATMAP_H_ */
@@ -0,0 +1,289 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+
+
+#include "Common.h"
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <algorithm>
+#include <vector>
+
+#include "IconCache.h"
+#include "MutexLocker.h"
+#include "QtUtils.h"
+
+static const char* s_diskCachePath = "/var/luna/data/.icon-cache";
+const size_t IconCache::s_memoryBudget = 4 * 1024 * 1024;
+const size_t IconCache::s_diskBudget = 8 * 1024 * 1024;
+
+static IconCache* s_instance = 0;
+
+IconCache* IconCache::instance()
+{
+	if (!s_instance)
+		s_instance = new IconCache();
+	return s_instance;
+}
+
+IconCache::IconCache()
+	: m_bytes(0)
+	, m_diskCacheReady(false)
+	, m_diskBytes(0)
+{
+	if (g_mkdir_with_parents(s_diskCachePath, 0755) == 0) {
+		m_diskCacheReady = true;
+		loadDiskIndex();
+	}
+	else
+		g_warning("%s: unable to create %s; scaled icons won't be kept across restarts", __FUNCTION__, s_diskCachePath);
+}
+
+IconCache::~IconCache()
+{
+}
+
+void IconCache::desaturate(QImage& img)
+{
+	int length = img.sizeInBytes();
+	uchar* data = img.bits();
+
+	int avg;
+
+	for (int i = 0; i < length; i += 4) {
+		avg = (data[i] + data[i+1] + data[i+2]) / 3;
+		data[i]   = avg;
+		data[i+1] = avg;
+		data[i+2] = avg;
+	}
+}
+
+QImage IconCache::image(const std::string& iconPath,int width,int height,bool desaturated)
+{
+	struct stat stBuf;
+	if (iconPath.empty() || ::stat(iconPath.c_str(), &stBuf) != 0)
+		return QImage();
+
+	gchar* keyStr = g_strdup_printf("%s|%lld|%lld|%dx%d|%d", iconPath.c_str(),
+									(long long)stBuf.st_mtime, (long long)stBuf.st_size,
+									width, height, desaturated ? 1 : 0);
+	std::string key(keyStr);
+	g_free(keyStr);
+
+	{
+		MutexLocker locker(&m_mutex);
+
+		std::map<std::string,Entry>::iterator it = m_entries.find(key);
+		if (it != m_entries.end()) {
+			m_lru.splice(m_lru.begin(), m_lru, it->second.lruPos);
+			return it->second.image;
+		}
+	}
+
+	//only variants that took some work to make are worth a file of their own.
+	//disk files are named <variant>-<mtime>-<size>.png, so all the files made from one path/size/desaturation share a prefix
+	std::string variant, fileName, diskPath;
+	if (m_diskCacheReady && (width > 0 || height > 0 || desaturated)) {
+		gchar* variantStr = g_strdup_printf("%s|%dx%d|%d", iconPath.c_str(), width, height, desaturated ? 1 : 0);
+		gchar* digest = g_compute_checksum_for_string(G_CHECKSUM_MD5, variantStr, -1);
+		gchar* fileNameStr = g_strdup_printf("%s-%lld-%lld.png", digest, (long long)stBuf.st_mtime, (long long)stBuf.st_size);
+		variant = digest;
+		fileName = fileNameStr;
+		diskPath = std::string(s_diskCachePath) + "/" + fileName;
+		g_free(fileNameStr);
+		g_free(digest);
+		g_free(variantStr);
+	}
+
+	bool fromDisk = false;
+	size_t storedBytes = 0;
+	QImage img = loadOrCreate(iconPath, diskPath, width, height, desaturated, fromDisk, storedBytes);
+	if (!img.isNull()) {
+		MutexLocker locker(&m_mutex);
+		insert(key, img);
+		if (fromDisk)
+			diskEntryUsed(variant);
+		else if (storedBytes)
+			diskEntryStored(variant, fileName, storedBytes);
+	}
+	return img;
+}
+
+QImage IconCache::loadOrCreate(const std::string& iconPath,const std::string& diskPath,int width,int height,bool desaturated,
+							   bool& r_fromDisk,size_t& r_storedBytes)
+{
+	QImage img;
+	if (!diskPath.empty() && img.load(qFromUtf8Stl(diskPath), "PNG")) {
+		r_fromDisk = true;
+		return img;
+	}
+
+	if (!img.load(qFromUtf8Stl(iconPath)))
+		return QImage();
+
+	if (width > 0 || height > 0)
+		img = img.scaled(width > 0 ? width : img.width(), height > 0 ? height : img.height(),
+						 Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+
+	if (desaturated)
+		desaturate(img);
+
+	if (!diskPath.empty()) {
+		//write next to it and rename, so a reader never sees a partial file. The temp name is unique since two threads may
+		//be making the same variant
+		gchar* tmpPath = g_strdup_printf("%s.tmp.XXXXXX", diskPath.c_str());
+		int fd = g_mkstemp(tmpPath);
+		if (fd >= 0) {
+			::close(fd);
+			struct stat stBuf;
+			if (img.save(QString::fromUtf8(tmpPath), "PNG") && ::stat(tmpPath, &stBuf) == 0
+				&& ::rename(tmpPath, diskPath.c_str()) == 0)
+				r_storedBytes = stBuf.st_size;
+			else
+				::unlink(tmpPath);
+		}
+		g_free(tmpPath);
+	}
+
+	return img;
+}
+
+//builds the disk cache index from the directory, dropping anything that doesn't belong there (temp files left by a crash,
+//files named the way older versions did, superseded variants) and trimming it to the budget
+void IconCache::loadDiskIndex()
+{
+	DIR* dir = ::opendir(s_diskCachePath);
+	if (!dir)
+		return;
+
+	std::vector<std::pair<time_t,std::string> > byAge;	// last use, file name
+	struct dirent* ent;
+	while ((ent = ::readdir(dir)) != NULL) {
+
+		if (ent->d_name[0] == '.')
+			continue;
+
+		std::string fileName = ent->d_name;
+		std::string path = std::string(s_diskCachePath) + "/" + fileName;
+		std::string::size_type dash = fileName.find('-');
+		struct stat stBuf;
+		if (dash != 32 || fileName.size() < 4 || fileName.compare(fileName.size() - 4, 4, ".png") != 0
+			|| ::stat(path.c_str(), &stBuf) != 0 || !S_ISREG(stBuf.st_mode)) {
+			::unlink(path.c_str());
+			continue;
+		}
+		byAge.push_back(std::make_pair(stBuf.st_mtime, fileName));
+	}
+	::closedir(dir);
+
+	//oldest first; a later file for the same variant supersedes an earlier one
+	std::sort(byAge.begin(), byAge.end());
+	for (std::vector<std::pair<time_t,std::string> >::const_iterator it = byAge.begin(); it != byAge.end(); ++it) {
+		struct stat stBuf;
+		std::string path = std::string(s_diskCachePath) + "/" + it->second;
+		if (::stat(path.c_str(), &stBuf) == 0)
+			diskEntryStored(it->second.substr(0, 32), it->second, stBuf.st_size);
+	}
+
+	g_message("%s: %d scaled icons (%d bytes) in %s", __FUNCTION__, (int)m_diskEntries.size(), (int)m_diskBytes, s_diskCachePath);
+}
+
+///BE SURE TO EXTERNALLY LOCK m_mutex!!!
+void IconCache::diskEntryUsed(const std::string& variant)
+{
+	std::map<std::string,DiskEntry>::iterator it = m_diskEntries.find(variant);
+	if (it == m_diskEntries.end())
+		return;
+
+	m_diskLru.splice(m_diskLru.begin(), m_diskLru, it->second.lruPos);
+	//the mtime carries the LRU order across restarts
+	std::string path = std::string(s_diskCachePath) + "/" + it->second.fileName;
+	::utime(path.c_str(), NULL);
+}
+
+///BE SURE TO EXTERNALLY LOCK m_mutex!!!
+void IconCache::diskEntryStored(const std::string& variant,const std::string& fileName,size_t bytes)
+{
+	std::map<std::string,DiskEntry>::iterator it = m_diskEntries.find(variant);
+	if (it != m_diskEntries.end()) {
+		if (it->second.fileName == fileName) {
+			//same file written again (two threads made the same variant)
+			m_diskBytes -= it->second.bytes;
+			it->second.bytes = bytes;
+			m_diskBytes += bytes;
+			m_diskLru.splice(m_diskLru.begin(), m_diskLru, it->second.lruPos);
+			return;
+		}
+		//made from an older (or newer) version of the icon file; it will never be asked for again
+		removeDiskEntry(it);
+	}
+
+	m_diskLru.push_front(variant);
+	DiskEntry& entry = m_diskEntries[variant];
+	entry.fileName = fileName;
+	entry.bytes = bytes;
+	entry.lruPos = m_diskLru.begin();
+	m_diskBytes += bytes;
+
+	while (m_diskBytes > s_diskBudget && m_diskLru.size() > 1)
+		removeDiskEntry(m_diskEntries.find(m_diskLru.back()));
+}
+
+///BE SURE TO EXTERNALLY LOCK m_mutex!!!
+void IconCache::removeDiskEntry(std::map<std::string,DiskEntry>::iterator it)
+{
+	std::string path = std::string(s_diskCachePath) + "/" + it->second.fileName;
+	::unlink(path.c_str());
+	m_diskBytes -= it->second.bytes;
+	m_diskLru.erase(it->second.lruPos);
+	m_diskEntries.erase(it);
+}
+
+///BE SURE TO EXTERNALLY LOCK m_mutex!!!
+void IconCache::insert(const std::string& key,const QImage& image)
+{
+	if (m_entries.find(key) != m_entries.end())
+		return;			//another thread got here first
+
+	size_t bytes = image.sizeInBytes();
+	if (bytes > s_memoryBudget)
+		return;
+
+	m_lru.push_front(key);
+	Entry& entry = m_entries[key];
+	entry.image = image;
+	entry.bytes = bytes;
+	entry.lruPos = m_lru.begin();
+	m_bytes += bytes;
+
+	while (m_bytes > s_memoryBudget && !m_lru.empty()) {
+		std::map<std::string,Entry>::iterator it = m_entries.find(m_lru.back());
+		m_bytes -= it->second.bytes;
+		m_entries.erase(it);
+		m_lru.pop_back();
+	}
+}
@@ -0,0 +1,96 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+
+
+#ifndef ICONCACHE_H_
+#define ICONCACHE_H_
+
+#include "Common.h"
+
+#include <string>
+#include <list>
+#include <map>
+#include <QImage>
+
+#include "Mutex.h"
+
+/*
+ * IconCache hands out decoded (and optionally scaled and/or desaturated) icon images so that LaunchPoint::icon() and
+ * ApplicationDescription::miniIcon() don't have to decode the PNG from disk on every call.
+ *
+ * Entries are keyed by (path, mtime, size of the file, target size, desaturated), so a changed icon file is simply a different
+ * key. Decoded images are kept in memory up to a byte budget, least recently used first out. Scaled variants are also written
+ * to a disk cache directory, so after a restart they can be loaded without decoding and scaling the full size original again.
+ * The disk cache holds at most one file per (path, target size, desaturated) - storing a variant made from a newer icon file
+ * replaces the old one - and has its own byte budget, also least recently used first out (a file's mtime is its last use).
+ */
+class IconCache
+{
+public:
+
+	static IconCache* instance();
+
+	// width/height 0 returns the image at its own size. Returns a null image if iconPath can't be loaded
+	QImage image(const std::string& iconPath,int width = 0,int height = 0,bool desaturated = false);
+
+	static void desaturate(QImage& img);
+
+private:
+
+	IconCache();
+	~IconCache();
+
+	struct Entry {
+		QImage image;
+		size_t bytes;
+		std::list<std::string>::iterator lruPos;
+	};
+
+	struct DiskEntry {
+		std::string fileName;
+		size_t bytes;
+		std::list<std::string>::iterator lruPos;
+	};
+
+	QImage loadOrCreate(const std::string& iconPath,const std::string& diskPath,int width,int height,bool desaturated,
+						bool& r_fromDisk,size_t& r_storedBytes);
+	void insert(const std::string& key,const QImage& image);
+
+	void loadDiskIndex();
+	void diskEntryUsed(const std::string& variant);
+	void diskEntryStored(const std::string& variant,const std::string& fileName,size_t bytes);
+	void removeDiskEntry(std::map<std::string,DiskEntry>::iterator it);
+
+	static const size_t s_memoryBudget;
+	static const size_t s_diskBudget;
+
+	Mutex m_mutex;
+	std::map<std::string,Entry> m_entries;
+	std::list<std::string> m_lru;		// most recently used first
+	size_t m_bytes;
+	bool m_diskCacheReady;
+
+	// variant (digest of path, target size, desaturated) -> the one file holding it
+	std::map<std::string,DiskEntry> m_diskEntries;
+	std::list<std::string> m_diskLru;	// most recently used first
+	size_t m_diskBytes;
+};
+
+#endif /* ICONCACHE_H_ */
@@ -33,6 +33,9 @@
 #include "Utils.h"
 #include "Settings.h"
 #include "Localization.h"
+#include "RegistrySnapshot.h"
+#include "LaunchPointJournal.h"
+#include "IconCache.h"
 //MDK-LAUNCHER #include "CardLayout.h"
 
 const char* localFileURI = "file://";
@@ -61,18 +64,12 @@ bool LaunchPoint::toFile() const
 	if (!isRemovable() || isDefault())
 		return false;
 
-	// dynamic launch points have appinfo files named by their launchpointid's
-	std::string	filePath = Settings::LunaSettings()->lunaLaunchPointsPath;
-	if (filePath[filePath.size()-1] != '/')
-		filePath += "/";
-	filePath += launchPointId();
-
-	// persist a launch points appinfo
+	// dynamic launch points are kept in the launch point journal, keyed by their launchpointid's
 	json_object* json = toJSON();
-	int res = json_object_to_file((char*)filePath.c_str(), json);
+	bool res = LaunchPointJournal::instance()->put(launchPointId(), json_object_to_json_string(json));
 	if (json)
 		json_object_put(json);
-	return res != -1;
+	return res;
 }
 
 LaunchPoint* LaunchPoint::fromJSON(ApplicationDescription* appDesc,
@@ -158,15 +155,24 @@ LaunchPoint::LaunchPoint(ApplicationDescription* appDesc,
 	if (m_iconPath.compare(0, 7, localFileURI) == 0) {
 		m_iconPath.erase(0, 7);
 	}
-	QImage icon;
-    icon.load(qFromUtf8Stl(m_iconPath));
-	if (icon.isNull()) {
-		// load a default image
-		m_iconPath = Settings::LunaSettings()->lunaSystemResourcesPath + "/default-app-icon.png";
-//		icon.load(qFromUtf8Stl(m_iconPath));
-//		if (m_icon.isNull())
-//			g_warning("%s: Failed to load application icon for app %s (original: %s, default: %s)",
-//					__PRETTY_FUNCTION__, id.c_str(), iconPath.c_str(), m_iconPath.c_str());
+	RegistrySnapshot::FileStamp iconStamp;
+	if (!RegistrySnapshot::instance()->isKnownGoodIcon(m_iconPath,iconStamp)) {
+		QImage icon;
+		icon.load(qFromUtf8Stl(m_iconPath));
+		if (icon.isNull()) {
+			// load a default image
+			m_iconPath = Settings::LunaSettings()->lunaSystemResourcesPath + "/default-app-icon.png";
+//			icon.load(qFromUtf8Stl(m_iconPath));
+//			if (m_icon.isNull())
+//				g_warning("%s: Failed to load application icon for app %s (original: %s, default: %s)",
+//						__PRETTY_FUNCTION__, id.c_str(), iconPath.c_str(), m_iconPath.c_str());
+		}
+		else {
+			RegistrySnapshot::instance()->recordGoodIcon(m_iconPath,iconStamp);
+		}
+	}
+	else {
+		RegistrySnapshot::instance()->recordGoodIcon(m_iconPath,iconStamp);
 	}
 
 	m_title.set(title);
@@ -314,8 +320,5 @@ json_object* LaunchPoint::toJSON() const
 QPixmap LaunchPoint::icon() const
 {
 	//get size of icon from launcher settings!
-	return QPixmap::fromImage(QImage(qFromUtf8Stl(m_iconPath)).scaled(DEFAULT_ICON_W,
-																	DEFAULT_ICON_H,
-																	Qt::IgnoreAspectRatio,
-																	Qt::SmoothTransformation));
+	return QPixmap::fromImage(IconCache::instance()->image(m_iconPath, DEFAULT_ICON_W, DEFAULT_ICON_H));
 }
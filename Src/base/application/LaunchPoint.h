@@ -41,6 +41,9 @@ public:
 
 	static LaunchPoint* fromFile(ApplicationDescription* appDesc,
 								 const std::string& filePath);
+	static LaunchPoint* fromJSON(ApplicationDescription* appDesc,
+								 const char* jsonStr,
+								 const std::string& launchPointId);
 
 	LaunchPoint(ApplicationDescription* appDesc,
 				const std::string& id,
@@ -77,6 +80,7 @@ public:
 	std::string entryPoint() const;
 
 	bool matchesTitle(const gchar* str) const;
+	const gchar* lowercaseTitle() const			{ return m_title.lowercase; }
 	int compareByKeys(const LaunchPoint* lp) const;
 
 	bool				isVisible() const;
@@ -113,10 +117,6 @@ private:
 		gchar* keyed;			// a keyed version used for fast sorting
 	};
 
-	static LaunchPoint* fromJSON(ApplicationDescription* appDesc,
-								 const char* jsonStr,
-								 const std::string& launchPointId);
-
 	bool toFile() const;
 
 	ApplicationDescription* m_appDesc;
@@ -0,0 +1,383 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+
+
+#include "Common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <json.h>
+
+#include "LaunchPointJournal.h"
+#include "MutexLocker.h"
+#include "Utils.h"
+
+static const char* s_journalName = ".launchpoints.journal";
+static const guint s_syncDelaySecs = 2;
+static const unsigned int s_minRecordsBeforeCompaction = 64;
+
+static LaunchPointJournal* s_instance = 0;
+
+static bool isLaunchPointId(const char* str)
+{
+	if (!str || !*str)
+		return false;
+	for (; *str; ++str) {
+		if (*str < '0' || *str > '9')
+			return false;
+	}
+	return true;
+}
+
+static bool writeAll(int fd,const std::string& buf)
+{
+	const char* p = buf.data();
+	size_t remaining = buf.size();
+	while (remaining) {
+		ssize_t n = ::write(fd,p,remaining);
+		if (n <= 0)
+			return false;
+		p += n;
+		remaining -= n;
+	}
+	return true;
+}
+
+//makes a rename() into dirPath durable
+static void syncDirectory(const std::string& dirPath)
+{
+	int fd = ::open(dirPath.c_str(),O_RDONLY | O_DIRECTORY);
+	if (fd < 0)
+		return;
+	fsync(fd);
+	::close(fd);
+}
+
+LaunchPointJournal* LaunchPointJournal::instance()
+{
+	if (!s_instance)
+		s_instance = new LaunchPointJournal();
+	return s_instance;
+}
+
+LaunchPointJournal::LaunchPointJournal()
+	: m_fd(-1)
+	, m_dirty(false)
+	, m_syncTimer(0)
+	, m_records(0)
+	, m_nextId(1)
+{
+}
+
+LaunchPointJournal::~LaunchPointJournal()
+{
+	sync();
+	if (m_fd >= 0)
+		::close(m_fd);
+}
+
+bool LaunchPointJournal::open(const std::string& launchPointFolder,std::map<std::string,std::string>& r_entries)
+{
+	MutexLocker locker(&m_mutex);
+
+	m_folder = launchPointFolder;
+	if (!m_folder.empty() && m_folder[m_folder.size() - 1] != '/')
+		m_folder += "/";
+	m_journalPath = m_folder + s_journalName;
+
+	if (m_fd >= 0)
+		::close(m_fd);
+	m_fd = -1;
+	m_entries.clear();
+	m_records = 0;
+
+	off_t validLength = -1;
+	load(validLength);
+	bool tornTail = (validLength >= 0);
+
+	std::vector<std::string> migratedFiles;
+	migrateLaunchPointFiles(migratedFiles);
+
+	//after a migration, if the journal is mostly garbage, or if it ends in a partial record (which the next append would
+	//otherwise be glued onto), start from a fresh file
+	bool success = true;
+	if (tornTail || !migratedFiles.empty() || m_records > 2 * m_entries.size() + s_minRecordsBeforeCompaction)
+		success = compact();
+
+	if (!success && tornTail && ::truncate(m_journalPath.c_str(),validLength) != 0)
+		g_warning("%s: unable to cut the partial record off %s",__FUNCTION__,m_journalPath.c_str());
+
+	if (success) {
+		//the launch points are in the (fsync'ed) journal now
+		for (std::vector<std::string>::const_iterator it = migratedFiles.begin(); it != migratedFiles.end(); ++it)
+			::unlink(it->c_str());
+		if (!migratedFiles.empty())
+			g_message("%s: migrated %d launch point files into %s",__FUNCTION__,(int)migratedFiles.size(),m_journalPath.c_str());
+	}
+
+	if (m_fd < 0)
+		m_fd = ::open(m_journalPath.c_str(),O_WRONLY | O_APPEND | O_CREAT,0644);
+	if (m_fd < 0) {
+		g_warning("%s: unable to open %s",__FUNCTION__,m_journalPath.c_str());
+		success = false;
+	}
+
+	r_entries = m_entries;
+	return success;
+}
+
+//r_validLength is set to the length of the valid part of the journal if it ends in a partial record, left alone otherwise
+bool LaunchPointJournal::load(off_t& r_validLength)
+{
+	struct stat stBuf;
+	if (::stat(m_journalPath.c_str(),&stBuf) != 0)
+		return false;
+
+	char* data = readFile(m_journalPath.c_str());
+	if (!data)
+		return false;
+
+	char* line = data;
+	while (*line) {
+
+		char* end = strchr(line,'\n');
+		if (!end)
+			break;				//torn last record
+		*end = '\0';
+
+		char* op = line;
+		char* id = strchr(op,' ');
+		char* json = 0;
+		if (id) {
+			*id++ = '\0';
+			json = strchr(id,' ');
+			if (json)
+				*json++ = '\0';
+		}
+
+		if (id && isLaunchPointId(id)) {
+			if (strcmp(op,"put") == 0 && json && *json) {
+				m_entries[id] = json;
+				noteId(id);
+				++m_records;
+			}
+			else if (strcmp(op,"del") == 0) {
+				m_entries.erase(id);
+				noteId(id);
+				++m_records;
+			}
+		}
+
+		line = end + 1;
+	}
+
+	//everything past the last newline (a partial record, or the zeroes some filesystems leave after a crash) is garbage
+	off_t validLength = line - data;
+	if (validLength != stBuf.st_size) {
+		g_warning("%s: %s ends in a partial record (%ld of %ld bytes are valid)",__FUNCTION__,m_journalPath.c_str(),
+				  (long)validLength,(long)stBuf.st_size);
+		r_validLength = validLength;
+	}
+
+	delete [] data;
+	return true;
+}
+
+void LaunchPointJournal::migrateLaunchPointFiles(std::vector<std::string>& r_migratedFiles)
+{
+	struct dirent** list = NULL;
+	int count = ::scandir(m_folder.c_str(),&list,0,0);
+	if (count < 0)
+		return;
+
+	for (int i = 0; i < count; i++) {
+
+		if (!list[i])
+			continue;
+
+		//the launch point files were named by their (numeric) launch point id
+		if (isLaunchPointId(list[i]->d_name)) {
+
+			std::string id = list[i]->d_name;
+			std::string filePath = m_folder + id;
+			char* jsonStr = readFile(filePath.c_str());
+			json_object* root = jsonStr ? json_tokener_parse(jsonStr) : 0;
+			if (root) {
+				//the journal copy wins if both exist (e.g. a crash between writing the journal and removing the file)
+				if (m_entries.find(id) == m_entries.end())
+					m_entries[id] = json_object_to_json_string(root);
+				noteId(id);
+				r_migratedFiles.push_back(filePath);
+				json_object_put(root);
+			}
+			else {
+				g_warning("%s: ignoring unparsable launch point file %s",__FUNCTION__,filePath.c_str());
+			}
+			delete [] jsonStr;
+		}
+
+		free(list[i]);
+	}
+	free(list);
+}
+
+void LaunchPointJournal::noteId(const std::string& launchPointId)
+{
+	unsigned long id = strtoul(launchPointId.c_str(),0,10);
+	if (id >= m_nextId)
+		m_nextId = id + 1;
+}
+
+std::string LaunchPointJournal::allocateId()
+{
+	MutexLocker locker(&m_mutex);
+
+	char numStr[24];
+	snprintf(numStr,sizeof(numStr),"%08lu",m_nextId++);
+	return std::string(numStr);
+}
+
+bool LaunchPointJournal::put(const std::string& launchPointId,const std::string& json)
+{
+	MutexLocker locker(&m_mutex);
+
+	//json_object_to_json_string() never emits raw newlines, so one record is always one line
+	if (json.find('\n') != std::string::npos)
+		return false;
+
+	if (!append("put " + launchPointId + " " + json + "\n"))
+		return false;
+
+	m_entries[launchPointId] = json;
+	noteId(launchPointId);
+	if (m_records > 2 * m_entries.size() + s_minRecordsBeforeCompaction)
+		compact();
+	return true;
+}
+
+bool LaunchPointJournal::remove(const std::string& launchPointId)
+{
+	MutexLocker locker(&m_mutex);
+
+	if (m_entries.find(launchPointId) == m_entries.end())
+		return false;
+
+	if (!append("del " + launchPointId + "\n"))
+		return false;
+
+	m_entries.erase(launchPointId);
+	if (m_records > 2 * m_entries.size() + s_minRecordsBeforeCompaction)
+		compact();
+	return true;
+}
+
+bool LaunchPointJournal::append(const std::string& record)
+{
+	if (m_fd < 0) {
+		g_warning("%s: journal is not open",__FUNCTION__);
+		return false;
+	}
+
+	//m_mutex serializes the appends, so this is where the record will start
+	off_t offset = ::lseek(m_fd,0,SEEK_END);
+	if (!writeAll(m_fd,record)) {
+		g_warning("%s: unable to write to %s",__FUNCTION__,m_journalPath.c_str());
+		//a partial record left in place would run into the next one and both would be lost on replay. Cut it off; failing that,
+		//rewrite the journal from m_entries (which the record never made it into), and failing that, stop appending
+		//altogether: load() drops a torn last line
+		if (offset < 0 || ::ftruncate(m_fd,offset) != 0) {
+			if (!compact() && m_fd >= 0) {
+				::close(m_fd);
+				m_fd = -1;
+			}
+		}
+		return false;
+	}
+	++m_records;
+
+	m_dirty = true;
+	if (!m_syncTimer)
+		m_syncTimer = g_timeout_add_seconds(s_syncDelaySecs,cbSync,this);
+	return true;
+}
+
+//rewrites the journal with just the live entries; temp file + fsync + rename, so there is always one complete journal on disk
+bool LaunchPointJournal::compact()
+{
+	std::string buf;
+	for (std::map<std::string,std::string>::const_iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+		buf += "put " + it->first + " " + it->second + "\n";
+
+	std::string tmpPath = m_journalPath + ".tmp";
+	int fd = ::open(tmpPath.c_str(),O_WRONLY | O_CREAT | O_TRUNC,0644);
+	if (fd < 0) {
+		g_warning("%s: unable to create %s",__FUNCTION__,tmpPath.c_str());
+		return false;
+	}
+
+	bool success = writeAll(fd,buf) && (fsync(fd) == 0);
+	::close(fd);
+
+	if (!success || ::rename(tmpPath.c_str(),m_journalPath.c_str()) != 0) {
+		g_warning("%s: unable to write %s",__FUNCTION__,m_journalPath.c_str());
+		::unlink(tmpPath.c_str());
+		return false;
+	}
+	//open() unlinks the migrated launch point files once this returns, so the rename has to be on disk first
+	syncDirectory(m_folder);
+
+	if (m_fd >= 0)
+		::close(m_fd);
+	m_fd = ::open(m_journalPath.c_str(),O_WRONLY | O_APPEND,0644);
+	m_records = m_entries.size();
+	m_dirty = false;
+	return m_fd >= 0;
+}
+
+void LaunchPointJournal::sync()
+{
+	MutexLocker locker(&m_mutex);
+
+	if (m_syncTimer) {
+		g_source_remove(m_syncTimer);
+		m_syncTimer = 0;
+	}
+	if (m_dirty && m_fd >= 0)
+		fdatasync(m_fd);
+	m_dirty = false;
+}
+
+gboolean LaunchPointJournal::cbSync(gpointer data)
+{
+	LaunchPointJournal* self = static_cast<LaunchPointJournal*>(data);
+	MutexLocker locker(&self->m_mutex);
+
+	self->m_syncTimer = 0;
+	if (self->m_dirty && self->m_fd >= 0)
+		fdatasync(self->m_fd);
+	self->m_dirty = false;
+	return FALSE;
+}
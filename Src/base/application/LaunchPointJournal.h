@@ -0,0 +1,91 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+
+
+#ifndef LAUNCHPOINTJOURNAL_H_
+#define LAUNCHPOINTJOURNAL_H_
+
+#include "Common.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <glib.h>
+#include <sys/types.h>
+
+#include "Mutex.h"
+
+/*
+ * LaunchPointJournal persists the dynamic (addLaunchPoint) launch points in one append-only file in the launch point folder,
+ * instead of one JSON file per launch point:
+ *
+ *   put <launchPointId> <launch point json>\n
+ *   del <launchPointId>\n
+ *
+ * The journal is read sequentially once at startup; a torn last line (crash while appending) is ignored, and the journal is
+ * then rewritten without it before anything is appended. An append that fails partway is truncated off again (or the journal
+ * rewritten), so no record is ever written after a fragment. Appends are written right away but fsync'ed in batches, and the
+ * file is rewritten with only the live entries once it has accumulated enough superseded records. Launch point ids are handed
+ * out sequentially.
+ *
+ * Launch points still stored as individual files in the folder (from before the journal) are imported by open(), and their files
+ * removed once the journal holding them is safely on disk.
+ */
+class LaunchPointJournal
+{
+public:
+
+	static LaunchPointJournal* instance();
+
+	// loads (and if necessary migrates) the journal in launchPointFolder; r_entries receives launch point id -> json
+	bool open(const std::string& launchPointFolder,std::map<std::string,std::string>& r_entries);
+
+	std::string allocateId();
+	bool put(const std::string& launchPointId,const std::string& json);
+	bool remove(const std::string& launchPointId);
+
+	// forces pending appends to disk
+	void sync();
+
+private:
+
+	LaunchPointJournal();
+	~LaunchPointJournal();
+
+	bool load(off_t& r_validLength);
+	void migrateLaunchPointFiles(std::vector<std::string>& r_migratedFiles);
+	bool append(const std::string& record);
+	bool compact();
+	void noteId(const std::string& launchPointId);
+
+	static gboolean cbSync(gpointer data);
+
+	mutable Mutex m_mutex;
+	std::string m_folder;
+	std::string m_journalPath;
+	int m_fd;
+	bool m_dirty;
+	guint m_syncTimer;
+	unsigned int m_records;
+	unsigned long m_nextId;
+	std::map<std::string,std::string> m_entries;
+};
+
+#endif /* LAUNCHPOINTJOURNAL_H_ */
@@ -24,6 +24,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <json.h>
 #include <json_util.h>
@@ -42,6 +45,22 @@ uint32_t MimeSystem::s_lastAssignedIndex = 0;
 std::vector<uint32_t> MimeSystem::s_indexRecycler;
 Mutex 		MimeSystem::s_mutex;
 
+static const size_t s_resolutionCacheSize = 256;
+static const size_t s_resolutionCacheMaxKeyLength = 1024;
+
+//the tables are keyed by lowercase mime types and extensions. Most queries already are lowercase, and then this doesn't copy
+static const std::string& lowercased(const std::string& s,std::string& r_buf)
+{
+	std::string::size_type i = 0;
+	while (i < s.size() && !isupper((unsigned char)s[i]))
+		++i;
+	if (i == s.size())
+		return s;
+	r_buf = s;
+	std::transform(r_buf.begin() + i, r_buf.end(), r_buf.begin() + i, tolower);
+	return r_buf;
+}
+
 // ---------------------------------------------------------------------------------------------------------------------
 // --------------------------------------------------- public ----------------------------------------------------------
 // ---------------------------------------------------------------------------------------------------------------------
@@ -107,7 +126,7 @@ int MimeSystem::RedirectHandlerNode::removeAppId(const std::string& appId)
 int MimeSystem::RedirectHandlerNode::removeVerb(const std::string& verb,RedirectHandler& handler)
 {
 	//get the verbcacheentry from the map
-	std::map<std::string,VerbCacheEntry>::iterator it = m_verbCache.find(verb);
+	VerbCacheMapIterType it = m_verbCache.find(verb);
 	if (it == m_verbCache.end())
 		return RC_HANDLERNODE_REMOVEVERB_NOSUCHVERB;
 	
@@ -145,7 +164,7 @@ int MimeSystem::RedirectHandlerNode::removeAllVerbsOfHandler(RedirectHandler& ha
 
 bool MimeSystem::RedirectHandlerNode::isCurrentVerbHandler(const std::string& verb,RedirectHandler& handler)
 {
-	std::map<std::string,VerbCacheEntry>::iterator it = m_verbCache.find(verb);
+	VerbCacheMapIterType it = m_verbCache.find(verb);
 	if (it == m_verbCache.end())
 		return false;		//no such verb
 	
@@ -182,7 +201,7 @@ bool MimeSystem::RedirectHandlerNode::reassignRandomVerbHandler(const std::strin
 	if (!pickRandomVerbHandler(verb,newHandlerIndex))
 		return false;
 	
-	std::map<std::string,VerbCacheEntry>::iterator it = m_verbCache.find(verb);
+	VerbCacheMapIterType it = m_verbCache.find(verb);
 	if (it == m_verbCache.end())
 		return false;
 	
@@ -248,7 +267,7 @@ struct json_object * MimeSystem::RedirectHandlerNode::toJson() 		//WARNING: memo
 	}
 	if (m_verbCache.size()) {
 		struct json_object * jarray = json_object_new_array();
-		for (std::map<std::string,VerbCacheEntry>::iterator it = m_verbCache.begin();it != m_verbCache.end();++it) {
+		for (VerbCacheMapIterType it = m_verbCache.begin();it != m_verbCache.end();++it) {
 			struct json_object * innerVerbObject = json_object_new_object();
 			json_object_object_add(innerVerbObject,(char *)"verb",json_object_new_string(it->first.c_str()));
 			json_object_object_add(innerVerbObject,(char *)"index",json_object_new_int(it->second.activeIndex));
@@ -389,7 +408,7 @@ int MimeSystem::RedirectHandlerNode::fixupVerbCacheTable(struct json_object * js
 	it != verbs.end();++it) 
 	{
 		//locate the VerbCacheEntry correspoding to the key in the verb iterator
-		std::map<std::string,VerbCacheEntry>::iterator search_it = m_verbCache.find(it->first);
+		VerbCacheMapIterType search_it = m_verbCache.find(it->first);
 		if (search_it == m_verbCache.end()) {
 			//oops, didn't find it. This is a pretty serious error (means that the addition of verbs failed and/or the VCE table in the json entry is corrupt)
 			//try to recover by ignoring it
@@ -484,7 +503,7 @@ int MimeSystem::ResourceHandlerNode::swapHandler(uint32_t index)
 int MimeSystem::ResourceHandlerNode::removeVerb(const std::string& verb,ResourceHandler& handler)
 {
 	//get the verbcacheentry from the map
-	std::map<std::string,VerbCacheEntry>::iterator it = m_verbCache.find(verb);
+	VerbCacheMapIterType it = m_verbCache.find(verb);
 	if (it == m_verbCache.end())
 		return RC_HANDLERNODE_REMOVEVERB_NOSUCHVERB;
 
@@ -520,7 +539,7 @@ int MimeSystem::ResourceHandlerNode::removeAllVerbsOfHandler(ResourceHandler& ha
 
 bool MimeSystem::ResourceHandlerNode::isCurrentVerbHandler(const std::string& verb,ResourceHandler& handler)
 {
-	std::map<std::string,VerbCacheEntry>::iterator it = m_verbCache.find(verb);
+	VerbCacheMapIterType it = m_verbCache.find(verb);
 	if (it == m_verbCache.end())
 		return false;		//no such verb
 	
@@ -557,7 +576,7 @@ bool MimeSystem::ResourceHandlerNode::reassignRandomVerbHandler(const std::strin
 	if (!pickRandomVerbHandler(verb,newHandlerIndex))
 		return false;
 	
-	std::map<std::string,VerbCacheEntry>::iterator it = m_verbCache.find(verb);
+	VerbCacheMapIterType it = m_verbCache.find(verb);
 	if (it == m_verbCache.end())
 		return false;
 	
@@ -595,7 +614,7 @@ struct json_object * MimeSystem::ResourceHandlerNode::toJson() 		//WARNING: memo
 	}
 	if (m_verbCache.size()) {
 		struct json_object * jarray = json_object_new_array();
-		for (std::map<std::string,VerbCacheEntry>::iterator it = m_verbCache.begin();it != m_verbCache.end();++it) {
+		for (VerbCacheMapIterType it = m_verbCache.begin();it != m_verbCache.end();++it) {
 			json_object * innerVerbObject = json_object_new_object();
 			json_object_object_add(innerVerbObject,(char *)"verb",json_object_new_string(it->first.c_str()));
 			json_object_object_add(innerVerbObject,(char *)"index",json_object_new_int(it->second.activeIndex));
@@ -763,7 +782,7 @@ int MimeSystem::ResourceHandlerNode::fixupVerbCacheTable(struct json_object * js
 			it != verbs.end();++it) 
 	{
 		//locate the VerbCacheEntry correspoding to the key in the verb iterator
-		std::map<std::string,VerbCacheEntry>::iterator search_it = m_verbCache.find(it->first);
+		VerbCacheMapIterType search_it = m_verbCache.find(it->first);
 		if (search_it == m_verbCache.end()) {
 			//oops, didn't find it. This is a pretty serious error (means that the addition of verbs failed and/or the VCE table in the json entry is corrupt)
 			//try to recover by ignoring it
@@ -776,6 +795,296 @@ int MimeSystem::ResourceHandlerNode::fixupVerbCacheTable(struct json_object * js
 	return rc;
 }
 
+static void closeLiteralRun(std::string& run,bool& inPrefix,std::string& r_prefix,std::string& r_literal)
+{
+	if (inPrefix) {
+		r_prefix = run;
+		inPrefix = false;
+	}
+	else if (run.size() > r_literal.size()) {
+		r_literal = run;
+	}
+	run.clear();
+}
+
+/*
+ * Works out what literal text any url matching the (POSIX extended) urlRe has to have: r_prefix is what it must start with, r_literal
+ * the longest other run of literal characters it must contain. Only the top level of the pattern is considered; anything inside a
+ * group, or any pattern with a top level alternation, contributes nothing. Both come out empty when nothing can be said
+ */
+//static
+void MimeSystem::RedirectMatcher::analyzePattern(const std::string& urlRe,std::string& r_prefix,std::string& r_literal)
+{
+	r_prefix.clear();
+	r_literal.clear();
+
+	std::string run;
+	bool inPrefix = (!urlRe.empty() && urlRe[0] == '^');
+	int depth = 0;
+	std::string::size_type i = (inPrefix ? 1 : 0);
+
+	while (i < urlRe.size()) {
+
+		char c = urlRe[i];
+		char lit = 0;
+		std::string::size_type len = 1;
+
+		if (c == '\\') {
+			if (i+1 >= urlRe.size())
+				goto Bail;				//not a valid pattern anyway
+			if (isalnum((unsigned char)urlRe[i+1])) {
+				//\w, \b and friends (GNU extensions) aren't literals
+				closeLiteralRun(run,inPrefix,r_prefix,r_literal);
+				i += 2;
+				continue;
+			}
+			lit = urlRe[i+1];
+			len = 2;
+		}
+		else if (c == '[') {
+			//bracket expression: one character out of a set. Skip to its closing ] (a ] right after [ or [^ is part of the set)
+			std::string::size_type j = i+1;
+			if (j < urlRe.size() && urlRe[j] == '^')
+				++j;
+			if (j < urlRe.size() && urlRe[j] == ']')
+				++j;
+			while (j < urlRe.size() && urlRe[j] != ']') {
+				if (urlRe[j] == '[' && j+1 < urlRe.size() && (urlRe[j+1] == ':' || urlRe[j+1] == '.' || urlRe[j+1] == '=')) {
+					std::string::size_type k = urlRe.find(std::string(1,urlRe[j+1])+"]",j+2);
+					if (k == std::string::npos)
+						goto Bail;
+					j = k+2;
+					continue;
+				}
+				++j;
+			}
+			if (j >= urlRe.size())
+				goto Bail;
+			if (depth == 0)
+				closeLiteralRun(run,inPrefix,r_prefix,r_literal);
+			i = j+1;
+			continue;
+		}
+		else if (c == '{') {
+			//interval; like * and ? it already ended the run (see below)
+			std::string::size_type j = urlRe.find('}',i+1);
+			if (j == std::string::npos)
+				goto Bail;
+			i = j+1;
+			continue;
+		}
+		else if (c == '(') {
+			if (depth == 0)
+				closeLiteralRun(run,inPrefix,r_prefix,r_literal);
+			++depth;
+			++i;
+			continue;
+		}
+		else if (c == ')') {
+			if (--depth < 0)
+				goto Bail;
+			++i;
+			continue;
+		}
+		else if (c == '|') {
+			if (depth == 0)
+				goto Bail;				//top level alternation; every branch would have to be analyzed on its own
+			++i;
+			continue;
+		}
+		else if (c == '.' || c == '*' || c == '+' || c == '?' || c == '^' || c == '$') {
+			if (depth == 0)
+				closeLiteralRun(run,inPrefix,r_prefix,r_literal);
+			++i;
+			continue;
+		}
+		else {
+			lit = c;
+		}
+
+		//a literal character...
+		if (depth == 0) {
+			char next = (i+len < urlRe.size() ? urlRe[i+len] : 0);
+			if (next == '*' || next == '?' || next == '{') {
+				//...that's optional
+				closeLiteralRun(run,inPrefix,r_prefix,r_literal);
+			}
+			else if (next == '+') {
+				//...that's required but may repeat
+				run += tolower((unsigned char)lit);
+				closeLiteralRun(run,inPrefix,r_prefix,r_literal);
+			}
+			else {
+				run += tolower((unsigned char)lit);
+			}
+		}
+		i += len;
+	}
+
+	if (depth != 0)
+		goto Bail;
+	closeLiteralRun(run,inPrefix,r_prefix,r_literal);
+	return;
+
+Bail:
+	r_prefix.clear();
+	r_literal.clear();
+}
+
+/*
+ * True if urlRe is nothing but "^<scheme>:", i.e. it matches exactly the urls whose scheme is r_scheme (lowercased)
+ */
+//static
+bool MimeSystem::RedirectMatcher::schemeOfPattern(const std::string& urlRe,std::string& r_scheme)
+{
+	r_scheme.clear();
+	if (urlRe.size() < 3 || urlRe[0] != '^' || urlRe[urlRe.size()-1] != ':')
+		return false;
+
+	for (std::string::size_type i = 1; i < urlRe.size()-1; ++i) {
+		char c = urlRe[i];
+		if (c == '\\' && i+1 < urlRe.size()-1 && (urlRe[i+1] == '.' || urlRe[i+1] == '+' || urlRe[i+1] == '-'))
+			c = urlRe[++i];
+		else if (!(isalnum((unsigned char)c) || c == '-'))
+			break;
+		if (r_scheme.empty() && !isalpha((unsigned char)c))
+			break;
+		r_scheme += tolower((unsigned char)c);
+		if (i == urlRe.size()-2)
+			return true;
+	}
+	r_scheme.clear();
+	return false;
+}
+
+void MimeSystem::RedirectMatcher::add(const std::string& urlRe,RedirectHandlerNode * p_node)
+{
+	remove(urlRe);
+
+	Entry& entry = m_entries[urlRe];
+	entry.p_node = p_node;
+
+	if (schemeOfPattern(urlRe,entry.scheme)) {
+		m_byScheme[entry.scheme][urlRe] = &entry;
+		return;
+	}
+
+	analyzePattern(urlRe,entry.prefix,entry.literal);
+	m_byPrefix[entry.prefix][urlRe] = &entry;
+	++m_prefixLengths[entry.prefix.size()];
+}
+
+void MimeSystem::RedirectMatcher::remove(const std::string& urlRe)
+{
+	std::map<std::string,Entry>::iterator it = m_entries.find(urlRe);
+	if (it == m_entries.end())
+		return;
+
+	if (!it->second.scheme.empty()) {
+		std::map<std::string,std::map<std::string,const Entry *> >::iterator scheme_it = m_byScheme.find(it->second.scheme);
+		if (scheme_it != m_byScheme.end()) {
+			scheme_it->second.erase(urlRe);
+			if (scheme_it->second.empty())
+				m_byScheme.erase(scheme_it);
+		}
+		m_entries.erase(it);
+		return;
+	}
+
+	const std::string& prefix = it->second.prefix;
+	std::map<std::string,std::map<std::string,const Entry *> >::iterator prefix_it = m_byPrefix.find(prefix);
+	if (prefix_it != m_byPrefix.end()) {
+		prefix_it->second.erase(urlRe);
+		if (prefix_it->second.empty())
+			m_byPrefix.erase(prefix_it);
+	}
+	std::map<size_t,int>::iterator len_it = m_prefixLengths.find(prefix.size());
+	if (len_it != m_prefixLengths.end() && --(len_it->second) <= 0)
+		m_prefixLengths.erase(len_it);
+
+	m_entries.erase(it);
+}
+
+void MimeSystem::RedirectMatcher::clear()
+{
+	m_byScheme.clear();
+	m_byPrefix.clear();
+	m_prefixLengths.clear();
+	m_entries.clear();
+}
+
+MimeSystem::RedirectHandlerNode * MimeSystem::RedirectMatcher::firstMatch(const std::string& url,Forms forms) const
+{
+	std::vector<RedirectHandlerNode *> matches;
+	match(url,forms,true,matches);
+	return (matches.empty() ? NULL : matches[0]);
+}
+
+void MimeSystem::RedirectMatcher::allMatches(const std::string& url,std::vector<RedirectHandlerNode *>& r_matches) const
+{
+	match(url,AllForms,false,r_matches);
+}
+
+//static
+bool MimeSystem::RedirectMatcher::candidateOrder(const Candidate& a,const Candidate& b)
+{
+	return *(a.first) < *(b.first);
+}
+
+//static
+void MimeSystem::RedirectMatcher::addCandidates(const std::map<std::string,const Entry *>& entries,const std::string& lcUrl,Forms forms,std::vector<Candidate>& r_candidates)
+{
+	for (std::map<std::string,const Entry *>::const_iterator it = entries.begin();it != entries.end();++it) {
+		const Entry * p_entry = it->second;
+		bool schemeForm = p_entry->p_node->m_redirectHandler.isSchemeForm();
+		if ((forms == RedirectForms && schemeForm) || (forms == SchemeForms && !schemeForm))
+			continue;
+		if (!p_entry->literal.empty() && lcUrl.find(p_entry->literal) == std::string::npos)
+			continue;
+		r_candidates.push_back(Candidate(&(it->first),p_entry));
+	}
+}
+
+void MimeSystem::RedirectMatcher::match(const std::string& url,Forms forms,bool firstOnly,std::vector<RedirectHandlerNode *>& r_matches) const
+{
+	if (url.empty())
+		return;
+
+	std::string lcUrl = url;
+	std::transform(lcUrl.begin(), lcUrl.end(), lcUrl.begin(), tolower);
+
+	std::vector<Candidate> candidates;
+
+	std::string::size_type colon = lcUrl.find(':');
+	if (colon != std::string::npos) {
+		std::map<std::string,std::map<std::string,const Entry *> >::const_iterator scheme_it = m_byScheme.find(lcUrl.substr(0,colon));
+		if (scheme_it != m_byScheme.end())
+			addCandidates(scheme_it->second,lcUrl,forms,candidates);
+	}
+
+	for (std::map<size_t,int>::const_iterator len_it = m_prefixLengths.begin();len_it != m_prefixLengths.end();++len_it) {
+		if (len_it->first > lcUrl.size())
+			break;
+		std::map<std::string,std::map<std::string,const Entry *> >::const_iterator prefix_it = m_byPrefix.find(lcUrl.substr(0,len_it->first));
+		if (prefix_it != m_byPrefix.end())
+			addCandidates(prefix_it->second,lcUrl,forms,candidates);
+	}
+
+	//back into m_redirectHandlerMap (i.e. pattern) order
+	std::sort(candidates.begin(),candidates.end(),candidateOrder);
+
+	for (std::vector<Candidate>::iterator it = candidates.begin();it != candidates.end();++it) {
+		const RedirectHandler& handler = it->second->p_node->m_redirectHandler;
+		//a scheme table hit already is a match
+		bool matched = (it->second->scheme.empty() ? handler.matches(url) : handler.reValid());
+		if (!matched)
+			continue;
+		r_matches.push_back(it->second->p_node);
+		if (firstOnly)
+			return;
+	}
+}
+
 //static 
 MimeSystem * MimeSystem::instance()
 {
@@ -790,7 +1099,14 @@ MimeSystem * MimeSystem::instance(const std::string& baseConfigFile)
 {
 
 	MimeSystem * inst = instance();	
-	MutexLocker lock(&(inst->m_mutex));
+	
+	//the files are read and parsed without m_lock; the tables are only locked while the result is put in
+	if (isBinaryMimeTable(baseConfigFile)) {
+		std::string err;
+		if (!inst->restoreBinaryMimeTable(baseConfigFile,err))
+			g_warning("%s: %s",__FUNCTION__,err.c_str());
+		return inst;
+	}
 	
 	struct json_object * file_root_jobj = json_object_from_file(const_cast<char *>(baseConfigFile.c_str()));
 	if (!file_root_jobj)
@@ -805,7 +1121,6 @@ MimeSystem * MimeSystem::instance(const std::string& baseConfigFile)
 MimeSystem * MimeSystem::instance(const std::string& baseConfigFile,const std::string& customizedConfigFile)
 {
 	MimeSystem * inst = instance();
-	MutexLocker lock(&(inst->m_mutex));
 	
 	//Since whatever comes first will not get overridden by what comes after, start with the customized file and then load the base file
 	
@@ -830,7 +1145,6 @@ MimeSystem * MimeSystem::instance(const std::string& baseConfigFile,const std::s
  */
 int MimeSystem::populateFromJson(struct json_object * root)
 {
-	MutexLocker lock(&m_mutex);
 	if (!root)
 		return 0;
 
@@ -850,6 +1164,10 @@ int MimeSystem::populateFromJson(struct json_object * root)
 			}
 		}
 	}
+	//the entries are gathered (and their patterns checked) first, and added in one write section by addHandlers()
+	RegistrationBatch batch;
+	batch.sysDefault = true;
+
 	json_object* commands = json_object_object_get(root, "commands");	
 	if (commands)
 	{
@@ -862,7 +1180,7 @@ int MimeSystem::populateFromJson(struct json_object * root)
 				if (re && appId) {
 					RedirectHandler handler(re, appId,true);
 					if (handler.reValid()) {
-						addRedirectHandler(re,appId,NULL,true,true);
+						batch.addRedirectHandler(re,appId,true);
 					}
 					else {
 						g_warning("Unable to parse cmd urlRe '%s'", re);
@@ -884,7 +1202,7 @@ int MimeSystem::populateFromJson(struct json_object * root)
 				if (re && appId) {
 					RedirectHandler handler(re, appId,false);
 					if (handler.reValid()) {
-						addRedirectHandler(re,appId,NULL,false,true);
+						batch.addRedirectHandler(re,appId,false);
 					}
 					else {
 						g_warning("Unable to parse redirect urlRe '%s'", re);
@@ -906,8 +1224,7 @@ int MimeSystem::populateFromJson(struct json_object * root)
 				const char* appId = json_object_get_string(json_object_object_get(e, "appId"));
 				bool stream = json_object_get_boolean(json_object_object_get(e, "streamable"));
 				if (extn && appId && mime) {
-					std::string extension(extn);
-					addResourceHandler(extension,mime,!stream,appId,NULL,true);
+					batch.addResourceHandler(extn,mime,!stream,appId);
 				}
 				else {
 					g_warning("Error parsing resource idx %d", i);
@@ -915,14 +1232,16 @@ int MimeSystem::populateFromJson(struct json_object * root)
 			}
 		}
 	}
+	addHandlers(batch);
 	return 1;
 }
 
-std::string	MimeSystem::getActiveAppIdForResource(std::string mimeType)
+std::string	MimeSystem::getActiveAppIdForResource(const std::string& mimeTypeIn)
 {
-	MutexLocker lock(&m_mutex);
+	ReadLocker lock(&m_lock);
 	
-	std::transform(mimeType.begin(), mimeType.end(), mimeType.begin(), tolower);
+	std::string lcBuf;
+	const std::string& mimeType = lowercased(mimeTypeIn,lcBuf);
 	
 	ResourceMapIterType it = m_resourceHandlerMap.find(mimeType);
 	if (it != m_resourceHandlerMap.end()) {
@@ -931,11 +1250,12 @@ std::string	MimeSystem::getActiveAppIdForResource(std::string mimeType)
 	return "";
 }
 
-int	MimeSystem::getAllAppIdForResource(std::string mimeType,std::string& r_active,std::vector<std::string>& r_alternatives)
+int	MimeSystem::getAllAppIdForResource(const std::string& mimeTypeIn,std::string& r_active,std::vector<std::string>& r_alternatives)
 {
-	MutexLocker lock(&m_mutex);
+	ReadLocker lock(&m_lock);
 	
-	std::transform(mimeType.begin(), mimeType.end(), mimeType.begin(), tolower);
+	std::string lcBuf;
+	const std::string& mimeType = lowercased(mimeTypeIn,lcBuf);
 	
 	ResourceMapIterType it = m_resourceHandlerMap.find(mimeType);
 	if (it == m_resourceHandlerMap.end()) {
@@ -952,11 +1272,12 @@ int	MimeSystem::getAllAppIdForResource(std::string mimeType,std::string& r_activ
 	return (p_rhn->m_alternates.size() +1);
 }
 
-ResourceHandler	MimeSystem::getActiveHandlerForResource(std::string mimeType)
+ResourceHandler	MimeSystem::getActiveHandlerForResource(const std::string& mimeTypeIn)
 {
-	MutexLocker lock(&m_mutex);
+	ReadLocker lock(&m_lock);
 	
-	std::transform(mimeType.begin(), mimeType.end(), mimeType.begin(), tolower);
+	std::string lcBuf;
+	const std::string& mimeType = lowercased(mimeTypeIn,lcBuf);
 	
 	ResourceMapIterType it = m_resourceHandlerMap.find(mimeType);
 	if (it != m_resourceHandlerMap.end()) {
@@ -965,11 +1286,12 @@ ResourceHandler	MimeSystem::getActiveHandlerForResource(std::string mimeType)
 	return ResourceHandler();	//return invalid object (see ResourceHandler::valid() )
 }
 
-int	MimeSystem::getAllHandlersForResource(std::string mimeType,ResourceHandler& r_active,std::vector<ResourceHandler>& r_alternatives)
+int	MimeSystem::getAllHandlersForResource(const std::string& mimeTypeIn,ResourceHandler& r_active,std::vector<ResourceHandler>& r_alternatives)
 {
-	MutexLocker lock(&m_mutex);
+	ReadLocker lock(&m_lock);
 	
-	std::transform(mimeType.begin(), mimeType.end(), mimeType.begin(), tolower);
+	std::string lcBuf;
+	const std::string& mimeType = lowercased(mimeTypeIn,lcBuf);
 	
 	ResourceMapIterType it = m_resourceHandlerMap.find(mimeType);
 	if (it == m_resourceHandlerMap.end()) {
@@ -988,7 +1310,7 @@ int	MimeSystem::getAllHandlersForResource(std::string mimeType,ResourceHandler&
 	
 std::string	MimeSystem::getActiveAppIdForRedirect(const std::string& url,bool doNotUseRegexpMatch,bool disallowSchemeForms)
 {
-	MutexLocker lock(&m_mutex);
+	ReadLocker lock(&m_lock);
 	RedirectMapIterType it;
 	
 	if (doNotUseRegexpMatch) {
@@ -1000,20 +1322,16 @@ std::string	MimeSystem::getActiveAppIdForRedirect(const std::string& url,bool do
 		}
 	}
 	else {
-		for (it = m_redirectHandlerMap.begin();it != m_redirectHandlerMap.end();++it) {
-			if ((disallowSchemeForms) && (it->second->m_redirectHandler.isSchemeForm()))
-				continue;
-			//try and match against it
-			if (it->second->m_redirectHandler.matches(url))
-				return it->second->m_redirectHandler.appId();
-		}
+		RedirectHandlerNode * p_rhn = resolveRedirect(url,(disallowSchemeForms ? RedirectMatcher::RedirectForms : RedirectMatcher::AllForms));
+		if (p_rhn)
+			return p_rhn->m_redirectHandler.appId();
 	}
 	return "";
 }
 
 int	MimeSystem::getAllAppIdForRedirect(const std::string& url,bool doNotUseRegexpMatch,std::string& r_active,std::vector<std::string>& r_alternatives)
 {
-	MutexLocker lock(&m_mutex);
+	ReadLocker lock(&m_lock);
 	int rc=0;
 	RedirectMapIterType it;
 	if (doNotUseRegexpMatch) {
@@ -1038,13 +1356,11 @@ int	MimeSystem::getAllAppIdForRedirect(const std::string& url,bool doNotUseRegex
 	}
 	
 	//else, do a regexp match
-	for (it = m_redirectHandlerMap.begin();it != m_redirectHandlerMap.end();++it) {
-		//try and match against it
-		if (it->second->m_redirectHandler.matches(url) == false)
-			continue;
-		
+	std::vector<RedirectHandlerNode *> matches;
+	resolveAllRedirects(url,matches);
+	for (std::vector<RedirectHandlerNode *>::iterator cit = matches.begin();cit != matches.end();++cit) {
 		//found a node that matches the url
-		RedirectHandlerNode * p_rhn = it->second;
+		RedirectHandlerNode * p_rhn = (*cit);
 		//Active is a litte bit ambiguous here since there may be multiple nodes that match the url (regexps can overlap, and also scheme and "redirect" forms can refer to the same url patterns)
 		//But we want an "active" to keep the API somewhat consistent...so just set the "active" as the primary handler of the first node that's found
 		if (rc == 0) {
@@ -1069,7 +1385,7 @@ int	MimeSystem::getAllAppIdForRedirect(const std::string& url,bool doNotUseRegex
 
 RedirectHandler	MimeSystem::getActiveHandlerForRedirect(const std::string& url,bool doNotUseRegexpMatch, bool disallowSchemeForms)
 {
-	MutexLocker lock(&m_mutex);
+	ReadLocker lock(&m_lock);
 	RedirectMapIterType it;
 	
 	if (doNotUseRegexpMatch) {
@@ -1081,20 +1397,16 @@ RedirectHandler	MimeSystem::getActiveHandlerForRedirect(const std::string& url,b
 		}
 	}
 	else {
-		for (it = m_redirectHandlerMap.begin();it != m_redirectHandlerMap.end();++it) {
-			if ((disallowSchemeForms) && (it->second->m_redirectHandler.isSchemeForm()))
-				continue;
-			//try and match against it
-			if (it->second->m_redirectHandler.matches(url))
-				return it->second->m_redirectHandler;
-		}
+		RedirectHandlerNode * p_rhn = resolveRedirect(url,(disallowSchemeForms ? RedirectMatcher::RedirectForms : RedirectMatcher::AllForms));
+		if (p_rhn)
+			return p_rhn->m_redirectHandler;
 	}
 	return RedirectHandler();
 }
 
 int	MimeSystem::getAllHandlersForRedirect(const std::string& url,bool doNotUseRegexpMatch,RedirectHandler& r_active,std::vector<RedirectHandler>& r_alternatives)
 {
-	MutexLocker lock(&m_mutex);
+	ReadLocker lock(&m_lock);
 	int rc=0;
 	RedirectMapIterType it;
 	if (doNotUseRegexpMatch) {
@@ -1122,13 +1434,11 @@ int	MimeSystem::getAllHandlersForRedirect(const std::string& url,bool doNotUseRe
 
 	//else, do a regexp match
 
-	for (RedirectMapIterType it = m_redirectHandlerMap.begin();it != m_redirectHandlerMap.end();++it) {
-		//try and match against it
-		if (it->second->m_redirectHandler.matches(url) == false)
-			continue;
-
+	std::vector<RedirectHandlerNode *> matches;
+	resolveAllRedirects(url,matches);
+	for (std::vector<RedirectHandlerNode *>::iterator cit = matches.begin();cit != matches.end();++cit) {
 		//found a node that matches the url
-		RedirectHandlerNode * p_rhn = it->second;
+		RedirectHandlerNode * p_rhn = (*cit);
 		//Active is a litte bit ambiguous here since there may be multiple nodes that match the url (regexps can overlap, and also scheme and "redirect" forms can refer to the same url patterns)
 		//But we want an "active" to keep the API somewhat consistent...so just set the "active" as the primary handler of the first node that's found
 		
@@ -1151,11 +1461,12 @@ int	MimeSystem::getAllHandlersForRedirect(const std::string& url,bool doNotUseRe
 	return rc;
 }
 
-std::string	MimeSystem::getAppIdByVerbForResource(std::string mimeType,const std::string& verb,std::string& r_params,uint32_t& r_index)
+std::string	MimeSystem::getAppIdByVerbForResource(const std::string& mimeTypeIn,const std::string& verb,std::string& r_params,uint32_t& r_index)
 {
-	MutexLocker lock(&m_mutex);
+	ReadLocker lock(&m_lock);
 	
-	std::transform(mimeType.begin(), mimeType.end(), mimeType.begin(), tolower);
+	std::string lcBuf;
+	const std::string& mimeType = lowercased(mimeTypeIn,lcBuf);
 		
 	ResourceMapIterType it = m_resourceHandlerMap.find(mimeType);
 	if (it == m_resourceHandlerMap.end())
@@ -1171,7 +1482,7 @@ std::string	MimeSystem::getAppIdByVerbForResource(std::string mimeType,const std
 	r_index = vc_it->second.activeIndex;
 	
 	//retrieve the handler by index
-	std::map<uint32_t,ResourceHandler *>::iterator handler_it = p_rhn->m_handlersByIndex.find(vc_it->second.activeIndex);
+	FlatMap<uint32_t,ResourceHandler *>::iterator handler_it = p_rhn->m_handlersByIndex.find(vc_it->second.activeIndex);
 	if (handler_it == p_rhn->m_handlersByIndex.end())
 		return "";
 	
@@ -1184,11 +1495,12 @@ std::string	MimeSystem::getAppIdByVerbForResource(std::string mimeType,const std
 	return (p_rh->appId());
 }
 
-ResourceHandler	MimeSystem::getHandlerByVerbForResource(std::string mimeType,const std::string& verb)
+ResourceHandler	MimeSystem::getHandlerByVerbForResource(const std::string& mimeTypeIn,const std::string& verb)
 {
-	MutexLocker lock(&m_mutex);
+	ReadLocker lock(&m_lock);
 	
-	std::transform(mimeType.begin(), mimeType.end(), mimeType.begin(), tolower);
+	std::string lcBuf;
+	const std::string& mimeType = lowercased(mimeTypeIn,lcBuf);
 		
 	ResourceMapIterType it = m_resourceHandlerMap.find(mimeType);
 	if (it == m_resourceHandlerMap.end())
@@ -1202,7 +1514,7 @@ ResourceHandler	MimeSystem::getHandlerByVerbForResource(std::string mimeType,con
 		return ResourceHandler();
 
 	//retrieve the handler by index
-	std::map<uint32_t,ResourceHandler *>::iterator handler_it = p_rhn->m_handlersByIndex.find(vc_it->second.activeIndex);
+	FlatMap<uint32_t,ResourceHandler *>::iterator handler_it = p_rhn->m_handlersByIndex.find(vc_it->second.activeIndex);
 	if (handler_it == p_rhn->m_handlersByIndex.end())
 		return ResourceHandler();
 
@@ -1210,11 +1522,12 @@ ResourceHandler	MimeSystem::getHandlerByVerbForResource(std::string mimeType,con
 	return *p_rh;
 }
 
-int	MimeSystem::getAllHandlersByVerbForResource(std::string mimeType,const std::string& verb,std::vector<ResourceHandler>& r_handlers)
+int	MimeSystem::getAllHandlersByVerbForResource(const std::string& mimeTypeIn,const std::string& verb,std::vector<ResourceHandler>& r_handlers)
 {
-	MutexLocker lock(&m_mutex);
+	ReadLocker lock(&m_lock);
 	
-	std::transform(mimeType.begin(), mimeType.end(), mimeType.begin(), tolower);
+	std::string lcBuf;
+	const std::string& mimeType = lowercased(mimeTypeIn,lcBuf);
 		
 	ResourceMapIterType it = m_resourceHandlerMap.find(mimeType);
 	if (it == m_resourceHandlerMap.end())
@@ -1253,11 +1566,12 @@ int	MimeSystem::getAllHandlersByVerbForResource(std::string mimeType,const std::
 	return rc;
 }
 
-int MimeSystem::getAllAppIdByVerbForResource(std::string mimeType,const std::string& verb,std::vector<VerbInfo>& r_handlers)
+int MimeSystem::getAllAppIdByVerbForResource(const std::string& mimeTypeIn,const std::string& verb,std::vector<VerbInfo>& r_handlers)
 {
-	MutexLocker lock(&m_mutex);
+	ReadLocker lock(&m_lock);
 	
-	std::transform(mimeType.begin(), mimeType.end(), mimeType.begin(), tolower);
+	std::string lcBuf;
+	const std::string& mimeType = lowercased(mimeTypeIn,lcBuf);
 	
 	ResourceMapIterType it = m_resourceHandlerMap.find(mimeType);
 	if (it == m_resourceHandlerMap.end())
@@ -1296,17 +1610,8 @@ int MimeSystem::getAllAppIdByVerbForResource(std::string mimeType,const std::str
 
 std::string	MimeSystem::getAppIdByVerbForRedirect(const std::string& url,bool disallowSchemeForms,const std::string& verb,std::string& r_params,uint32_t& r_index)
 {
-	MutexLocker lock(&m_mutex);
-	RedirectHandlerNode * p_rhn = NULL;
-	for (RedirectMapIterType it = m_redirectHandlerMap.begin();it != m_redirectHandlerMap.end();++it) {
-		if ((disallowSchemeForms) && (it->second->m_redirectHandler.isSchemeForm()))
-			continue;
-		//try and match against it
-		if (it->second->m_redirectHandler.matches(url)) {
-			p_rhn = it->second;
-			break;
-		}
-	}
+	ReadLocker lock(&m_lock);
+	RedirectHandlerNode * p_rhn = resolveRedirect(url,(disallowSchemeForms ? RedirectMatcher::RedirectForms : RedirectMatcher::AllForms));
 	
 	if (p_rhn == NULL)
 		return "";
@@ -1319,7 +1624,7 @@ std::string	MimeSystem::getAppIdByVerbForRedirect(const std::string& url,bool di
 	r_index = vc_it->second.activeIndex;
 	
 	//retrieve the handler by index
-	std::map<uint32_t,RedirectHandler *>::iterator handler_it = p_rhn->m_handlersByIndex.find(vc_it->second.activeIndex);
+	FlatMap<uint32_t,RedirectHandler *>::iterator handler_it = p_rhn->m_handlersByIndex.find(vc_it->second.activeIndex);
 	if (handler_it == p_rhn->m_handlersByIndex.end())
 		return "";
 
@@ -1335,17 +1640,8 @@ std::string	MimeSystem::getAppIdByVerbForRedirect(const std::string& url,bool di
 
 RedirectHandler	MimeSystem::getHandlerByVerbForRedirect(const std::string& url,bool disallowSchemeForms,const std::string& verb)
 {
-	MutexLocker lock(&m_mutex);
-	RedirectHandlerNode * p_rhn = NULL;
-	for (RedirectMapIterType it = m_redirectHandlerMap.begin();it != m_redirectHandlerMap.end();++it) {
-		if ((disallowSchemeForms) && (it->second->m_redirectHandler.isSchemeForm()))
-			continue;
-		//try and match against it
-		if (it->second->m_redirectHandler.matches(url)) {
-			p_rhn = it->second;
-			break;
-		}
-	}
+	ReadLocker lock(&m_lock);
+	RedirectHandlerNode * p_rhn = resolveRedirect(url,(disallowSchemeForms ? RedirectMatcher::RedirectForms : RedirectMatcher::AllForms));
 
 	if (p_rhn == NULL)
 		return RedirectHandler();
@@ -1356,7 +1652,7 @@ RedirectHandler	MimeSystem::getHandlerByVerbForRedirect(const std::string& url,b
 		return RedirectHandler();
 
 	//retrieve the handler by index
-	std::map<uint32_t,RedirectHandler *>::iterator handler_it = p_rhn->m_handlersByIndex.find(vc_it->second.activeIndex);
+	FlatMap<uint32_t,RedirectHandler *>::iterator handler_it = p_rhn->m_handlersByIndex.find(vc_it->second.activeIndex);
 	if (handler_it == p_rhn->m_handlersByIndex.end())
 		return RedirectHandler();
 
@@ -1368,14 +1664,13 @@ RedirectHandler	MimeSystem::getHandlerByVerbForRedirect(const std::string& url,b
 
 int MimeSystem::getAllHandlersByVerbForRedirect(const std::string& url,const std::string& verb,std::vector<RedirectHandler>& r_handlers)
 {
-	MutexLocker lock(&m_mutex);
+	ReadLocker lock(&m_lock);
 	RedirectHandlerNode * p_rhn = NULL;
 	int rc = 0;
-	for (RedirectMapIterType it = m_redirectHandlerMap.begin();it != m_redirectHandlerMap.end();++it) {
-		if (it->second->m_redirectHandler.matches(url) == false)
-			continue;
-
-		p_rhn = it->second;
+	std::vector<RedirectHandlerNode *> matches;
+	resolveAllRedirects(url,matches);
+	for (std::vector<RedirectHandlerNode *>::iterator cit = matches.begin();cit != matches.end();++cit) {
+		p_rhn = (*cit);
 
 		//found...
 
@@ -1410,14 +1705,13 @@ int MimeSystem::getAllHandlersByVerbForRedirect(const std::string& url,const std
 
 int MimeSystem::getAllAppIdByVerbForRedirect(const std::string& url,const std::string& verb,std::vector<VerbInfo>& r_handlers)
 {
-	MutexLocker lock(&m_mutex);
+	ReadLocker lock(&m_lock);
 	RedirectHandlerNode * p_rhn = NULL;
 	int rc = 0;
-	for (RedirectMapIterType it = m_redirectHandlerMap.begin();it != m_redirectHandlerMap.end();++it) {
-		if (it->second->m_redirectHandler.matches(url) == false)
-			continue;
-
-		p_rhn = it->second;
+	std::vector<RedirectHandlerNode *> matches;
+	resolveAllRedirects(url,matches);
+	for (std::vector<RedirectHandlerNode *>::iterator cit = matches.begin();cit != matches.end();++cit) {
+		p_rhn = (*cit);
 
 		//found...
 
@@ -1452,67 +1746,69 @@ int MimeSystem::getAllAppIdByVerbForRedirect(const std::string& url,const std::s
 
 RedirectHandler	MimeSystem::getRedirectHandlerDirect(const uint32_t index)
 {
+	ReadLocker lock(&m_lock);
 	
-	for (RedirectMapIterType it = m_redirectHandlerMap.begin();it != m_redirectHandlerMap.end();++it) {
-		std::map<uint32_t,RedirectHandler *>::iterator rit = it->second->m_handlersByIndex.find(index);
-		if (rit != it->second->m_handlersByIndex.end())
-			return (*(rit->second));
-	}
+	RedirectHandlerNode * p_rhn = redirectNodeByIndex(index);
+	if (p_rhn)
+		return (*(p_rhn->m_handlersByIndex[index]));
 	
 	return RedirectHandler();
 }
 
 ResourceHandler	MimeSystem::getResourceHandlerDirect(const uint32_t index)
 {
-	for (ResourceMapIterType it = m_resourceHandlerMap.begin();it != m_resourceHandlerMap.end();++it) {
-		std::map<uint32_t,ResourceHandler *>::iterator rit = it->second->m_handlersByIndex.find(index);
-		if (rit != it->second->m_handlersByIndex.end())
-			return (*(rit->second));
-	}
+	ReadLocker lock(&m_lock);
+	
+	ResourceHandlerNode * p_rhn = resourceNodeByIndex(index);
+	if (p_rhn)
+		return (*(p_rhn->m_handlersByIndex[index]));
 	
 	return ResourceHandler();
 }
 	
 int MimeSystem::removeAllForAppId(const std::string& appId)
 {
-	MutexLocker lock(&m_mutex);
-	std::vector<std::string> keys;
-	//go through all the nodes
+	WriteLocker lock(&m_lock);
+	tablesChanged();
+	//only the nodes this app has handlers in
 	
-	for (RedirectMapIterType it = m_redirectHandlerMap.begin();it != m_redirectHandlerMap.end();++it) 
-	{
-		int rc = it->second->removeAppId(appId);
-		if (rc == RC_HANDLERNODE_REMOVEAPPID_REMOVENODE) {
-			//need to remove the whole node
-			keys.push_back(it->first);
+	std::map<std::string,std::set<std::string> >::iterator app_it = m_redirectKeysByAppId.find(appId);
+	if (app_it != m_redirectKeysByAppId.end()) {
+		for (std::set<std::string>::iterator key_it = app_it->second.begin();key_it != app_it->second.end();++key_it) 
+		{
+			RedirectMapIterType found_it = m_redirectHandlerMap.find(*key_it);
+			if (found_it == m_redirectHandlerMap.end())
+				continue;
+			int rc = found_it->second->removeAppId(appId);
+			if (rc == RC_HANDLERNODE_REMOVEAPPID_REMOVENODE) {
+				//need to remove the whole node
+				MimeSystem::reclaimIndex(found_it->second->m_redirectHandler.index());
+				delete (found_it->second);
+				m_redirectHandlerMap.erase(found_it);
+				m_redirectMatcher.remove(*key_it);
+			}
 		}
+		m_redirectKeysByAppId.erase(app_it);
 	}
 	
-	//erase all the keys for nodes which are completely obliterated
-	for (std::vector<std::string>::iterator it = keys.begin();it != keys.end();++it) {
-		RedirectMapIterType found_it = m_redirectHandlerMap.find(*it);
-		MimeSystem::reclaimIndex(found_it->second->m_redirectHandler.index());
-		delete (found_it->second);
-		m_redirectHandlerMap.erase(*it);
-	}
-	keys.clear();
 	// and do the same for the Resources...
 	
-	for (ResourceMapIterType it = m_resourceHandlerMap.begin();it != m_resourceHandlerMap.end();++it) 
-	{
-		int rc = it->second->removeAppId(appId);
-		if (rc == RC_HANDLERNODE_REMOVEAPPID_REMOVENODE) {
-			//need to remove the whole node
-			keys.push_back(it->first);
+	app_it = m_resourceKeysByAppId.find(appId);
+	if (app_it != m_resourceKeysByAppId.end()) {
+		for (std::set<std::string>::iterator key_it = app_it->second.begin();key_it != app_it->second.end();++key_it) 
+		{
+			ResourceMapIterType found_it = m_resourceHandlerMap.find(*key_it);
+			if (found_it == m_resourceHandlerMap.end())
+				continue;
+			int rc = found_it->second->removeAppId(appId);
+			if (rc == RC_HANDLERNODE_REMOVEAPPID_REMOVENODE) {
+				//need to remove the whole node
+				MimeSystem::reclaimIndex(found_it->second->m_resourceHandler.index());
+				delete (found_it->second);
+				m_resourceHandlerMap.erase(found_it);
+			}
 		}
-	}
-
-	//erase all the keys for nodes which are completely obliterated
-	for (std::vector<std::string>::iterator it = keys.begin();it != keys.end();++it) {
-		ResourceMapIterType found_it = m_resourceHandlerMap.find(*it);
-		MimeSystem::reclaimIndex(found_it->second->m_resourceHandler.index());
-		delete (found_it->second);
-		m_resourceHandlerMap.erase(*it);
+		m_resourceKeysByAppId.erase(app_it);
 	}
 
 	return 1;
@@ -1520,7 +1816,8 @@ int MimeSystem::removeAllForAppId(const std::string& appId)
 
 int	MimeSystem::removeAllForMimeType(std::string mimeType)
 {	
-	MutexLocker lock(&m_mutex);
+	WriteLocker lock(&m_lock);
+	tablesChanged();
 	
 	std::transform(mimeType.begin(), mimeType.end(), mimeType.begin(), tolower);
 		
@@ -1535,13 +1832,15 @@ int	MimeSystem::removeAllForMimeType(std::string mimeType)
 
 int	MimeSystem::removeAllForUrl(const std::string& url)
 {
-	MutexLocker lock(&m_mutex);
+	WriteLocker lock(&m_lock);
+	tablesChanged();
 	//find the RedirectHandlerNode, and delete it
 	RedirectMapIterType it = m_redirectHandlerMap.find(url);
 	if (it == m_redirectHandlerMap.end())
 		return 0;
 	delete (it->second);
 	m_redirectHandlerMap.erase(it);
+	m_redirectMatcher.remove(url);
 	return 1;
 }
 
@@ -1550,7 +1849,8 @@ int	MimeSystem::removeAllForUrl(const std::string& url)
  */
 int	MimeSystem::addResourceHandler(std::string& extension,std::string mimeType,bool shouldDownload,const std::string appId,const std::map<std::string,std::string> * pVerbs,bool sysDefault)
 {
-	MutexLocker lock(&m_mutex);
+	WriteLocker lock(&m_lock);
+	tablesChanged();
 	
 	//if mimeType is blank, bail
 	if (mimeType.size() == 0)
@@ -1590,6 +1890,7 @@ int	MimeSystem::addResourceHandler(std::string& extension,std::string mimeType,b
 		if (sysDefault)
 			p_rhn->m_resourceHandler.setTag("system-default");	//also tag as a system default
 		m_resourceHandlerMap[mimeType] = p_rhn;
+		indexResourceNode(mimeType,p_rhn);
 		return 1;
 	}
 	
@@ -1602,12 +1903,14 @@ int	MimeSystem::addResourceHandler(std::string& extension,std::string mimeType,b
 	ResourceHandler * p_newHandler = new ResourceHandler(extension,mimeType,appId,!shouldDownload);
 	p_rhn->m_handlersByIndex[p_newHandler->index()] = p_newHandler;
 	p_rhn->m_alternates.push_back(p_newHandler);
+	indexResourceHandler(mimeType,p_newHandler);
 	return 2;
 }
 
 int	MimeSystem::addResourceHandler(std::string extension,bool shouldDownload,const std::string appId,const std::map<std::string,std::string> * pVerbs,bool sysDefault)
 {
-	MutexLocker lock(&m_mutex);
+	WriteLocker lock(&m_lock);
+	tablesChanged();
 	//find the mime type for this extension
 	std::transform(extension.begin(), extension.end(), extension.begin(), tolower);
 	std::map<std::string,std::string>::iterator mit = m_extensionToMimeMap.find(extension);
@@ -1625,6 +1928,7 @@ int	MimeSystem::addResourceHandler(std::string extension,bool shouldDownload,con
 		if (sysDefault)
 			p_rhn->m_resourceHandler.setTag("system-default");	//also tag as a system default
 		m_resourceHandlerMap[mimeType] = p_rhn;
+		indexResourceNode(mimeType,p_rhn);
 		return 1;
 	}
 
@@ -1638,13 +1942,15 @@ int	MimeSystem::addResourceHandler(std::string extension,bool shouldDownload,con
 	p_rhn->m_handlersByIndex[p_newHandler->index()] = p_newHandler;
 
 	p_rhn->m_alternates.push_back(p_newHandler);
+	indexResourceHandler(mimeType,p_newHandler);
 		
 	return 2;
 }
 
 int	MimeSystem::addRedirectHandler(const std::string& url,const std::string appId,const std::map<std::string,std::string> * pVerbs,bool isSchemeForm,bool sysDefault)
 {
-	MutexLocker lock(&m_mutex);
+	WriteLocker lock(&m_lock);
+	tablesChanged();
 	//see if there is a primary entry already
 	RedirectMapIterType it = m_redirectHandlerMap.find(url);
 	if (it == m_redirectHandlerMap.end()) {
@@ -1653,6 +1959,8 @@ int	MimeSystem::addRedirectHandler(const std::string& url,const std::string appI
 		if (sysDefault)
 			p_rhn->m_redirectHandler.setTag("system-default");	//also tag as a system default
 		m_redirectHandlerMap[url] = p_rhn;
+		m_redirectMatcher.add(url,p_rhn);
+		indexRedirectNode(url,p_rhn);
 		return 1;
 	}
 
@@ -1661,16 +1969,116 @@ int	MimeSystem::addRedirectHandler(const std::string& url,const std::string appI
 	if (p_rhn->exists(url,appId))
 		return 3;				//it existing here is not an error. Just quietly exit
 
-	//add it
-	RedirectHandler * p_newHandler = new RedirectHandler(url,appId,isSchemeForm);
+	//add it; same url as the primary, so it can share its compiled expression
+	RedirectHandler * p_newHandler = new RedirectHandler(p_rhn->m_redirectHandler,appId,isSchemeForm);
 	p_rhn->m_handlersByIndex[p_newHandler->index()] = p_newHandler;
 	
 	p_rhn->m_alternates.push_back(p_newHandler);
+	indexRedirectHandler(url,p_newHandler);
 	return 2;
 }
 
+void MimeSystem::RegistrationBatch::addResourceHandler(const std::string& extension,const std::string& mimeType,bool shouldDownload,const std::string& appId)
+{
+	Entry entry;
+	entry.kind = ResourceByMimeType;
+	entry.extension = extension;
+	entry.mimeType = mimeType;
+	entry.appId = appId;
+	entry.shouldDownload = shouldDownload;
+	entry.schemeForm = false;
+	entry.result = 0;
+	entries.push_back(entry);
+}
+
+void MimeSystem::RegistrationBatch::addResourceHandler(const std::string& extension,bool shouldDownload,const std::string& appId)
+{
+	Entry entry;
+	entry.kind = ResourceByExtension;
+	entry.extension = extension;
+	entry.appId = appId;
+	entry.shouldDownload = shouldDownload;
+	entry.schemeForm = false;
+	entry.result = 0;
+	entries.push_back(entry);
+}
+
+void MimeSystem::RegistrationBatch::addRedirectHandler(const std::string& url,const std::string& appId,bool isSchemeForm)
+{
+	Entry entry;
+	entry.kind = Redirect;
+	entry.url = url;
+	entry.appId = appId;
+	entry.shouldDownload = false;
+	entry.schemeForm = isSchemeForm;
+	entry.result = 0;
+	entries.push_back(entry);
+}
+
+int MimeSystem::addHandlers(RegistrationBatch& batch)
+{
+	WriteLocker lock(&m_lock);
+	tablesChanged();
+	
+	//the same registration more than once (an app listing a type twice, the same app in two folders...) is only done the first time;
+	// the repeats get what a repeated add*Handler() call would have returned
+	std::map<std::string,uint32_t> done;
+	int nOk = 0;
+	
+	for (std::vector<RegistrationBatch::Entry>::iterator it = batch.entries.begin();it != batch.entries.end();++it)
+	{
+		RegistrationBatch::Entry& entry = *it;
+		std::string key;
+		switch (entry.kind) {
+		case RegistrationBatch::ResourceByMimeType:
+			key = std::string("m") + entry.extension + '\n' + entry.mimeType + '\n' + entry.appId;
+			break;
+		case RegistrationBatch::ResourceByExtension:
+			key = std::string("e") + entry.extension + '\n' + entry.appId;
+			break;
+		case RegistrationBatch::Redirect:
+			key = std::string("r") + entry.url + '\n' + entry.appId;
+			break;
+		}
+		
+		std::map<std::string,uint32_t>::iterator done_it = done.find(key);
+		if (done_it != done.end()) {
+			const RegistrationBatch::Entry& first = batch.entries[done_it->second];
+			entry.extension = first.extension;
+			entry.mimeType = first.mimeType;
+			entry.result = (first.result > 0 ? 3 : first.result);
+		}
+		else {
+			switch (entry.kind) {
+			case RegistrationBatch::ResourceByMimeType:
+				entry.result = addResourceHandler(entry.extension,entry.mimeType,entry.shouldDownload,entry.appId,NULL,batch.sysDefault);
+				break;
+			case RegistrationBatch::ResourceByExtension:
+				entry.result = addResourceHandler(entry.extension,entry.shouldDownload,entry.appId,NULL,batch.sysDefault);
+				if (entry.result > 0) {
+					std::string extension = entry.extension;
+					std::transform(extension.begin(), extension.end(), extension.begin(), tolower);
+					entry.mimeType = m_extensionToMimeMap[extension];
+				}
+				break;
+			case RegistrationBatch::Redirect:
+				entry.result = addRedirectHandler(entry.url,entry.appId,NULL,entry.schemeForm,batch.sysDefault);
+				break;
+			}
+			done[key] = it - batch.entries.begin();
+		}
+		
+		if (entry.result > 0)
+			++nOk;
+	}
+	
+	return nOk;
+}
+
 int	MimeSystem::addVerbsToResourceHandler(std::string mimeType,const std::string& appId,const std::map<std::string,std::string>& verbs)
 {
+	WriteLocker lock(&m_lock);
+	tablesChanged();
 
 	std::transform(mimeType.begin(),mimeType.end(),mimeType.begin(),tolower);
 	ResourceMapIterType resource_it = m_resourceHandlerMap.find(mimeType);
@@ -1692,6 +2100,8 @@ int	MimeSystem::addVerbsToResourceHandler(std::string mimeType,const std::string
 
 int	MimeSystem::addVerbsToRedirectHandler(const std::string& url,const std::string& appId,const std::map<std::string,std::string>& verbs)
 {
+	WriteLocker lock(&m_lock);
+	tablesChanged();
 	RedirectMapIterType redirect_it = m_redirectHandlerMap.find(url);
 	if (redirect_it != m_redirectHandlerMap.end())
 	{
@@ -1711,29 +2121,22 @@ int	MimeSystem::addVerbsToRedirectHandler(const std::string& url,const std::stri
 
 int	MimeSystem::addVerbsDirect(uint32_t index,const std::map<std::string,std::string>& verbs)
 {
-	//scan all the maps to find one that has the index in question
-	for (ResourceMapIterType resource_it = m_resourceHandlerMap.begin();
-			resource_it != m_resourceHandlerMap.end();++resource_it)
-	{
-		ResourceHandlerNode * p_rhn = resource_it->second;
-		std::map<uint32_t,ResourceHandler *>::iterator find_it = p_rhn->m_handlersByIndex.find(index);
-		if (find_it != p_rhn->m_handlersByIndex.end())
-			return MimeSystem::addVerbs(verbs,*p_rhn,*(find_it->second));		//found it...add verbs
-	}
-	for (RedirectMapIterType redirect_it = m_redirectHandlerMap.begin();
-	redirect_it != m_redirectHandlerMap.end();++redirect_it)
-	{
-		RedirectHandlerNode * p_rhn = redirect_it->second;
-		std::map<uint32_t,RedirectHandler *>::iterator find_it = p_rhn->m_handlersByIndex.find(index);
-		if (find_it != p_rhn->m_handlersByIndex.end())
-			return MimeSystem::addVerbs(verbs,*p_rhn,*(find_it->second));		//found it...add verbs
-	}
+	WriteLocker lock(&m_lock);
+	tablesChanged();
+	//find the node that has the index in question
+	ResourceHandlerNode * p_resourceNode = resourceNodeByIndex(index);
+	if (p_resourceNode)
+		return MimeSystem::addVerbs(verbs,*p_resourceNode,*(p_resourceNode->m_handlersByIndex[index]));		//found it...add verbs
+	RedirectHandlerNode * p_redirectNode = redirectNodeByIndex(index);
+	if (p_redirectNode)
+		return MimeSystem::addVerbs(verbs,*p_redirectNode,*(p_redirectNode->m_handlersByIndex[index]));		//found it...add verbs
 	return 0;
 }
 	
 int MimeSystem::swapResourceHandler(std::string mimeType, uint32_t index)
 {
-	MutexLocker lock(&m_mutex);
+	WriteLocker lock(&m_lock);
+	tablesChanged();
 	std::transform(mimeType.begin(),mimeType.end(),mimeType.begin(),tolower);
 		
 	ResourceMapIterType it = m_resourceHandlerMap.find(mimeType);
@@ -1745,7 +2148,8 @@ int MimeSystem::swapResourceHandler(std::string mimeType, uint32_t index)
 
 int	MimeSystem::swapRedirectHandler(const std::string& url, uint32_t index)
 {
-	MutexLocker lock(&m_mutex);
+	WriteLocker lock(&m_lock);
+	tablesChanged();
 	RedirectMapIterType it = m_redirectHandlerMap.find(url);
 	if (it == m_redirectHandlerMap.end())
 		return 0;
@@ -1775,10 +2179,11 @@ bool MimeSystem::getExtensionFromUrl(const std::string& url,std::string& r_extn)
 	return false;
 }
 
-bool MimeSystem::getMimeTypeByExtension(std::string extension,std::string& r_mimeType)
+bool MimeSystem::getMimeTypeByExtension(const std::string& extensionIn,std::string& r_mimeType)
 {
-	MutexLocker lock(&m_mutex);
-	std::transform(extension.begin(), extension.end(), extension.begin(), tolower);
+	ReadLocker lock(&m_lock);
+	std::string lcBuf;
+	const std::string& extension = lowercased(extensionIn,lcBuf);
 	std::map<std::string,std::string>::iterator it = m_extensionToMimeMap.find(extension);
 	if (it != m_extensionToMimeMap.end()) 
 	{
@@ -1819,10 +2224,11 @@ std::string	MimeSystem::makePseudoExtensionFromMime(const std::string& mimeType)
 
 std::string	MimeSystem::allTablesAsJsonString()
 {
-	MutexLocker locker(&m_mutex);
+	ReadLocker locker(&m_lock);
 	json_object * jobj = json_object_new_object();
 	json_object_object_add(jobj,(char *)"resources",resourceTableAsJsonArray());
 	json_object_object_add(jobj,(char *)"redirects",redirectTableAsJsonArray());
+	json_object_object_add(jobj,(char *)"resolutionCache",resolutionCacheAsJson());
 	std::string s = json_object_to_json_string(jobj);
 	json_object_put(jobj);
 	return s;
@@ -1830,7 +2236,7 @@ std::string	MimeSystem::allTablesAsJsonString()
 
 std::string	MimeSystem::resourceTableAsJsonString()
 {
-	MutexLocker locker(&m_mutex);
+	ReadLocker locker(&m_lock);
 	json_object * jobj = resourceTableAsJson();
 	std::string s = json_object_to_json_string(jobj);
 	json_object_put(jobj);
@@ -1839,7 +2245,7 @@ std::string	MimeSystem::resourceTableAsJsonString()
 
 json_object * MimeSystem::resourceTableAsJson()	//WARNING: memory allocated; caller must clean
 {
-	MutexLocker locker(&m_mutex);
+	ReadLocker locker(&m_lock);
 	json_object * jobj = json_object_new_object();
 	json_object * jarray = json_object_new_array();
 	for (ResourceMapIterType it = m_resourceHandlerMap.begin();
@@ -1856,7 +2262,7 @@ json_object * MimeSystem::resourceTableAsJson()	//WARNING: memory allocated; cal
 
 json_object * MimeSystem::resourceTableAsJsonArray()	//WARNING: memory allocated; caller must clean
 {
-	MutexLocker locker(&m_mutex);
+	ReadLocker locker(&m_lock);
 	json_object * jobj = json_object_new_array();
 	for (ResourceMapIterType it = m_resourceHandlerMap.begin();
 	it != m_resourceHandlerMap.end();++it) 
@@ -1873,7 +2279,7 @@ json_object * MimeSystem::resourceTableAsJsonArray()	//WARNING: memory allocated
 
 std::string	MimeSystem::redirectTableAsJsonString()
 {
-	MutexLocker locker(&m_mutex);
+	ReadLocker locker(&m_lock);
 	json_object * jobj = redirectTableAsJson();
 	std::string s = json_object_to_json_string(jobj);
 	json_object_put(jobj);
@@ -1882,7 +2288,7 @@ std::string	MimeSystem::redirectTableAsJsonString()
 	
 json_object * MimeSystem::redirectTableAsJson() //WARNING: memory allocated; caller must clean
 {
-	MutexLocker locker(&m_mutex);
+	ReadLocker locker(&m_lock);
 	json_object * jobj = json_object_new_object();
 	json_object * jarray = json_object_new_array();
 	for (RedirectMapIterType it = m_redirectHandlerMap.begin();
@@ -1899,7 +2305,7 @@ json_object * MimeSystem::redirectTableAsJson() //WARNING: memory allocated; cal
 
 json_object * MimeSystem::redirectTableAsJsonArray() //WARNING: memory allocated; caller must clean
 {
-	MutexLocker locker(&m_mutex);
+	ReadLocker locker(&m_lock);
 	json_object * jobj = json_object_new_array();
 	for (RedirectMapIterType it = m_redirectHandlerMap.begin();
 	it != m_redirectHandlerMap.end();++it) 
@@ -1912,9 +2318,21 @@ json_object * MimeSystem::redirectTableAsJsonArray() //WARNING: memory allocated
 	return jobj;
 }
 
+json_object * MimeSystem::resolutionCacheAsJson()	//WARNING: memory allocated; caller must clean
+{
+	ReadLocker locker(&m_lock);
+	MutexLocker cacheLocker(&m_resolutionCacheMutex);
+	json_object * jobj = json_object_new_object();
+	json_object_object_add(jobj,(char *)"entries",json_object_new_int(m_resolutionCache.size()));
+	json_object_object_add(jobj,(char *)"hits",json_object_new_int(m_resolutionCacheHits));
+	json_object_object_add(jobj,(char *)"misses",json_object_new_int(m_resolutionCacheMisses));
+	json_object_object_add(jobj,(char *)"generation",json_object_new_int(m_generation));
+	return jobj;
+}
+
 std::string	MimeSystem::extensionMapAsJsonString()
 {
-	MutexLocker locker(&m_mutex);
+	ReadLocker locker(&m_lock);
 	struct json_object * jobj = extensionMapAsJson();
 	std::string s = json_object_to_json_string(jobj);
 	json_object_put(jobj);
@@ -1923,7 +2341,7 @@ std::string	MimeSystem::extensionMapAsJsonString()
 
 json_object * MimeSystem::extensionMapAsJson()	//WARNING: memory allocated; caller must clean
 {
-	MutexLocker locker(&m_mutex);
+	ReadLocker locker(&m_lock);
 	struct json_object * jobj = json_object_new_object();
 	json_object * jarr = json_object_new_array();
 	
@@ -1939,7 +2357,7 @@ json_object * MimeSystem::extensionMapAsJson()	//WARNING: memory allocated; call
 
 json_object * MimeSystem::extensionMapAsJsonArray() //WARNING: memory allocated; caller must clean
 {
-	MutexLocker locker(&m_mutex);
+	ReadLocker locker(&m_lock);
 	json_object * jarr = json_object_new_array();
 	
 	for (std::map<std::string,std::string>::iterator it = m_extensionToMimeMap.begin();
@@ -1951,57 +2369,200 @@ json_object * MimeSystem::extensionMapAsJsonArray() //WARNING: memory allocated;
 	return jarr;
 }
 
-bool MimeSystem::saveMimeTable(const std::string& file,std::string& r_err)
-{
-	MutexLocker locker(&m_mutex);
-	std::string mimeTablesJsonStr;
-	r_err.clear();
-	//try and open the file
-	FILE * fp = fopen(file.c_str(),"w");
-	if (!fp) {
-		r_err = "Unable to open file "+file;
+/*
+ * The binary mime table (what saveMimeTableToActiveFile writes, and what's read back at boot):
+ *
+ *   header			MimeTableFileHeader
+ *   string index	stringCount x { uint32 offset (into the string data), uint32 length }
+ *   string data		every distinct string once, NUL terminated
+ *   records			uint32 words; strings are referred to by their number in the string index
+ *
+ *	 records:	extensionCount, extensionCount x { extension, mimeType }
+ *				resourceNodeCount, for each: handlerCount (primary first), for each handler:
+ *											{ extension, mimeType, appId, tag, streamable, verbCount, verbCount x { verb, params } }
+ *										verbCacheCount, verbCacheCount x { verb, position of the active handler in the node, useCount }
+ *				redirectNodeCount, for each: handlerCount (primary first), for each handler:
+ *											{ url, appId, tag, schemeForm, verbCount, verbCount x { verb, params } }
+ *										verbCacheCount, verbCacheCount x { verb, position of the active handler in the node, useCount }
+ *
+ * Handler indexes aren't stored; they are assigned anew when the table is loaded.
+ * All numbers are in host byte order: the file never leaves the device.
+ */
+
+static const uint32_t s_mimeTableFileMagic = 0x424d544c;		// "LTMB"
+static const uint32_t s_mimeTableFileVersion = 1;
+
+struct MimeTableFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t fileSize;
+	uint32_t stringCount;
+	uint32_t stringIndexOffset;
+	uint32_t stringDataOffset;
+	uint32_t stringDataSize;
+	uint32_t recordsOffset;
+	uint32_t recordCount;			// in uint32 words
+};
+
+class MimeTableFileWriter {
+public:
+	void put(uint32_t word) { m_records.push_back(word); }
+	void putString(const std::string& str) {
+		std::map<std::string,uint32_t>::iterator it = m_stringIds.find(str);
+		if (it == m_stringIds.end()) {
+			it = m_stringIds.insert(std::pair<std::string,uint32_t>(str,m_strings.size())).first;
+			m_strings.push_back(&(it->first));
+		}
+		put(it->second);
+	}
+	std::string contents() const;
+
+private:
+	std::map<std::string,uint32_t> m_stringIds;
+	std::vector<const std::string *> m_strings;
+	std::vector<uint32_t> m_records;
+};
+
+std::string MimeTableFileWriter::contents() const
+{
+	MimeTableFileHeader header;
+	header.magic = s_mimeTableFileMagic;
+	header.version = s_mimeTableFileVersion;
+	header.stringCount = m_strings.size();
+	header.stringIndexOffset = sizeof(header);
+	header.stringDataOffset = header.stringIndexOffset + header.stringCount * 2 * sizeof(uint32_t);
+
+	std::vector<uint32_t> stringIndex;
+	std::string stringData;
+	for (std::vector<const std::string *>::const_iterator it = m_strings.begin();it != m_strings.end();++it) {
+		stringIndex.push_back(stringData.size());
+		stringIndex.push_back((*it)->size());
+		stringData.append(**it);
+		stringData.push_back('\0');
+	}
+	while (stringData.size() % sizeof(uint32_t))
+		stringData.push_back('\0');		//keep the records aligned for the mmap'ed reader
+
+	header.stringDataSize = stringData.size();
+	header.recordsOffset = header.stringDataOffset + header.stringDataSize;
+	header.recordCount = m_records.size();
+	header.fileSize = header.recordsOffset + header.recordCount * sizeof(uint32_t);
+
+	std::string buf;
+	buf.reserve(header.fileSize);
+	buf.append((const char *)&header,sizeof(header));
+	if (!stringIndex.empty())
+		buf.append((const char *)&stringIndex[0],stringIndex.size() * sizeof(uint32_t));
+	buf.append(stringData);
+	if (!m_records.empty())
+		buf.append((const char *)&m_records[0],m_records.size() * sizeof(uint32_t));
+	return buf;
+}
+
+class MimeTableFileReader {
+public:
+	MimeTableFileReader(const char * data,size_t size) : m_header(0), m_stringIndex(0), m_records(0), m_pos(0), m_ok(false) {
+		if (size < sizeof(MimeTableFileHeader))
+			return;
+		m_header = (const MimeTableFileHeader *)data;
+		if (m_header->magic != s_mimeTableFileMagic || m_header->version != s_mimeTableFileVersion || m_header->fileSize != size)
+			return;
+		//every section has to be inside the file
+		if (m_header->stringIndexOffset > size || m_header->stringCount > (size - m_header->stringIndexOffset) / (2 * sizeof(uint32_t))
+			|| m_header->stringDataOffset > size || m_header->stringDataSize > size - m_header->stringDataOffset
+			|| m_header->recordsOffset > size || m_header->recordCount > (size - m_header->recordsOffset) / sizeof(uint32_t))
+			return;
+		m_stringIndex = (const uint32_t *)(data + m_header->stringIndexOffset);
+		m_stringData = data + m_header->stringDataOffset;
+		m_records = (const uint32_t *)(data + m_header->recordsOffset);
+		m_ok = true;
+	}
+
+	bool ok() const { return m_ok; }
+	bool atEnd() const { return m_pos == m_header->recordCount; }
+
+	uint32_t get() {
+		if (!m_ok || m_pos >= m_header->recordCount) {
+			m_ok = false;
+			return 0;
+		}
+		return m_records[m_pos++];
+	}
+	std::string getString() {
+		uint32_t id = get();
+		if (!m_ok || id >= m_header->stringCount) {
+			m_ok = false;
+			return std::string();
+		}
+		uint32_t offset = m_stringIndex[2*id];
+		uint32_t length = m_stringIndex[2*id+1];
+		if (offset > m_header->stringDataSize || length > m_header->stringDataSize - offset) {
+			m_ok = false;
+			return std::string();
+		}
+		return std::string(m_stringData + offset,length);
+	}
+
+private:
+	const MimeTableFileHeader * m_header;
+	const uint32_t * m_stringIndex;
+	const char * m_stringData;
+	const uint32_t * m_records;
+	uint32_t m_pos;
+	bool m_ok;
+};
+
+//temp file + fsync + rename (+ fsync of the directory): whatever happens, the file is either the old one or the new one in full.
+//the callers only share m_lock, so two saves can run at once; each gets a temp file of its own
+static bool writeFileAtomically(const std::string& file,const std::string& contents,std::string& r_err)
+{
+	std::string tmpFile = file + ".XXXXXX";
+	int fd = ::mkstemp(&tmpFile[0]);
+	if (fd < 0) {
+		r_err = "Unable to open file "+tmpFile;
 		return false;
 	}
-	
-	struct json_object * outer_jobj = json_object_new_object();
-	
-	//get the extension map, and the mime tables and wrap into a json object
-	json_object_object_add(outer_jobj,(char *)"schemaVersion",json_object_new_int(2));
-	json_object_object_add(outer_jobj,(char *)"extensionMap",extensionMapAsJsonArray());
-	json_object_object_add(outer_jobj,(char *)"resources",resourceTableAsJsonArray());
-	json_object_object_add(outer_jobj,(char *)"redirects",redirectTableAsJsonArray());
-	
-	std::string s = json_object_to_json_string(outer_jobj);
-	json_object_put(outer_jobj);
-	
-	//write it
-	size_t wr = fwrite(s.data(),1,s.size(),fp);
-	if (wr != s.size()) {
-		r_err = "Couldn't write maps to file "+file;
-		goto Done_saveMimeTable;
+	fchmod(fd,0644);
+
+	const char * p = contents.data();
+	size_t remaining = contents.size();
+	while (remaining) {
+		ssize_t n = ::write(fd,p,remaining);
+		if (n <= 0)
+			break;
+		p += n;
+		remaining -= n;
 	}
-	
-	fprintf(fp,"\n\n");
-	
-Done_saveMimeTable:
 
-	fclose(fp);
-	if (r_err.size())
+	if (remaining || fsync(fd) != 0) {
+		r_err = "Couldn't write maps to file "+tmpFile;
+		::close(fd);
+		::unlink(tmpFile.c_str());
+		return false;
+	}
+	::close(fd);
+
+	if (::rename(tmpFile.c_str(),file.c_str()) != 0) {
+		r_err = "Couldn't replace file "+file;
+		::unlink(tmpFile.c_str());
 		return false;
+	}
+
+	gchar * dirPath = g_path_get_dirname(file.c_str());
+	int dirFd = ::open(dirPath,O_RDONLY | O_DIRECTORY);
+	if (dirFd >= 0) {
+		fsync(dirFd);
+		::close(dirFd);
+	}
+	g_free(dirPath);
 	return true;
 }
 
-bool MimeSystem::saveMimeTableToActiveFile(std::string& r_err)
+//exported as json, for debugging and moving tables around; the active file is saved in the binary form (saveMimeTableToActiveFile)
+bool MimeSystem::saveMimeTable(const std::string& file,std::string& r_err)
 {
-	MutexLocker locker(&m_mutex);
-	std::string mimeTablesJsonStr;
+	ReadLocker locker(&m_lock);
 	r_err.clear();
-	//try and open the file
-	FILE * fp = fopen(Settings::LunaSettings()->lunaCmdHandlerSavedPath.c_str(),"w");
-	if (!fp) {
-		r_err = std::string("Unable to open file ")+Settings::LunaSettings()->lunaCmdHandlerSavedPath;
-		return false;
-	}
 	
 	struct json_object * outer_jobj = json_object_new_object();
 	
@@ -2013,27 +2574,286 @@ bool MimeSystem::saveMimeTableToActiveFile(std::string& r_err)
 	
 	std::string s = json_object_to_json_string(outer_jobj);
 	json_object_put(outer_jobj);
+	s += "\n\n";
 	
-	//write it
-	size_t wr = fwrite(s.data(),1,s.size(),fp);
-	if (wr != s.size()) {
-		r_err = std::string("Couldn't write maps to file ")+Settings::LunaSettings()->lunaCmdHandlerSavedPath;
-		goto Done_saveMimeTableToActiveFile;
+	return writeFileAtomically(file,s,r_err);
+}
+
+bool MimeSystem::saveMimeTableToActiveFile(std::string& r_err)
+{
+	ReadLocker locker(&m_lock);
+	r_err.clear();
+
+	MimeTableFileWriter writer;
+
+	writer.put(m_extensionToMimeMap.size());
+	for (std::map<std::string,std::string>::iterator it = m_extensionToMimeMap.begin();it != m_extensionToMimeMap.end();++it) {
+		writer.putString(it->first);
+		writer.putString(it->second);
+	}
+
+	writer.put(m_resourceHandlerMap.size());
+	for (ResourceMapIterType it = m_resourceHandlerMap.begin();it != m_resourceHandlerMap.end();++it) {
+		ResourceHandlerNode * p_rhn = it->second;
+		std::vector<ResourceHandler *> handlers;
+		handlers.push_back(&(p_rhn->m_resourceHandler));
+		handlers.insert(handlers.end(),p_rhn->m_alternates.begin(),p_rhn->m_alternates.end());
+
+		writer.put(handlers.size());
+		for (std::vector<ResourceHandler *>::iterator h_it = handlers.begin();h_it != handlers.end();++h_it) {
+			ResourceHandler * p_rh = *h_it;
+			writer.putString(p_rh->fileExt());
+			writer.putString(p_rh->contentType());
+			writer.putString(p_rh->appId());
+			writer.putString(p_rh->tag());
+			writer.put(p_rh->stream() ? 1 : 0);
+			writer.put(p_rh->verbs().size());
+			for (std::map<std::string,std::string>::const_iterator v_it = p_rh->verbs().begin();v_it != p_rh->verbs().end();++v_it) {
+				writer.putString(v_it->first);
+				writer.putString(v_it->second);
+			}
+		}
+		writer.put(p_rhn->m_verbCache.size());
+		for (VerbCacheMapIterType vc_it = p_rhn->m_verbCache.begin();vc_it != p_rhn->m_verbCache.end();++vc_it) {
+			uint32_t pos = 0;
+			while (pos < handlers.size() && handlers[pos]->index() != vc_it->second.activeIndex)
+				++pos;
+			writer.putString(vc_it->first);
+			writer.put(pos < handlers.size() ? pos : 0);
+			writer.put(vc_it->second.useCount);
+		}
 	}
-	
-	fprintf(fp,"\n\n");
-	
-Done_saveMimeTableToActiveFile:
 
+	writer.put(m_redirectHandlerMap.size());
+	for (RedirectMapIterType it = m_redirectHandlerMap.begin();it != m_redirectHandlerMap.end();++it) {
+		RedirectHandlerNode * p_rhn = it->second;
+		std::vector<RedirectHandler *> handlers;
+		handlers.push_back(&(p_rhn->m_redirectHandler));
+		handlers.insert(handlers.end(),p_rhn->m_alternates.begin(),p_rhn->m_alternates.end());
+
+		writer.put(handlers.size());
+		for (std::vector<RedirectHandler *>::iterator h_it = handlers.begin();h_it != handlers.end();++h_it) {
+			RedirectHandler * p_rh = *h_it;
+			writer.putString(p_rh->urlRe());
+			writer.putString(p_rh->appId());
+			writer.putString(p_rh->tag());
+			writer.put(p_rh->isSchemeForm() ? 1 : 0);
+			writer.put(p_rh->verbs().size());
+			for (std::map<std::string,std::string>::const_iterator v_it = p_rh->verbs().begin();v_it != p_rh->verbs().end();++v_it) {
+				writer.putString(v_it->first);
+				writer.putString(v_it->second);
+			}
+		}
+		writer.put(p_rhn->m_verbCache.size());
+		for (VerbCacheMapIterType vc_it = p_rhn->m_verbCache.begin();vc_it != p_rhn->m_verbCache.end();++vc_it) {
+			uint32_t pos = 0;
+			while (pos < handlers.size() && handlers[pos]->index() != vc_it->second.activeIndex)
+				++pos;
+			writer.putString(vc_it->first);
+			writer.put(pos < handlers.size() ? pos : 0);
+			writer.put(vc_it->second.useCount);
+		}
+	}
+
+	return writeFileAtomically(Settings::LunaSettings()->lunaCmdHandlerSavedPath,writer.contents(),r_err);
+}
+
+//static
+bool MimeSystem::isBinaryMimeTable(const std::string& file)
+{
+	uint32_t magic = 0;
+	FILE * fp = fopen(file.c_str(),"r");
+	if (!fp)
+		return false;
+	size_t rd = fread(&magic,sizeof(magic),1,fp);
 	fclose(fp);
-	if (r_err.size())
+	return (rd == 1 && magic == s_mimeTableFileMagic);
+}
+
+bool MimeSystem::restoreBinaryMimeTable(const std::string& file,std::string& r_err)
+{
+	//everything is read into new nodes without m_lock; installNodes() puts them in
+	int fd = ::open(file.c_str(),O_RDONLY);
+	if (fd < 0) {
+		r_err = "No saved tables found in "+file;
 		return false;
+	}
+	struct stat st;
+	void * data = MAP_FAILED;
+	if (fstat(fd,&st) == 0 && st.st_size > 0)
+		data = ::mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+	::close(fd);
+	if (data == MAP_FAILED) {
+		r_err = "Unable to map file "+file;
+		return false;
+	}
+
+	MimeTableFileReader reader((const char *)data,st.st_size);
+	std::map<std::string,std::string> extensionToMimeMap;
+	std::vector<ResourceHandlerNode *> resourceNodes;
+	std::vector<RedirectHandlerNode *> redirectNodes;
+
+	uint32_t count = reader.get();
+	for (uint32_t i = 0; i < count && reader.ok(); ++i) {
+		std::string extension = reader.getString();
+		extensionToMimeMap[extension] = reader.getString();
+	}
+
+	count = reader.get();
+	for (uint32_t i = 0; i < count && reader.ok(); ++i) {
+		ResourceHandlerNode * p_rhn = NULL;
+		std::vector<ResourceHandler *> handlers;
+		uint32_t handlerCount = reader.get();
+		for (uint32_t h = 0; h < handlerCount && reader.ok(); ++h) {
+			std::string extension = reader.getString();
+			std::string mimeType = reader.getString();
+			std::string appId = reader.getString();
+			std::string tag = reader.getString();
+			bool stream = (reader.get() != 0);
+			ResourceHandler * p_rh;
+			if (p_rhn == NULL) {
+				p_rhn = new ResourceHandlerNode(extension,mimeType,appId,stream);
+				resourceNodes.push_back(p_rhn);
+				p_rh = &(p_rhn->m_resourceHandler);
+				p_rh->setTag(tag);
+			}
+			else {
+				p_rh = new ResourceHandler(extension,mimeType,appId,stream,tag);
+				p_rhn->m_handlersByIndex[p_rh->index()] = p_rh;
+				p_rhn->m_alternates.push_back(p_rh);
+			}
+			handlers.push_back(p_rh);
+			uint32_t verbCount = reader.get();
+			for (uint32_t v = 0; v < verbCount && reader.ok(); ++v) {
+				std::string verb = reader.getString();
+				p_rh->addVerb(verb,reader.getString());
+			}
+		}
+		uint32_t verbCacheCount = reader.get();
+		for (uint32_t v = 0; v < verbCacheCount && reader.ok(); ++v) {
+			std::string verb = reader.getString();
+			uint32_t pos = reader.get();
+			uint32_t useCount = reader.get();
+			if (p_rhn && pos < handlers.size()) {
+				VerbCacheEntry& entry = p_rhn->m_verbCache[verb];
+				entry.activeIndex = handlers[pos]->index();
+				entry.useCount = useCount;
+			}
+		}
+	}
+
+	count = reader.get();
+	for (uint32_t i = 0; i < count && reader.ok(); ++i) {
+		RedirectHandlerNode * p_rhn = NULL;
+		std::vector<RedirectHandler *> handlers;
+		uint32_t handlerCount = reader.get();
+		for (uint32_t h = 0; h < handlerCount && reader.ok(); ++h) {
+			std::string url = reader.getString();
+			std::string appId = reader.getString();
+			std::string tag = reader.getString();
+			bool schemeForm = (reader.get() != 0);
+			RedirectHandler * p_rh;
+			if (p_rhn == NULL) {
+				p_rhn = new RedirectHandlerNode(url,appId,schemeForm);
+				redirectNodes.push_back(p_rhn);
+				p_rh = &(p_rhn->m_redirectHandler);
+				p_rh->setTag(tag);
+			}
+			else {
+				p_rh = new RedirectHandler(url,appId,schemeForm,tag);
+				p_rhn->m_handlersByIndex[p_rh->index()] = p_rh;
+				p_rhn->m_alternates.push_back(p_rh);
+			}
+			handlers.push_back(p_rh);
+			uint32_t verbCount = reader.get();
+			for (uint32_t v = 0; v < verbCount && reader.ok(); ++v) {
+				std::string verb = reader.getString();
+				p_rh->addVerb(verb,reader.getString());
+			}
+		}
+		uint32_t verbCacheCount = reader.get();
+		for (uint32_t v = 0; v < verbCacheCount && reader.ok(); ++v) {
+			std::string verb = reader.getString();
+			uint32_t pos = reader.get();
+			uint32_t useCount = reader.get();
+			if (p_rhn && pos < handlers.size()) {
+				VerbCacheEntry& entry = p_rhn->m_verbCache[verb];
+				entry.activeIndex = handlers[pos]->index();
+				entry.useCount = useCount;
+			}
+		}
+	}
+
+	bool ok = reader.ok() && reader.atEnd();
+	::munmap(data,st.st_size);
+
+	if (!ok) {
+		//leave the tables as they were
+		for (std::vector<ResourceHandlerNode *>::iterator it = resourceNodes.begin();it != resourceNodes.end();++it)
+			delete *it;
+		for (std::vector<RedirectHandlerNode *>::iterator it = redirectNodes.begin();it != redirectNodes.end();++it)
+			delete *it;
+		r_err = "Invalid or corrupt mime table in "+file;
+		return false;
+	}
+
+	installNodes(&extensionToMimeMap,resourceNodes,redirectNodes);
 	return true;
 }
 
+void MimeSystem::installNodes(std::map<std::string,std::string> * p_extensionMap,
+							  const std::vector<ResourceHandlerNode *>& resourceNodes,
+							  const std::vector<RedirectHandlerNode *>& redirectNodes)
+{
+	std::vector<ResourceHandlerNode *> replacedResourceNodes;
+	std::vector<RedirectHandlerNode *> replacedRedirectNodes;
+	{
+		WriteLocker lock(&m_lock);
+		tablesChanged();
+
+		if (p_extensionMap)
+			m_extensionToMimeMap.swap(*p_extensionMap);
+
+		//the entries the replaced nodes leave in the handler location and appId indexes are only stale hints (see MimeSystem.h);
+		//the matcher drops a pattern's old entry when it's added again
+		for (std::vector<ResourceHandlerNode *>::const_iterator it = resourceNodes.begin();it != resourceNodes.end();++it) {
+			const std::string& mimeType = (*it)->m_resourceHandler.contentType();
+			ResourceMapIterType found_it = m_resourceHandlerMap.find(mimeType);
+			if (found_it != m_resourceHandlerMap.end()) {
+				replacedResourceNodes.push_back(found_it->second);
+				found_it->second = *it;
+			}
+			else
+				m_resourceHandlerMap[mimeType] = *it;
+			indexResourceNode(mimeType,*it);
+		}
+		for (std::vector<RedirectHandlerNode *>::const_iterator it = redirectNodes.begin();it != redirectNodes.end();++it) {
+			const std::string& url = (*it)->m_redirectHandler.urlRe();
+			RedirectMapIterType found_it = m_redirectHandlerMap.find(url);
+			if (found_it != m_redirectHandlerMap.end()) {
+				replacedRedirectNodes.push_back(found_it->second);
+				found_it->second = *it;
+			}
+			else
+				m_redirectHandlerMap[url] = *it;
+			m_redirectMatcher.add(url,*it);
+			indexRedirectNode(url,*it);
+		}
+	}
+
+	//nothing reaches these any more (resolution cache entries for them went stale with tablesChanged())
+	for (std::vector<ResourceHandlerNode *>::iterator it = replacedResourceNodes.begin();it != replacedResourceNodes.end();++it)
+		delete *it;
+	for (std::vector<RedirectHandlerNode *>::iterator it = replacedRedirectNodes.begin();it != replacedRedirectNodes.end();++it)
+		delete *it;
+}
+
 //TODO: reimplement as static factory fn?
 bool MimeSystem::restoreMimeTable(const std::string& file,std::string& r_err)
 {
+	if (isBinaryMimeTable(file))
+		return restoreBinaryMimeTable(file,r_err);
+
 	//read in the file as json
 	char* tables = readFile(file.c_str());
 	if (!tables) {
@@ -2054,8 +2874,12 @@ bool MimeSystem::restoreMimeTable(const std::string& file,std::string& r_err)
 
 bool MimeSystem::restoreMimeTable(json_object * root,std::string& r_err)
 {
+	//the nodes are built without m_lock; installNodes() puts them in
 	std::string val_s;
 	json_object * topLevel_jobj;
+	std::map<std::string,std::string> extensionToMimeMap;
+	std::vector<ResourceHandlerNode *> resourceNodes;
+	std::vector<RedirectHandlerNode *> redirectNodes;
 	
 	if (!root)
 	{
@@ -2065,8 +2889,6 @@ bool MimeSystem::restoreMimeTable(json_object * root,std::string& r_err)
 	}
 
 	//restore the extension map
-	m_extensionToMimeMap.clear();
-
 	if ((topLevel_jobj = JsonGetObject(root,"extensionMap")) != NULL) 
 	{
 		//found the extn map...
@@ -2076,7 +2898,7 @@ bool MimeSystem::restoreMimeTable(json_object * root,std::string& r_err)
 				json_object* e = json_object_array_get_idx(topLevel_jobj, i);
 				json_object_object_foreach(e,key,val) {		//a bit awkward since there's only going to be 1 k-v pair per object but using the long (expanded out) version of the macro is messy
 					val_s = json_object_get_string(val);
-					m_extensionToMimeMap[key] = val_s;
+					extensionToMimeMap[key] = val_s;
 				}
 			}
 		}
@@ -2097,10 +2919,8 @@ bool MimeSystem::restoreMimeTable(json_object * root,std::string& r_err)
 					continue;		//skip...error.
 				
 				RedirectHandlerNode * p_rhn = RedirectHandlerNode::fromJson(h);
-				if (p_rhn != NULL) {
-					//add...
-					m_redirectHandlerMap[p_rhn->m_redirectHandler.urlRe()] = p_rhn;
-				}
+				if (p_rhn != NULL)
+					redirectNodes.push_back(p_rhn);
 			}
 		}
 	}
@@ -2117,14 +2937,14 @@ bool MimeSystem::restoreMimeTable(json_object * root,std::string& r_err)
 				if (!h)
 					continue;		//skip...error.
 				ResourceHandlerNode * p_rhn = ResourceHandlerNode::fromJson(h);
-				if (p_rhn != NULL) {
-					//add...
-					m_resourceHandlerMap[p_rhn->m_resourceHandler.contentType()] = p_rhn;
-				}
+				if (p_rhn != NULL)
+					resourceNodes.push_back(p_rhn);
 			}
 		}
 	}
 
+	installNodes(&extensionToMimeMap,resourceNodes,redirectNodes);
+
 	Done_restoreMimeTable:
 
 	if (r_err.size())
@@ -2184,7 +3004,7 @@ bool MimeSystem::dbg_printMimeTables()
 
 bool MimeSystem::dbg_getResourceTableStrings(std::vector<std::pair<std::string,std::vector<std::string> > >& r_resourceTableStrings)
 {
-	MutexLocker locker(&m_mutex);
+	ReadLocker locker(&m_lock);
 	for (ResourceMapIterType it = m_resourceHandlerMap.begin();
 	it != m_resourceHandlerMap.end();++it) 
 	{
@@ -2203,7 +3023,7 @@ bool MimeSystem::dbg_getResourceTableStrings(std::vector<std::pair<std::string,s
 
 bool MimeSystem::dbg_getRedirectTableStrings(std::vector<std::pair<std::string,std::vector<std::string> > >& r_redirectTableStrings)
 {
-	MutexLocker locker(&m_mutex);
+	ReadLocker locker(&m_lock);
 	for (RedirectMapIterType it = m_redirectHandlerMap.begin();
 	it != m_redirectHandlerMap.end();++it) 
 	{
@@ -2222,7 +3042,7 @@ bool MimeSystem::dbg_getRedirectTableStrings(std::vector<std::pair<std::string,s
 
 void MimeSystem::dbg_printVerbCacheTableForResource(const std::string& mime)
 {
-	MutexLocker locker(&m_mutex);
+	ReadLocker locker(&m_lock);
 	ResourceHandlerNode * p_rhn = getResourceHandlerNode(mime);
 	if (p_rhn == NULL) {
 		printf("didn't find any nodes for mime type %s\n",mime.c_str());
@@ -2234,7 +3054,7 @@ void MimeSystem::dbg_printVerbCacheTableForResource(const std::string& mime)
 
 void MimeSystem::dbg_printVerbCacheTableForRedirect(const std::string& url)
 {
-	MutexLocker locker(&m_mutex);
+	ReadLocker locker(&m_lock);
 	RedirectHandlerNode * p_rhn = this->getRedirectHandlerNode(url);
 	if (p_rhn == NULL) {
 		printf("didn't find any nodes for redirect(url) %s\n",url.c_str());
@@ -2245,7 +3065,7 @@ void MimeSystem::dbg_printVerbCacheTableForRedirect(const std::string& url)
 
 void MimeSystem::dbg_printVerbCacheTableForScheme(const std::string& url)
 {
-	MutexLocker locker(&m_mutex);
+	ReadLocker locker(&m_lock);
 	RedirectHandlerNode * p_rhn = this->getSchemeHandlerNode(url);
 	if (p_rhn == NULL) {
 		printf("didn't find any nodes for redirect(scheme) %s\n",url.c_str());
@@ -2255,12 +3075,12 @@ void MimeSystem::dbg_printVerbCacheTableForScheme(const std::string& url)
 }
 
 //static		(CALL UNDER PROPER LOCK FOR p_verbCacheTable) 
-void MimeSystem::dbg_printVerbCacheTable(const std::map<std::string,MimeSystem::VerbCacheEntry> * p_verbCacheTable)
+void MimeSystem::dbg_printVerbCacheTable(const FlatMap<std::string,MimeSystem::VerbCacheEntry> * p_verbCacheTable)
 {
 	if (p_verbCacheTable == NULL)
 		return;
 	
-	for (std::map<std::string,VerbCacheEntry>::const_iterator it = p_verbCacheTable->begin();
+	for (FlatMap<std::string,VerbCacheEntry>::const_iterator it = p_verbCacheTable->begin();
 			it != p_verbCacheTable->end();++it)
 	{
 		std::string verbStr = it->first;
@@ -2285,6 +3105,9 @@ void MimeSystem::dbg_printRedirectHandlerNode(const RedirectHandlerNode * p_redi
 // ---------------------------------------------------------------------------------------------------------------------
 
 MimeSystem::MimeSystem() 
+	: m_generation(0)
+	, m_resolutionCacheHits(0)
+	, m_resolutionCacheMisses(0)
 {
 	
 }
@@ -2297,18 +3120,24 @@ MimeSystem::~MimeSystem()
 
 void MimeSystem::destroy()
 {
-	MutexLocker locker(&m_mutex);
+	WriteLocker locker(&m_lock);
+	tablesChanged();
 	m_extensionToMimeMap.clear();
 	for (RedirectMapIterType it = m_redirectHandlerMap.begin();
 		it != m_redirectHandlerMap.end();++it) 
 		delete it->second;
 	m_redirectHandlerMap.clear();
+	m_redirectMatcher.clear();
 	
 	for (ResourceMapIterType it = m_resourceHandlerMap.begin();
 		it != m_resourceHandlerMap.end();++it) 
 		delete it->second;
 	m_resourceHandlerMap.clear();
 	
+	m_handlerLocations.clear();
+	m_resourceKeysByAppId.clear();
+	m_redirectKeysByAppId.clear();
+	
 	MutexLocker lock_index(&s_mutex);
 	s_indexRecycler.clear();
 	s_genIndex = 1;
@@ -2334,7 +3163,7 @@ int MimeSystem::addVerbs(const std::map<std::string,std::string>& verbs,Resource
 			continue;
 		
 		//if the verb is not already in the verbCache, add it 
-		std::map<std::string,VerbCacheEntry>::iterator vce_it= resourceHandlerNode.m_verbCache.find(it->first);
+		VerbCacheMapIterType vce_it= resourceHandlerNode.m_verbCache.find(it->first);
 		if (vce_it == resourceHandlerNode.m_verbCache.end())
 		{
 			resourceHandlerNode.m_verbCache[it->first] = VerbCacheEntry(newHandler.index());
@@ -2360,7 +3189,7 @@ int MimeSystem::addVerbs(const std::map<std::string,std::string>& verbs,Redirect
 			continue;
 
 		//if the verb is not already in the verbCache, add it 
-		std::map<std::string,VerbCacheEntry>::iterator vce_it= redirectHandlerNode.m_verbCache.find(it->first);
+		VerbCacheMapIterType vce_it= redirectHandlerNode.m_verbCache.find(it->first);
 		if (vce_it == redirectHandlerNode.m_verbCache.end())
 		{
 			redirectHandlerNode.m_verbCache[it->first] = VerbCacheEntry(newHandler.index());
@@ -2457,9 +3286,61 @@ int MimeSystem::extractVerbsFromHandlerNodeEntryJson(struct json_object * jsonHa
 	return rc;
 }
 
+void MimeSystem::indexResourceHandler(const std::string& mimeType,ResourceHandler * p_handler)
+{
+	uint32_t index = p_handler->index();
+	if (index >= m_handlerLocations.size())
+		m_handlerLocations.resize(index+1);
+	m_handlerLocations[index].isRedirect = false;
+	m_handlerLocations[index].key = mimeType;
+	m_resourceKeysByAppId[p_handler->appId()].insert(mimeType);
+}
+
+void MimeSystem::indexRedirectHandler(const std::string& url,RedirectHandler * p_handler)
+{
+	uint32_t index = p_handler->index();
+	if (index >= m_handlerLocations.size())
+		m_handlerLocations.resize(index+1);
+	m_handlerLocations[index].isRedirect = true;
+	m_handlerLocations[index].key = url;
+	m_redirectKeysByAppId[p_handler->appId()].insert(url);
+}
+
+void MimeSystem::indexResourceNode(const std::string& mimeType,ResourceHandlerNode * p_rhn)
+{
+	for (FlatMap<uint32_t,ResourceHandler *>::iterator it = p_rhn->m_handlersByIndex.begin();it != p_rhn->m_handlersByIndex.end();++it)
+		indexResourceHandler(mimeType,it->second);
+}
+
+void MimeSystem::indexRedirectNode(const std::string& url,RedirectHandlerNode * p_rhn)
+{
+	for (FlatMap<uint32_t,RedirectHandler *>::iterator it = p_rhn->m_handlersByIndex.begin();it != p_rhn->m_handlersByIndex.end();++it)
+		indexRedirectHandler(url,it->second);
+}
+
+MimeSystem::ResourceHandlerNode * MimeSystem::resourceNodeByIndex(uint32_t index)
+{
+	if (index >= m_handlerLocations.size() || m_handlerLocations[index].isRedirect)
+		return NULL;
+	ResourceMapIterType it = m_resourceHandlerMap.find(m_handlerLocations[index].key);
+	if (it == m_resourceHandlerMap.end() || it->second->m_handlersByIndex.find(index) == it->second->m_handlersByIndex.end())
+		return NULL;
+	return it->second;
+}
+
+MimeSystem::RedirectHandlerNode * MimeSystem::redirectNodeByIndex(uint32_t index)
+{
+	if (index >= m_handlerLocations.size() || !m_handlerLocations[index].isRedirect)
+		return NULL;
+	RedirectMapIterType it = m_redirectHandlerMap.find(m_handlerLocations[index].key);
+	if (it == m_redirectHandlerMap.end() || it->second->m_handlersByIndex.find(index) == it->second->m_handlersByIndex.end())
+		return NULL;
+	return it->second;
+}
+
 MimeSystem::ResourceHandlerNode * MimeSystem::getResourceHandlerNode(const std::string& mimeType)
 {
-	MutexLocker lock(&m_mutex);
+	ReadLocker lock(&m_lock);
 	ResourceMapIterType it = m_resourceHandlerMap.find(mimeType);
 	if (it != m_resourceHandlerMap.end()) {
 		return it->second;
@@ -2470,28 +3351,78 @@ MimeSystem::ResourceHandlerNode * MimeSystem::getResourceHandlerNode(const std::
 
 MimeSystem::RedirectHandlerNode * MimeSystem::getRedirectHandlerNode(const std::string& url)
 {
-	MutexLocker lock(&m_mutex);
-	for (RedirectMapIterType it = m_redirectHandlerMap.begin();it != m_redirectHandlerMap.end();++it) {
-		if (it->second->m_redirectHandler.isSchemeForm())
-			continue;
-		//try and match against it
-		if (it->second->m_redirectHandler.matches(url))
-			return it->second;
-	}
-	return NULL;
-		
+	ReadLocker lock(&m_lock);
+	return resolveRedirect(url,RedirectMatcher::RedirectForms);
 }
 
 MimeSystem::RedirectHandlerNode * MimeSystem::getSchemeHandlerNode(const std::string& url)
 {
-	MutexLocker lock(&m_mutex);
-	for (RedirectMapIterType it = m_redirectHandlerMap.begin();it != m_redirectHandlerMap.end();++it) {
-		if (it->second->m_redirectHandler.isSchemeForm() == false)
-			continue;
-		//try and match against it
-		if (it->second->m_redirectHandler.matches(url))
-			return it->second;
+	ReadLocker lock(&m_lock);
+	return resolveRedirect(url,RedirectMatcher::SchemeForms);
+}
+
+MimeSystem::RedirectHandlerNode * MimeSystem::resolveRedirect(const std::string& url,RedirectMatcher::Forms forms)
+{
+	std::string key = std::string(1,'0'+(char)forms) + url;
+	std::vector<RedirectHandlerNode *> matches;
+	if (!lookupResolutionCache(key,matches)) {
+		RedirectHandlerNode * p_rhn = m_redirectMatcher.firstMatch(url,forms);
+		if (p_rhn)
+			matches.push_back(p_rhn);
+		storeResolutionCache(key,matches);
 	}
-	return NULL;
+	return (matches.empty() ? NULL : matches[0]);
+}
+
+void MimeSystem::resolveAllRedirects(const std::string& url,std::vector<RedirectHandlerNode *>& r_matches)
+{
+	std::string key = std::string("*") + url;
+	if (lookupResolutionCache(key,r_matches))
+		return;
+	m_redirectMatcher.allMatches(url,r_matches);
+	storeResolutionCache(key,r_matches);
 }
 
+bool MimeSystem::lookupResolutionCache(const std::string& key,std::vector<RedirectHandlerNode *>& r_matches)
+{
+	MutexLocker lock(&m_resolutionCacheMutex);
+	std::map<std::string,ResolutionCacheEntry>::iterator it = m_resolutionCache.find(key);
+	if (it != m_resolutionCache.end()) {
+		if (it->second.generation == m_generation) {
+			m_resolutionCacheLru.splice(m_resolutionCacheLru.begin(),m_resolutionCacheLru,it->second.lruPos);
+			r_matches = it->second.matches;
+			++m_resolutionCacheHits;
+			return true;
+		}
+		//resolved against tables that have changed since
+		m_resolutionCacheLru.erase(it->second.lruPos);
+		m_resolutionCache.erase(it);
+	}
+	++m_resolutionCacheMisses;
+	return false;
+}
+
+void MimeSystem::storeResolutionCache(const std::string& key,const std::vector<RedirectHandlerNode *>& matches)
+{
+	//data: urls and the like aren't going to be asked for again
+	if (key.size() > s_resolutionCacheMaxKeyLength)
+		return;
+
+	MutexLocker lock(&m_resolutionCacheMutex);
+	std::map<std::string,ResolutionCacheEntry>::iterator it = m_resolutionCache.find(key);
+	if (it == m_resolutionCache.end()) {
+		m_resolutionCacheLru.push_front(key);
+		it = m_resolutionCache.insert(std::pair<std::string,ResolutionCacheEntry>(key,ResolutionCacheEntry())).first;
+		it->second.lruPos = m_resolutionCacheLru.begin();
+	}
+	else {
+		m_resolutionCacheLru.splice(m_resolutionCacheLru.begin(),m_resolutionCacheLru,it->second.lruPos);
+	}
+	it->second.generation = m_generation;
+	it->second.matches = matches;
+
+	while (m_resolutionCache.size() > s_resolutionCacheSize) {
+		m_resolutionCache.erase(m_resolutionCacheLru.back());
+		m_resolutionCacheLru.pop_back();
+	}
+}
@@ -28,9 +28,12 @@
 #include <vector>
 #include <map>
 #include <set>
+#include <list>
 #include <algorithm>
 
 #include "Mutex.h"
+#include "ReadWriteLock.h"
+#include "FlatMap.h"
 #include "CmdResourceHandlers.h"
 
 class MimeSystem
@@ -76,11 +79,11 @@ public:
 	static MimeSystem * instance(const std::string& baseConfigFile);
 	static MimeSystem * instance(const std::string& baseConfigFile,const std::string& customizedConfigFile);
 	
-	std::string			getActiveAppIdForResource(std::string mimeType);
-	int					getAllAppIdForResource(std::string mimeType,std::string& r_active,std::vector<std::string>& r_handlerAppIds);
+	std::string			getActiveAppIdForResource(const std::string& mimeType);
+	int					getAllAppIdForResource(const std::string& mimeType,std::string& r_active,std::vector<std::string>& r_handlerAppIds);
 	
-	ResourceHandler		getActiveHandlerForResource(std::string mimeType);
-	int					getAllHandlersForResource(std::string mimeType,ResourceHandler& r_active,std::vector<ResourceHandler>& r_handlers);
+	ResourceHandler		getActiveHandlerForResource(const std::string& mimeType);
+	int					getAllHandlersForResource(const std::string& mimeType,ResourceHandler& r_active,std::vector<ResourceHandler>& r_handlers);
 		
 	std::string			getActiveAppIdForRedirect(const std::string& url,bool doNotUseRegexpMatch,bool disallowSchemeForms);
 	int					getAllAppIdForRedirect(const std::string& url,bool doNotUseRegexpMatch,std::string& r_active,std::vector<std::string>& r_handlerAppIds);
@@ -88,10 +91,10 @@ public:
 	RedirectHandler		getActiveHandlerForRedirect(const std::string& url,bool doNotUseRegexpMatch,bool disallowSchemeForms);
 	int					getAllHandlersForRedirect(const std::string& url,bool doNotUseRegexpMatch,RedirectHandler& r_active,std::vector<RedirectHandler>& r_handlers);
 		
-	std::string			getAppIdByVerbForResource(std::string mimeType,const std::string& verb,std::string& r_params,uint32_t& r_index);
-	ResourceHandler		getHandlerByVerbForResource(std::string mimeType,const std::string& verb);
-	int					getAllHandlersByVerbForResource(std::string mimeType,const std::string& verb,std::vector<ResourceHandler>& r_handlers);
-	int 				getAllAppIdByVerbForResource(std::string mimeType,const std::string& verb,std::vector<VerbInfo>& r_handlers);
+	std::string			getAppIdByVerbForResource(const std::string& mimeType,const std::string& verb,std::string& r_params,uint32_t& r_index);
+	ResourceHandler		getHandlerByVerbForResource(const std::string& mimeType,const std::string& verb);
+	int					getAllHandlersByVerbForResource(const std::string& mimeType,const std::string& verb,std::vector<ResourceHandler>& r_handlers);
+	int 				getAllAppIdByVerbForResource(const std::string& mimeType,const std::string& verb,std::vector<VerbInfo>& r_handlers);
 	
 	std::string			getAppIdByVerbForRedirect(const std::string& url,bool disallowSchemeForms,const std::string& verb,std::string& r_params,uint32_t& r_index);
 	RedirectHandler		getHandlerByVerbForRedirect(const std::string& url,bool disallowSchemeForms,const std::string& verb);
@@ -109,6 +112,39 @@ public:
 	int					addResourceHandler(std::string extension,bool shouldDownload,const std::string appId,const std::map<std::string,std::string> * pVerbs,bool sysDefault);
 	int					addRedirectHandler(const std::string& url,const std::string appId,const std::map<std::string,std::string> * pVerbs,bool isSchemeForm,bool sysDefault);
 	
+	/*
+	 * Registrations collected up front (e.g. for all the apps of a scan) and then applied together by addHandlers(), in order,
+	 * as if by the add*Handler() calls above, but under one lock.
+	 */
+	class RegistrationBatch {
+	public:
+		enum Kind {
+			ResourceByMimeType,
+			ResourceByExtension,
+			Redirect
+		};
+		struct Entry {
+			Kind kind;
+			std::string extension;		// resources: addHandlers() fills in the extension actually used
+			std::string mimeType;		// resources: addHandlers() fills in the mime type of a by-extension registration
+			std::string url;			// redirects
+			std::string appId;
+			bool shouldDownload;
+			bool schemeForm;
+			int result;					// set by addHandlers(): what the corresponding add*Handler() call returns
+		};
+		
+		void addResourceHandler(const std::string& extension,const std::string& mimeType,bool shouldDownload,const std::string& appId);
+		void addResourceHandler(const std::string& extension,bool shouldDownload,const std::string& appId);
+		void addRedirectHandler(const std::string& url,const std::string& appId,bool isSchemeForm);
+		
+		RegistrationBatch() : sysDefault(false) {}
+		
+		std::vector<Entry>	entries;
+		bool				sysDefault;		// new handlers are tagged as the system defaults (those from the config files)
+	};
+	int					addHandlers(RegistrationBatch& batch);		//returns the number of entries that succeeded
+	
 	int					addVerbsToResourceHandler(std::string mimeType,const std::string& appId,const std::map<std::string,std::string>& verbs);
 	int					addVerbsToRedirectHandler(const std::string& url,const std::string& appId,const std::map<std::string,std::string>& verbs);
 	int					addVerbsDirect(uint32_t index,const std::map<std::string,std::string>& verbs);
@@ -117,7 +153,7 @@ public:
 	int					swapRedirectHandler(const std::string& url, uint32_t index);
 	
 	static bool 		getExtensionFromUrl(const std::string& url,std::string& r_extn);
-	bool				getMimeTypeByExtension(std::string extension,std::string& r_mimeType);
+	bool				getMimeTypeByExtension(const std::string& extension,std::string& r_mimeType);
 	
 	static uint32_t		assignIndex();
 	static uint32_t		getLastAssignedIndex();
@@ -132,6 +168,8 @@ public:
 	json_object *		redirectTableAsJson();	//WARNING: memory allocated; caller must clean
 	json_object *		redirectTableAsJsonArray();	//WARNING: memory allocated; caller must clean
 	
+	json_object *		resolutionCacheAsJson();	//WARNING: memory allocated; caller must clean
+	
 	std::string			extensionMapAsJsonString();
 	json_object *		extensionMapAsJson();	//WARNING: memory allocated; caller must clean
 	json_object *		extensionMapAsJsonArray();	//WARNING: memory allocated; caller must clean
@@ -140,6 +178,8 @@ public:
 	bool				saveMimeTableToActiveFile(std::string& r_err);
 	bool				restoreMimeTable(const std::string& file,std::string& r_err);
 	bool				restoreMimeTable(json_object * source,std::string& r_err);			//a version of restore that takes a read-in version of the file as a json obj.
+	bool				restoreBinaryMimeTable(const std::string& file,std::string& r_err);	//the form saveMimeTableToActiveFile writes
+	static bool			isBinaryMimeTable(const std::string& file);
 	bool				clearMimeTable();
 	static void			deleteSavedMimeTable();				
 	
@@ -184,8 +224,8 @@ private:
 		RedirectHandler	m_redirectHandler;
 		std::vector<RedirectHandler *> m_alternates;
 	
-		std::map<std::string,VerbCacheEntry> m_verbCache;
-		std::map<uint32_t,RedirectHandler *> m_handlersByIndex;
+		FlatMap<std::string,VerbCacheEntry> m_verbCache;
+		FlatMap<uint32_t,RedirectHandler *> m_handlersByIndex;
 		
 		int removePrimary();
 		int removeAppId(const std::string& appId);
@@ -230,8 +270,8 @@ private:
 		
 		ResourceHandler		m_resourceHandler;
 		std::vector<ResourceHandler *> m_alternates;
-		std::map<std::string,VerbCacheEntry> m_verbCache;
-		std::map<uint32_t,ResourceHandler *> m_handlersByIndex;
+		FlatMap<std::string,VerbCacheEntry> m_verbCache;
+		FlatMap<uint32_t,ResourceHandler *> m_handlersByIndex;
 		
 		int removePrimary();
 		int removeAppId(const std::string& appId);
@@ -277,6 +317,53 @@ private:
 		int fixupVerbCacheTable(struct json_object * jsonHandlerNodeEntry);
 	};
 	
+	/*
+	 * RedirectMatcher narrows a url down to the redirect nodes whose pattern could possibly match it, so the redirect lookups only
+	 * run regexec() on those. For each pattern it keeps the literal text a match must start with (what follows the ^ anchor, up to
+	 * the first regex construct; e.g. the scheme and often the host) and the longest other literal run a match must contain.
+	 * Patterns that yield neither are always candidates. Candidates are checked in m_redirectHandlerMap key order, so "first match
+	 * wins" picks the same node a full scan of the map would.
+	 *
+	 * Pure scheme patterns ("^tel:", "^x-custom-app:", as fromFile registers for command handlers) are kept in their own table keyed
+	 * by the lowercased scheme instead: one lookup on the scheme of the url finds them, and no regexec() is needed to confirm them.
+	 */
+	class RedirectMatcher {
+	public:
+		enum Forms {
+			AllForms,
+			RedirectForms,						// skip scheme form (command) handlers
+			SchemeForms							// only scheme form (command) handlers
+		};
+
+		void add(const std::string& urlRe,RedirectHandlerNode * p_node);
+		void remove(const std::string& urlRe);
+		void clear();
+
+		RedirectHandlerNode * firstMatch(const std::string& url,Forms forms) const;
+		void allMatches(const std::string& url,std::vector<RedirectHandlerNode *>& r_matches) const;
+
+		static void analyzePattern(const std::string& urlRe,std::string& r_prefix,std::string& r_literal);
+		static bool schemeOfPattern(const std::string& urlRe,std::string& r_scheme);
+
+	private:
+		struct Entry {
+			std::string prefix;					// lowercased (patterns are compiled REG_ICASE)
+			std::string literal;
+			std::string scheme;					// non-empty if the pattern is a pure scheme form
+			RedirectHandlerNode * p_node;
+		};
+		typedef std::pair<const std::string *,const Entry *> Candidate;
+		static bool candidateOrder(const Candidate& a,const Candidate& b);
+
+		void match(const std::string& url,Forms forms,bool firstOnly,std::vector<RedirectHandlerNode *>& r_matches) const;
+		static void addCandidates(const std::map<std::string,const Entry *>& entries,const std::string& lcUrl,Forms forms,std::vector<Candidate>& r_candidates);
+
+		std::map<std::string,Entry> m_entries;										// by pattern
+		std::map<std::string,std::map<std::string,const Entry *> > m_byPrefix;		// prefix -> pattern -> entry
+		std::map<size_t,int> m_prefixLengths;										// distinct prefix lengths (and how many use each)
+		std::map<std::string,std::map<std::string,const Entry *> > m_byScheme;		// scheme -> pattern -> entry
+	};
+
 	static void reclaimIndex(uint32_t idx);
 	
 	static int addVerbs(const std::map<std::string,std::string>& verbs,ResourceHandlerNode& resourceHandlerNode,ResourceHandler& newHandler);
@@ -291,7 +378,7 @@ public:
 	void				dbg_printVerbCacheTableForResource(const std::string& mime);
 	void 				dbg_printVerbCacheTableForRedirect(const std::string& url);
 	void				dbg_printVerbCacheTableForScheme(const std::string& url);
-	static void			dbg_printVerbCacheTable(const std::map<std::string,VerbCacheEntry> * p_verbCacheTable);
+	static void			dbg_printVerbCacheTable(const FlatMap<std::string,VerbCacheEntry> * p_verbCacheTable);
 	static void			dbg_printResourceHandlerNode(const ResourceHandlerNode * p_resourceHandlerNode,int level=0);
 	static void			dbg_printRedirectHandlerNode(const RedirectHandlerNode * p_redirectHandlerNode,int level=0);
 	
@@ -301,17 +388,65 @@ private:
 	RedirectHandlerNode *	getRedirectHandlerNode(const std::string& url);
 	RedirectHandlerNode *	getSchemeHandlerNode(const std::string& url);
 	
+	// redirect resolution through m_resolutionCache; call with m_lock held (for reading at least)
+	RedirectHandlerNode *	resolveRedirect(const std::string& url,RedirectMatcher::Forms forms);
+	void					resolveAllRedirects(const std::string& url,std::vector<RedirectHandlerNode *>& r_matches);
+	bool					lookupResolutionCache(const std::string& key,std::vector<RedirectHandlerNode *>& r_matches);
+	void					storeResolutionCache(const std::string& key,const std::vector<RedirectHandlerNode *>& matches);
+	void					tablesChanged() { ++m_generation; }		//with m_lock held for writing
+	
+	// m_handlerLocations / m_*KeysByAppId upkeep; call with m_lock held for writing whenever handlers are put into a node
+	void					indexResourceHandler(const std::string& mimeType,ResourceHandler * p_handler);
+	void					indexRedirectHandler(const std::string& url,RedirectHandler * p_handler);
+	void					indexResourceNode(const std::string& mimeType,ResourceHandlerNode * p_rhn);
+	void					indexRedirectNode(const std::string& url,RedirectHandlerNode * p_rhn);
+	
+	// puts nodes built outside the lock into the tables (replacing any for the same mime type / url) and, if p_extensionMap
+	// is given, swaps in that extension map, all in one short write section. The replaced nodes are deleted after it
+	void					installNodes(std::map<std::string,std::string> * p_extensionMap,
+										 const std::vector<ResourceHandlerNode *>& resourceNodes,
+										 const std::vector<RedirectHandlerNode *>& redirectNodes);
+	ResourceHandlerNode *	resourceNodeByIndex(uint32_t index);		//the node holding the handler with this index, or NULL
+	RedirectHandlerNode *	redirectNodeByIndex(uint32_t index);
+	
+	struct HandlerLocation {
+		HandlerLocation() : isRedirect(false) {}
+		bool isRedirect;
+		std::string key;			//mime type or url of the node
+	};
+	
+	struct ResolutionCacheEntry {
+		uint32_t generation;
+		std::vector<RedirectHandlerNode *> matches;
+		std::list<std::string>::iterator lruPos;
+	};
+	
 /// ------------------------------------------- vars -------------------------------------------------------------------
 	
 	static MimeSystem * s_p_inst;
 	
 	static Mutex 	s_mutex;
-	Mutex 			m_mutex;
+	ReadWriteLock	m_lock;			//lookups share it; anything that changes the tables holds it alone
 	
 	std::map<std::string,MimeSystem::ResourceHandlerNode *> m_resourceHandlerMap;
 	std::map<std::string,MimeSystem::RedirectHandlerNode *> m_redirectHandlerMap;
+	RedirectMatcher											m_redirectMatcher;		//kept in step with m_redirectHandlerMap
 	
 	std::map<std::string,std::string>						m_extensionToMimeMap;
+	
+	//lookups by handler index and by appId without going through every node. Entries aren't removed along with the handlers,
+	//so they can be stale: they are only hints, always checked against the node they point to
+	std::vector<HandlerLocation>							m_handlerLocations;		//by handler index (these are dense; see assignIndex())
+	std::map<std::string,std::set<std::string> >			m_resourceKeysByAppId;	//appId -> mime types it has (had) handlers for
+	std::map<std::string,std::set<std::string> >			m_redirectKeysByAppId;	//appId -> urls it has (had) handlers for
+	
+	uint32_t												m_generation;			//bumped on every change to the tables
+	
+	Mutex													m_resolutionCacheMutex;	//lookups fill the cache while sharing m_lock
+	std::map<std::string,ResolutionCacheEntry>				m_resolutionCache;		//(query, url) -> matching redirect nodes
+	std::list<std::string>									m_resolutionCacheLru;	//most recently used first
+	uint32_t												m_resolutionCacheHits;
+	uint32_t												m_resolutionCacheMisses;
 	static uint32_t 	s_genIndex;
 	static uint32_t		s_lastAssignedIndex;
 	static std::vector<uint32_t> s_indexRecycler;
@@ -320,8 +455,8 @@ private:
 	typedef std::map<std::string,MimeSystem::ResourceHandlerNode *>::iterator ResourceMapIterType;
 	typedef std::map<std::string,MimeSystem::RedirectHandlerNode *> RedirectMapType;
 	typedef std::map<std::string,MimeSystem::RedirectHandlerNode *>::iterator RedirectMapIterType;
-	typedef std::map<std::string,MimeSystem::VerbCacheEntry> VerbCacheMapType;
-	typedef std::map<std::string,MimeSystem::VerbCacheEntry>::iterator VerbCacheMapIterType;
+	typedef FlatMap<std::string,MimeSystem::VerbCacheEntry> VerbCacheMapType;
+	typedef FlatMap<std::string,MimeSystem::VerbCacheEntry>::iterator VerbCacheMapIterType;
 };
 
 #endif /*MIMESYSTEM_H_*/
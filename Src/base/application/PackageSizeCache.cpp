@@ -0,0 +1,302 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+
+
+#include "Common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <json.h>
+#include <json_util.h>
+
+#include "PackageSizeCache.h"
+#include "ApplicationInstaller.h"
+#include "ApplicationManager.h"
+#include "PackageDescription.h"
+#include "HostBase.h"
+#include "JSONUtils.h"
+#include "MutexLocker.h"
+#include "Utils.h"
+
+const char* PackageSizeCache::s_cacheFile = "/var/luna/data/.package-sizes.json";
+
+static PackageSizeCache* s_instance = 0;
+
+PackageSizeCache* PackageSizeCache::instance()
+{
+	if (!s_instance)
+		s_instance = new PackageSizeCache();
+	return s_instance;
+}
+
+PackageSizeCache::PackageSizeCache()
+	: m_refreshPool(NULL)
+	, m_mainContext(g_main_loop_get_context(HostBase::instance()->mainLoop()))
+	, m_savePending(false)
+{
+	load();
+}
+
+PackageSizeCache::~PackageSizeCache()
+{
+}
+
+//static
+uint64_t PackageSizeCache::stampFor(const std::vector<std::string>& folders)
+{
+	//FNV-1a over (dev, ino, mtime) of each folder; a folder that's missing counts too
+	uint64_t stamp = 14695981039346656037ULL;
+	for (std::vector<std::string>::const_iterator it = folders.begin();it != folders.end();++it) {
+		struct stat st;
+		uint64_t parts[4] = { 0, 0, 0, 0 };
+		if (::stat(it->c_str(),&st) == 0) {
+			parts[0] = (uint64_t)st.st_dev;
+			parts[1] = (uint64_t)st.st_ino;
+			parts[2] = (uint64_t)st.st_mtim.tv_sec;
+			parts[3] = (uint64_t)st.st_mtim.tv_nsec;
+		}
+		const unsigned char* p = (const unsigned char*)parts;
+		for (size_t i = 0;i < sizeof(parts);++i) {
+			stamp ^= p[i];
+			stamp *= 1099511628211ULL;
+		}
+	}
+	return stamp;
+}
+
+bool PackageSizeCache::lookup(const std::string& packageId,const std::string& version,uint64_t stamp,uint64_t& r_size,bool& r_stale)
+{
+	MutexLocker locker(&m_mutex);
+
+	std::map<std::string,Entry>::const_iterator it = m_entries.find(packageId);
+	if (it == m_entries.end())
+		return false;
+
+	r_size = it->second.size;
+	r_stale = (it->second.version != version || it->second.stamp != stamp);
+	return true;
+}
+
+void PackageSizeCache::store(const std::string& packageId,const std::string& version,uint64_t stamp,uint64_t size)
+{
+	MutexLocker locker(&m_mutex);
+
+	Entry& entry = m_entries[packageId];
+	if (entry.version == version && entry.stamp == stamp && entry.size == size)
+		return;
+	entry.version = version;
+	entry.stamp = stamp;
+	entry.size = size;
+	scheduleSave();
+}
+
+void PackageSizeCache::invalidate(const std::string& packageId)
+{
+	MutexLocker locker(&m_mutex);
+
+	if (m_entries.erase(packageId))
+		scheduleSave();
+
+	//a refresh that's queued or running measured (or will measure) what's being removed; cbRefreshDone() drops it
+	if (m_refreshing.count(packageId))
+		++m_generations[packageId];
+}
+
+void PackageSizeCache::refresh(const std::string& packageId,const std::string& version,const std::vector<std::string>& folders,const std::string& fsPath)
+{
+	MutexLocker locker(&m_mutex);
+
+	if (!m_refreshing.insert(packageId).second)
+		return;		//already on its way
+
+	if (!m_refreshPool) {
+		//one thread: these are only catching up, they shouldn't compete with anything the user is waiting for
+		m_refreshPool = g_thread_pool_new(refreshWorkerFn,m_mainContext,1,FALSE,NULL);
+		if (!m_refreshPool) {
+			g_warning("%s: unable to create the refresh thread; %s keeps its stale size", __FUNCTION__, packageId.c_str());
+			m_refreshing.erase(packageId);
+			return;
+		}
+	}
+
+	RefreshJob* job = new RefreshJob();
+	job->packageId = packageId;
+	job->version = version;
+	job->folders = folders;
+	job->fsPath = fsPath;
+	job->generation = m_generations[packageId];
+	job->measured = false;
+	job->size = 0;
+	job->stamp = 0;
+	g_thread_pool_push(m_refreshPool,job,NULL);
+}
+
+//runs on m_refreshPool's thread. Only measures; the result is stored (or dropped) by cbRefreshDone(), on the main loop
+void PackageSizeCache::refreshWorkerFn(gpointer data,gpointer userData)
+{
+	RefreshJob* job = (RefreshJob*)data;
+	job->measured = ApplicationInstaller::measurePackageFolders(job->fsPath,job->folders,job->size,job->stamp);
+
+	GSource* source = g_idle_source_new();
+	g_source_set_callback(source,cbRefreshDone,job,NULL);
+	g_source_attach(source,(GMainContext*)userData);
+	g_source_unref(source);
+}
+
+gboolean PackageSizeCache::cbRefreshDone(gpointer data)
+{
+	RefreshJob* job = (RefreshJob*)data;
+	PackageSizeCache* cache = PackageSizeCache::instance();
+
+	bool current;
+	{
+		MutexLocker locker(&cache->m_mutex);
+		cache->m_refreshing.erase(job->packageId);
+		std::map<std::string,uint32_t>::iterator it = cache->m_generations.find(job->packageId);
+		current = (it->second == job->generation);
+		cache->m_generations.erase(it);		//only needed while a refresh is pending
+	}
+
+	if (!current) {
+		g_message("%s: %s was invalidated while it was being measured; dropping the result", __FUNCTION__, job->packageId.c_str());
+		delete job;
+		return FALSE;
+	}
+
+	if (job->measured)
+		cache->store(job->packageId,job->version,job->stamp,job->size);
+
+	PackageDescription* packageDesc = ApplicationManager::instance()->getPackageInfoByPackageId(job->packageId);
+	if (packageDesc && packageDesc->version() == job->version && job->measured && job->size)
+		packageDesc->setPackageSize(job->size);
+
+	delete job;
+	return FALSE;
+}
+
+void PackageSizeCache::load()
+{
+	json_object* root = json_object_from_file((char*)s_cacheFile);
+	if (!root)
+		return;
+
+	json_object* packages = JsonGetObject(root,"packages");
+	if (packages && json_object_is_type(packages,json_type_object)) {
+		json_object_object_foreach(packages,key,val) {
+			std::string version, stamp, size;
+			if (!extractFromJson(val,"version",version) || !extractFromJson(val,"stamp",stamp) || !extractFromJson(val,"size",size))
+				continue;
+			Entry& entry = m_entries[key];
+			entry.version = version;
+			entry.stamp = strtoull(stamp.c_str(),NULL,10);
+			entry.size = strtoull(size.c_str(),NULL,10);
+		}
+	}
+
+	json_object_put(root);
+}
+
+///BE SURE TO EXTERNALLY LOCK m_mutex!!!
+void PackageSizeCache::scheduleSave()
+{
+	if (m_savePending)
+		return;
+	m_savePending = true;
+
+	GSource* source = g_idle_source_new();
+	g_source_set_priority(source,G_PRIORITY_LOW);
+	g_source_set_callback(source,cbSave,this,NULL);
+	g_source_attach(source,m_mainContext);
+	g_source_unref(source);
+}
+
+gboolean PackageSizeCache::cbSave(gpointer data)
+{
+	PackageSizeCache* cache = (PackageSizeCache*)data;
+
+	json_object* root = json_object_new_object();
+	json_object* packages = json_object_new_object();
+	{
+		MutexLocker locker(&cache->m_mutex);
+		cache->m_savePending = false;
+
+		for (std::map<std::string,Entry>::const_iterator it = cache->m_entries.begin();it != cache->m_entries.end();++it) {
+			json_object* entry = json_object_new_object();
+			json_object_object_add(entry,(char*)"version",json_object_new_string(it->second.version.c_str()));
+			json_object_object_add(entry,(char*)"stamp",json_object_new_string(toSTLString<uint64_t>(it->second.stamp).c_str()));
+			json_object_object_add(entry,(char*)"size",json_object_new_string(toSTLString<uint64_t>(it->second.size).c_str()));
+			json_object_object_add(packages,(char*)it->first.c_str(),entry);
+		}
+	}
+	json_object_object_add(root,(char*)"packages",packages);
+
+	std::string contents = json_object_to_json_string(root);
+	json_object_put(root);
+	contents += "\n";
+
+	//write a temp file of its own next to it, sync it and rename it over the old one, so a crash leaves one or the other whole
+	std::string tmpPath = std::string(s_cacheFile) + ".XXXXXX";
+	int fd = ::mkstemp(&tmpPath[0]);
+	if (fd < 0) {
+		g_warning("%s: unable to create %s: %s", __FUNCTION__, tmpPath.c_str(), strerror(errno));
+		return FALSE;
+	}
+	fchmod(fd,0644);
+
+	const char* p = contents.data();
+	size_t remaining = contents.size();
+	while (remaining) {
+		ssize_t n = ::write(fd,p,remaining);
+		if (n <= 0)
+			break;
+		p += n;
+		remaining -= n;
+	}
+
+	if (remaining || fsync(fd) != 0) {
+		g_warning("%s: unable to write %s", __FUNCTION__, tmpPath.c_str());
+		::close(fd);
+		::unlink(tmpPath.c_str());
+		return FALSE;
+	}
+	::close(fd);
+
+	if (::rename(tmpPath.c_str(),s_cacheFile) != 0) {
+		g_warning("%s: unable to replace %s", __FUNCTION__, s_cacheFile);
+		::unlink(tmpPath.c_str());
+		return FALSE;
+	}
+
+	gchar* dirPath = g_path_get_dirname(s_cacheFile);
+	int dirFd = ::open(dirPath,O_RDONLY | O_DIRECTORY);
+	if (dirFd >= 0) {
+		fsync(dirFd);
+		::close(dirFd);
+	}
+	g_free(dirPath);
+
+	return FALSE;
+}
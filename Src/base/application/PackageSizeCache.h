@@ -0,0 +1,108 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+
+
+#ifndef PACKAGESIZECACHE_H_
+#define PACKAGESIZECACHE_H_
+
+#include "Common.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <glib.h>
+
+#include "Mutex.h"
+
+/*
+ * PackageSizeCache remembers the measured size of each installed package across restarts, so getSizeOfApps can answer
+ * without walking the package's folders again.
+ *
+ * Entries are keyed by package id and are only good for the package version they were measured for and for a "stamp" of
+ * the package's folders (device, inode and mtime of each), so a reinstall or a change to those folders makes them stale.
+ * A stale size is still handed out, and refresh() measures the package again on a background thread. The cache is saved
+ * (atomically) to disk from the main loop whenever it changes.
+ *
+ * The stamp only covers each top-level folder's own inode and mtime. Adding, removing or renaming an entry directly in one of
+ * those folders changes it; a file that's rewritten in place, or anything changed further down the tree, does not, and goes
+ * unnoticed until the package's version changes (an install) or the entry is invalidate()d.
+ *
+ * A refresh only measures; it doesn't write the package's manifest. Its result is dropped if the package was invalidate()d
+ * while it ran.
+ */
+class PackageSizeCache
+{
+public:
+
+	static PackageSizeCache* instance();
+
+	// r_stale is set if the size is known but not for this version and stamp; it's still returned, but should be refresh()ed
+	bool lookup(const std::string& packageId,const std::string& version,uint64_t stamp,uint64_t& r_size,bool& r_stale);
+	void store(const std::string& packageId,const std::string& version,uint64_t stamp,uint64_t size);
+	void invalidate(const std::string& packageId);
+
+	// measures the package again on a background thread, and updates its PackageDescription once that's done. Asking again
+	// while that's pending does nothing
+	void refresh(const std::string& packageId,const std::string& version,const std::vector<std::string>& folders,const std::string& fsPath);
+
+	static uint64_t stampFor(const std::vector<std::string>& folders);
+
+private:
+
+	PackageSizeCache();
+	~PackageSizeCache();
+
+	struct Entry {
+		std::string version;
+		uint64_t stamp;
+		uint64_t size;
+	};
+
+	struct RefreshJob {
+		std::string packageId;
+		std::string version;
+		std::vector<std::string> folders;
+		std::string fsPath;
+		uint32_t generation;		// the package's m_generations value when the job was queued
+		bool measured;
+		uint64_t size;
+		uint64_t stamp;
+	};
+
+	void load();
+	void scheduleSave();		///BE SURE TO EXTERNALLY LOCK m_mutex!!!
+	static gboolean cbSave(gpointer data);
+	static void refreshWorkerFn(gpointer data,gpointer userData);
+	static gboolean cbRefreshDone(gpointer data);
+
+	static const char* s_cacheFile;
+
+	Mutex m_mutex;
+	std::map<std::string,Entry> m_entries;
+	std::set<std::string> m_refreshing;		// package ids with a RefreshJob queued or running
+	std::map<std::string,uint32_t> m_generations;		// bumped by invalidate() while one runs, so its result is dropped
+	GThreadPool* m_refreshPool;
+	GMainContext* m_mainContext;
+	bool m_savePending;
+};
+
+#endif /* PACKAGESIZECACHE_H_ */
@@ -0,0 +1,80 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+
+
+#include "Common.h"
+
+#include "ReadWriteLock.h"
+
+ReadWriteLock::ReadWriteLock()
+	: m_writer(NULL)
+	, m_writeDepth(0)
+{
+	pthread_rwlock_init(&m_lock, NULL);
+}
+
+ReadWriteLock::~ReadWriteLock()
+{
+	pthread_rwlock_destroy(&m_lock);
+}
+
+// only the writing thread ever sets m_writer to itself, and clears it before it lets go, so no other thread can get a false
+// positive here. m_writeDepth is only looked at once this says it is ours
+bool ReadWriteLock::heldForWriteByThisThread() const
+{
+	return g_atomic_pointer_get(&m_writer) == (gpointer)g_thread_self();
+}
+
+void ReadWriteLock::lockForRead()
+{
+	if (heldForWriteByThisThread()) {
+		++m_writeDepth;
+		return;
+	}
+	pthread_rwlock_rdlock(&m_lock);
+}
+
+void ReadWriteLock::unlockRead()
+{
+	if (heldForWriteByThisThread()) {
+		--m_writeDepth;
+		return;
+	}
+	pthread_rwlock_unlock(&m_lock);
+}
+
+void ReadWriteLock::lockForWrite()
+{
+	if (heldForWriteByThisThread()) {
+		++m_writeDepth;
+		return;
+	}
+	pthread_rwlock_wrlock(&m_lock);
+	m_writeDepth = 1;
+	g_atomic_pointer_set(&m_writer, (gpointer)g_thread_self());
+}
+
+void ReadWriteLock::unlockWrite()
+{
+	if (--m_writeDepth > 0)
+		return;
+	g_atomic_pointer_set(&m_writer, NULL);
+	pthread_rwlock_unlock(&m_lock);
+}
@@ -0,0 +1,77 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+
+
+#ifndef READWRITELOCK_H_
+#define READWRITELOCK_H_
+
+#include "Common.h"
+
+#include <pthread.h>
+#include <glib.h>
+
+/*
+ * A reader/writer lock for tables that are read all the time and changed rarely: any number of readers hold it at once, a writer
+ * holds it alone. Like the recursive Mutex it replaces, the thread holding it for writing may lock it again (for reading or writing)
+ * from the helpers it calls. A reader must not ask for the write lock while it holds the read lock.
+ */
+class ReadWriteLock
+{
+public:
+
+	ReadWriteLock();
+	~ReadWriteLock();
+
+	void lockForRead();
+	void unlockRead();
+	void lockForWrite();
+	void unlockWrite();
+
+private:
+
+	ReadWriteLock(const ReadWriteLock&);
+	ReadWriteLock& operator=(const ReadWriteLock&);
+
+	bool heldForWriteByThisThread() const;
+
+	pthread_rwlock_t m_lock;
+	gpointer m_writer;		// the GThread holding the write lock, or NULL. Only read/written with g_atomic_pointer_*
+	int m_writeDepth;		// only touched by m_writer, while it holds the lock
+};
+
+class ReadLocker
+{
+public:
+	ReadLocker(ReadWriteLock* lock) : m_lock(lock) { m_lock->lockForRead(); }
+	~ReadLocker() { m_lock->unlockRead(); }
+private:
+	ReadWriteLock* m_lock;
+};
+
+class WriteLocker
+{
+public:
+	WriteLocker(ReadWriteLock* lock) : m_lock(lock) { m_lock->lockForWrite(); }
+	~WriteLocker() { m_lock->unlockWrite(); }
+private:
+	ReadWriteLock* m_lock;
+};
+
+#endif /* READWRITELOCK_H_ */
@@ -0,0 +1,450 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+
+
+#include "Common.h"
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "RegistrySnapshot.h"
+#include "MutexLocker.h"
+
+/*
+ * File layout (host byte order; the snapshot never leaves the device):
+ *
+ *   char[8]   magic "LAMREGS\0"
+ *   uint32    version
+ *   uint32    number of source entries
+ *   uint32    number of icon entries
+ *   string    locale
+ *   source entries:	string folderPath, uint32 number of dir stamps, stamp dirs[], string jsonPath, stamp json,
+ *						string description
+ *   icon entries:		string iconPath, stamp icon
+ *
+ * where string = uint32 length + bytes (no terminator) and stamp = uint64 ino, int64 mtime, uint64 size
+ */
+
+static const char s_magic[8] = { 'L','A','M','R','E','G','S','\0' };
+const uint32_t RegistrySnapshot::s_version = 2;
+
+static RegistrySnapshot* s_instance = 0;
+
+namespace {
+
+class SnapshotReader
+{
+public:
+	SnapshotReader(const char* data,size_t len) : m_p(data), m_end(data+len), m_ok(true) {}
+
+	bool ok() const { return m_ok; }
+
+	bool bytes(void* dst,size_t n) {
+		if (!m_ok || (size_t)(m_end - m_p) < n) {
+			m_ok = false;
+			return false;
+		}
+		memcpy(dst,m_p,n);
+		m_p += n;
+		return true;
+	}
+
+	uint32_t u32() { uint32_t v = 0; bytes(&v,sizeof(v)); return v; }
+	uint64_t u64() { uint64_t v = 0; bytes(&v,sizeof(v)); return v; }
+	int64_t  i64() { int64_t v = 0; bytes(&v,sizeof(v)); return v; }
+
+	std::string str() {
+		uint32_t n = u32();
+		if (!m_ok || (size_t)(m_end - m_p) < n) {
+			m_ok = false;
+			return std::string();
+		}
+		std::string s(m_p,n);
+		m_p += n;
+		return s;
+	}
+
+	RegistrySnapshot::FileStamp stamp() {
+		RegistrySnapshot::FileStamp st;
+		st.ino = u64();
+		st.mtime = i64();
+		st.size = u64();
+		return st;
+	}
+
+private:
+	const char* m_p;
+	const char* m_end;
+	bool m_ok;
+};
+
+}
+
+static void appendBytes(std::string& buf,const void* p,size_t n)
+{
+	buf.append(static_cast<const char*>(p),n);
+}
+
+static void appendU32(std::string& buf,uint32_t v) { appendBytes(buf,&v,sizeof(v)); }
+static void appendU64(std::string& buf,uint64_t v) { appendBytes(buf,&v,sizeof(v)); }
+static void appendI64(std::string& buf,int64_t v) { appendBytes(buf,&v,sizeof(v)); }
+
+static void appendString(std::string& buf,const std::string& s)
+{
+	appendU32(buf,(uint32_t)s.size());
+	buf.append(s);
+}
+
+static void appendStamp(std::string& buf,const RegistrySnapshot::FileStamp& st)
+{
+	appendU64(buf,st.ino);
+	appendI64(buf,st.mtime);
+	appendU64(buf,st.size);
+}
+
+bool RegistrySnapshot::FileStamp::fromPath(const std::string& path,FileStamp& r_stamp)
+{
+	struct stat stBuf;
+	if (::stat(path.c_str(),&stBuf) != 0)
+		return false;
+
+	r_stamp.ino = stBuf.st_ino;
+	r_stamp.mtime = stBuf.st_mtime;
+	r_stamp.size = stBuf.st_size;
+	return true;
+}
+
+RegistrySnapshot* RegistrySnapshot::instance()
+{
+	if (!s_instance)
+		s_instance = new RegistrySnapshot();
+	return s_instance;
+}
+
+RegistrySnapshot::RegistrySnapshot()
+	: m_active(false)
+{
+}
+
+RegistrySnapshot::~RegistrySnapshot()
+{
+}
+
+void RegistrySnapshot::beginScan(const std::string& snapshotPath,const std::string& locale)
+{
+	MutexLocker locker(&m_mutex);
+
+	m_snapshotPath = snapshotPath;
+	m_locale = locale;
+	m_prevSources.clear();
+	m_prevIcons.clear();
+	m_sources.clear();
+	m_icons.clear();
+
+	if (!load(snapshotPath)) {
+		m_prevSources.clear();
+		m_prevIcons.clear();
+	}
+
+	m_active = true;
+}
+
+bool RegistrySnapshot::load(const std::string& snapshotPath)
+{
+	int fd = ::open(snapshotPath.c_str(),O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat stBuf;
+	if (fstat(fd,&stBuf) != 0 || stBuf.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+
+	void* map = mmap(0,stBuf.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+	::close(fd);
+	if (map == MAP_FAILED) {
+		g_warning("%s: unable to map %s",__FUNCTION__,snapshotPath.c_str());
+		return false;
+	}
+
+	SnapshotReader rd(static_cast<const char*>(map),stBuf.st_size);
+	bool success = false;
+	uint32_t numSources, numIcons;
+	std::string locale;
+
+	char magic[sizeof(s_magic)];
+	if (!rd.bytes(magic,sizeof(magic)) || memcmp(magic,s_magic,sizeof(s_magic)) != 0) {
+		g_warning("%s: %s is not a registry snapshot",__FUNCTION__,snapshotPath.c_str());
+		goto Done;
+	}
+	if (rd.u32() != s_version) {
+		g_message("%s: %s has a different version; ignoring it",__FUNCTION__,snapshotPath.c_str());
+		goto Done;
+	}
+
+	numSources = rd.u32();
+	numIcons = rd.u32();
+	locale = rd.str();
+	if (!rd.ok() || locale != m_locale) {
+		//localized appinfos may resolve differently now
+		goto Done;
+	}
+
+	for (uint32_t i = 0; i < numSources && rd.ok(); ++i) {
+		std::string folderPath = rd.str();
+		SourceEntry entry;
+		uint32_t numDirs = rd.u32();
+		for (uint32_t d = 0; d < numDirs && rd.ok(); ++d)
+			entry.dirStamps.push_back(rd.stamp());
+		entry.jsonPath = rd.str();
+		entry.jsonStamp = rd.stamp();
+		entry.description = rd.str();
+		if (rd.ok())
+			m_prevSources[folderPath] = entry;
+	}
+
+	for (uint32_t i = 0; i < numIcons && rd.ok(); ++i) {
+		std::string iconPath = rd.str();
+		FileStamp st = rd.stamp();
+		if (rd.ok())
+			m_prevIcons[IconKey(iconPath,st)] = st.ino;
+	}
+
+	success = rd.ok();
+	if (!success)
+		g_warning("%s: %s is truncated or corrupt",__FUNCTION__,snapshotPath.c_str());
+	else
+		g_message("%s: loaded %d folder and %d icon entries from %s",__FUNCTION__,
+				  (int)m_prevSources.size(),(int)m_prevIcons.size(),snapshotPath.c_str());
+
+Done:
+
+	munmap(map,stBuf.st_size);
+	return success;
+}
+
+bool RegistrySnapshot::commitScan()
+{
+	MutexLocker locker(&m_mutex);
+
+	if (!m_active)
+		return false;
+
+	m_active = false;
+	m_prevSources.clear();
+	m_prevIcons.clear();
+
+	std::string buf;
+	appendBytes(buf,s_magic,sizeof(s_magic));
+	appendU32(buf,s_version);
+	appendU32(buf,(uint32_t)m_sources.size());
+	appendU32(buf,(uint32_t)m_icons.size());
+	appendString(buf,m_locale);
+
+	for (std::map<std::string,SourceEntry>::const_iterator it = m_sources.begin(); it != m_sources.end(); ++it) {
+		appendString(buf,it->first);
+		appendU32(buf,(uint32_t)it->second.dirStamps.size());
+		for (std::vector<FileStamp>::const_iterator dit = it->second.dirStamps.begin(); dit != it->second.dirStamps.end(); ++dit)
+			appendStamp(buf,*dit);
+		appendString(buf,it->second.jsonPath);
+		appendStamp(buf,it->second.jsonStamp);
+		appendString(buf,it->second.description);
+	}
+
+	for (std::map<IconKey,uint64_t>::const_iterator it = m_icons.begin(); it != m_icons.end(); ++it) {
+		FileStamp st;
+		st.ino = it->second;
+		st.mtime = it->first.mtime;
+		st.size = it->first.size;
+		appendString(buf,it->first.path);
+		appendStamp(buf,st);
+	}
+
+	m_sources.clear();
+	m_icons.clear();
+
+	//write a temp file of its own and rename it over the old one so a crash never leaves a half-written snapshot behind
+	std::string tmpPath = m_snapshotPath + ".XXXXXX";
+	int fd = mkstemp(&tmpPath[0]);
+	if (fd < 0) {
+		g_warning("%s: unable to create %s",__FUNCTION__,tmpPath.c_str());
+		return false;
+	}
+	fchmod(fd,0644);
+
+	bool success = true;
+	const char* p = buf.data();
+	size_t remaining = buf.size();
+	while (remaining) {
+		ssize_t n = ::write(fd,p,remaining);
+		if (n <= 0) {
+			success = false;
+			break;
+		}
+		p += n;
+		remaining -= n;
+	}
+
+	if (success && fsync(fd) != 0)
+		success = false;
+	::close(fd);
+
+	if (!success || ::rename(tmpPath.c_str(),m_snapshotPath.c_str()) != 0) {
+		g_warning("%s: unable to write %s",__FUNCTION__,m_snapshotPath.c_str());
+		::unlink(tmpPath.c_str());
+		return false;
+	}
+
+	//and the rename itself
+	gchar* dirPath = g_path_get_dirname(m_snapshotPath.c_str());
+	int dirFd = ::open(dirPath,O_RDONLY | O_DIRECTORY);
+	if (dirFd >= 0) {
+		fsync(dirFd);
+		::close(dirFd);
+	}
+	g_free(dirPath);
+
+	return true;
+}
+
+//the directories whose listing decides which manifest parseApplicationFolder()/parsePackageFolder() end up reading
+void RegistrySnapshot::probeDirs(const std::string& folderPath,const std::string& locale,std::vector<std::string>& r_dirs)
+{
+	r_dirs.clear();
+	r_dirs.push_back(folderPath);
+	r_dirs.push_back(folderPath + "/resources");
+
+	std::string language, region;
+	std::size_t underscorePos = locale.find("_");
+	if (underscorePos != std::string::npos) {
+		language = locale.substr(0, underscorePos);
+		region = locale.substr(underscorePos+1);
+	}
+
+	r_dirs.push_back(folderPath + "/resources/" + language);
+	if (!language.empty() && !region.empty())
+		r_dirs.push_back(folderPath + "/resources/" + language + "/" + region);
+	r_dirs.push_back(folderPath + "/resources/" + locale);
+}
+
+void RegistrySnapshot::stampDirs(const std::vector<std::string>& dirs,std::vector<FileStamp>& r_stamps)
+{
+	r_stamps.clear();
+	for (std::vector<std::string>::const_iterator it = dirs.begin(); it != dirs.end(); ++it) {
+		FileStamp st;
+		if (!FileStamp::fromPath(*it,st))
+			st = FileStamp();		//missing; must still be missing for the entry to be used
+		r_stamps.push_back(st);
+	}
+}
+
+bool RegistrySnapshot::lookupSource(const std::string& folderPath,std::string& r_jsonPath,std::string& r_description,SourceStamps& r_stamps) const
+{
+	r_stamps = SourceStamps();
+
+	SourceEntry entry;
+	std::string locale;
+	bool found = false;
+	{
+		MutexLocker locker(&m_mutex);
+		if (!m_active)
+			return false;
+
+		std::map<std::string,SourceEntry>::const_iterator it = m_prevSources.find(folderPath);
+		if (it != m_prevSources.end()) {
+			entry = it->second;
+			found = true;
+		}
+		locale = m_locale;
+	}
+
+	//the directories first: they decide which manifest gets read
+	std::vector<std::string> dirs;
+	probeDirs(folderPath,locale,dirs);
+	stampDirs(dirs,r_stamps.dirStamps);
+	if (!found || r_stamps.dirStamps != entry.dirStamps)
+		return false;
+
+	stampJson(entry.jsonPath,r_stamps);
+	if (r_stamps.jsonStamp == FileStamp() || r_stamps.jsonStamp != entry.jsonStamp)
+		return false;
+
+	r_jsonPath = entry.jsonPath;
+	r_description = entry.description;
+	return true;
+}
+
+//static
+void RegistrySnapshot::stampJson(const std::string& jsonPath,SourceStamps& r_stamps)
+{
+	if (!FileStamp::fromPath(jsonPath,r_stamps.jsonStamp))
+		r_stamps.jsonStamp = FileStamp();		//recordSource() won't record it
+}
+
+void RegistrySnapshot::recordSource(const std::string& folderPath,const std::string& jsonPath,const SourceStamps& stamps,const std::string& description)
+{
+	//stamps from lookupSource() while recording was off, or a manifest that couldn't be stat'ed
+	if (stamps.dirStamps.empty() || stamps.jsonStamp == FileStamp())
+		return;
+
+	SourceEntry entry;
+	entry.jsonPath = jsonPath;
+	entry.description = description;
+	entry.dirStamps = stamps.dirStamps;
+	entry.jsonStamp = stamps.jsonStamp;
+
+	MutexLocker locker(&m_mutex);
+	if (m_active)
+		m_sources[folderPath] = entry;
+}
+
+bool RegistrySnapshot::isKnownGoodIcon(const std::string& iconPath,FileStamp& r_stamp) const
+{
+	r_stamp = FileStamp();
+	if (!FileStamp::fromPath(iconPath,r_stamp)) {
+		r_stamp = FileStamp();
+		return false;
+	}
+
+	MutexLocker locker(&m_mutex);
+	if (!m_active)
+		return false;
+
+	std::map<IconKey,uint64_t>::const_iterator it = m_prevIcons.find(IconKey(iconPath,r_stamp));
+	return (it != m_prevIcons.end()) && (it->second == r_stamp.ino);
+}
+
+void RegistrySnapshot::recordGoodIcon(const std::string& iconPath,const FileStamp& stamp)
+{
+	if (stamp.ino == 0)
+		return;
+
+	MutexLocker locker(&m_mutex);
+	if (m_active)
+		m_icons[IconKey(iconPath,stamp)] = stamp.ino;
+}
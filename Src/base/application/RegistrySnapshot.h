@@ -0,0 +1,142 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2008-2013 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+
+
+#ifndef REGISTRYSNAPSHOT_H_
+#define REGISTRYSNAPSHOT_H_
+
+#include "Common.h"
+
+#include <string>
+#include <map>
+#include <vector>
+#include <stdint.h>
+
+#include "Mutex.h"
+
+/*
+ * RegistrySnapshot remembers, from one initial scan to the next, the results of the filesystem probing done while scanning:
+ *
+ *  - which (possibly localized) appinfo.json / packageinfo.json / services.json a folder was read from, so the next boot can
+ *    open it directly instead of probing up to four locations per folder
+ *  - optionally, the description parsed from that file, in whatever serialized form the caller chose (see
+ *    ApplicationDescription::toSnapshotString()), so an unchanged manifest doesn't have to be parsed again
+ *  - which icon files were found to be loadable images, so launch points don't have to decode every icon just to validate it
+ *
+ * A folder entry carries the stamp of the manifest it was read from and of every directory the localized lookup probes
+ * (the folder, resources/, resources/<language>/, resources/<language>/<region>/ and resources/<locale>/; missing ones are
+ * recorded as missing). Adding, removing or renaming a manifest in any of them changes that directory's mtime, so the entry is
+ * only used while the lookup would still resolve to the same file. Icon entries are keyed by (path, mtime, size) and also
+ * check the inode. The snapshot is a small versioned binary file which is mmap'ed for loading and replaced atomically when the
+ * scan finishes.
+ *
+ * Lookups and recording are only active between beginScan() and commitScan(). Both may be called from the scan worker threads.
+ */
+class RegistrySnapshot
+{
+public:
+
+	struct FileStamp {
+		FileStamp() : ino(0), mtime(0), size(0) {}
+		bool operator==(const FileStamp& c) const { return (ino == c.ino) && (mtime == c.mtime) && (size == c.size); }
+		bool operator!=(const FileStamp& c) const { return !(*this == c); }
+		static bool fromPath(const std::string& path,FileStamp& r_stamp);
+
+		uint64_t ino;
+		int64_t mtime;
+		uint64_t size;
+	};
+
+	// what recordSource() keeps about a folder. The stamps are taken before the folder is parsed: lookupSource() fills in the
+	// directories' (and, on a hit, the manifest's), stampJson() the manifest's just before it's read, so that a change made
+	// while the parse runs leaves the recorded entry stale instead of making an outdated description look current
+	struct SourceStamps {
+		std::vector<FileStamp> dirStamps;
+		FileStamp jsonStamp;
+	};
+
+	static RegistrySnapshot* instance();
+
+	// loads the previous snapshot (if any, and if it was taken with the same locale) and starts recording a new one
+	void beginScan(const std::string& snapshotPath,const std::string& locale);
+	// writes out everything recorded since beginScan() and stops recording
+	bool commitScan();
+
+	// true if folderPath was read from r_jsonPath last time and nothing the lookup depends on has changed since.
+	// r_description is what was recorded along with it (possibly empty). r_stamps is filled in either way (see SourceStamps)
+	bool lookupSource(const std::string& folderPath,std::string& r_jsonPath,std::string& r_description,SourceStamps& r_stamps) const;
+	static void stampJson(const std::string& jsonPath,SourceStamps& r_stamps);
+	void recordSource(const std::string& folderPath,const std::string& jsonPath,const SourceStamps& stamps,const std::string& description);
+
+	// true if iconPath was a loadable image last time and hasn't changed since. r_stamp is filled in with the icon's current
+	// stamp either way (or left zeroed if it can't be stat'ed), and is what should be passed to recordGoodIcon() if the icon
+	// then decodes; taking it before decoding means an icon replaced mid-decode is never recorded as good
+	bool isKnownGoodIcon(const std::string& iconPath,FileStamp& r_stamp) const;
+	void recordGoodIcon(const std::string& iconPath,const FileStamp& stamp);
+
+private:
+
+	RegistrySnapshot();
+	~RegistrySnapshot();
+
+	struct SourceEntry {
+		std::vector<FileStamp> dirStamps;		// one per probeDirs() entry, zeroed if the directory didn't exist
+		std::string jsonPath;
+		FileStamp jsonStamp;
+		std::string description;
+	};
+
+	struct IconKey {
+		IconKey() : mtime(0), size(0) {}
+		IconKey(const std::string& p,const FileStamp& st) : path(p), mtime(st.mtime), size(st.size) {}
+		bool operator<(const IconKey& c) const {
+			if (path != c.path)
+				return path < c.path;
+			if (mtime != c.mtime)
+				return mtime < c.mtime;
+			return size < c.size;
+		}
+
+		std::string path;
+		int64_t mtime;
+		uint64_t size;
+	};
+
+	bool load(const std::string& snapshotPath);
+	static void probeDirs(const std::string& folderPath,const std::string& locale,std::vector<std::string>& r_dirs);
+	static void stampDirs(const std::vector<std::string>& dirs,std::vector<FileStamp>& r_stamps);
+
+	static const uint32_t s_version;
+
+	mutable Mutex m_mutex;
+	bool m_active;
+	std::string m_snapshotPath;
+	std::string m_locale;
+
+	// from the previous snapshot
+	std::map<std::string,SourceEntry> m_prevSources;
+	std::map<IconKey,uint64_t> m_prevIcons;		// -> inode
+
+	// recorded during this scan
+	std::map<std::string,SourceEntry> m_sources;
+	std::map<IconKey,uint64_t> m_icons;
+};
+
+#endif /* REGISTRYSNAPSHOT_H_ */
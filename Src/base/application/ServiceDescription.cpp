@@ -87,6 +87,25 @@ Done:
 	return serviceDesc;
 }
 
+// static
+ServiceDescription* ServiceDescription::fromSnapshotString(const std::string& snapshot)
+{
+	//"<id>\n<json>"; json_object_to_json_string() never emits a raw newline, so the last one is the separator
+	std::string::size_type sep = snapshot.rfind('\n');
+	if (sep == std::string::npos || sep == 0)
+		return NULL;
+
+	ServiceDescription* serviceDesc = new ServiceDescription();
+	serviceDesc->m_id = snapshot.substr(0, sep);
+	serviceDesc->m_jsonString = snapshot.substr(sep + 1);
+	return serviceDesc;
+}
+
+std::string ServiceDescription::toSnapshotString() const
+{
+	return m_id + "\n" + m_jsonString;
+}
+
 json_object* ServiceDescription::toJSON() const
 {
 	json_object* json = json_tokener_parse(m_jsonString.c_str());
@@ -34,6 +34,9 @@ public:
 	~ServiceDescription();
 
 	static ServiceDescription* fromFile(const std::string& filePath);
+	// round-trips through RegistrySnapshot without re-parsing the json
+	static ServiceDescription* fromSnapshotString(const std::string& snapshot);
+	std::string toSnapshotString() const;
 
 	const std::string& id()			const { return m_id; }
 	const std::string& jsonString() const { return m_jsonString; }